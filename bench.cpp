@@ -0,0 +1,350 @@
+#include "filesystem.h"
+#include "treegen.h"
+#include "fmtguard.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
+#include <random>
+using namespace std;
+
+// fsbench: times the core operations on generated trees of growing size.
+//
+// Usage: fsbench [--sizes 1e3,1e4,1e5,1e6] [--ops N] [--repeat N]
+//                [--out FILE] [--baseline FILE] [--label TEXT] [--dir DIR] [--keep]
+//                [--fanout N] [--depth N] [--files N] [--name LEN]
+//                [--size DIST] [--age DAYS] [--seed S]
+//
+// Every size gets a fresh tree from the generator (treegen.h) in its own
+// file system under DIR.  Save and load run --repeat times and report the
+// median; the other operations run --ops times on random targets.
+// --out appends one JSON object per measurement (JSON Lines), and a
+// previous --out file given as --baseline adds a change column.
+
+/*─────────────────────────  Results  ───────────────────────────*/
+namespace {
+    struct Result {
+        uint64_t entries;
+        string op;
+        uint64_t count;
+        double seconds;
+        double nsPerOp() const { return count ? seconds * 1e9 / count : 0; }
+        double perSecond() const { return seconds > 0 ? count / seconds : 0; }
+    };
+
+    double secondsSince(chrono::steady_clock::time_point t0) {
+        return chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    }
+
+    double median(vector<double> v) {
+        sort(v.begin(), v.end());
+        return v.empty() ? 0 : v[v.size() / 2];
+    }
+
+    string jsonEscape(const string& s) {
+        string out;
+        for (char c : s) {
+            if (c == '"' || c == '\\') out += '\\';
+            if (static_cast<unsigned char>(c) >= 0x20) out += c;
+        }
+        return out;
+    }
+
+    // Value of "key": in one line of our own output (numbers only)
+    bool jsonNumber(const string& line, const string& key, double& v) {
+        size_t p = line.find("\"" + key + "\":");
+        if (p == string::npos) return false;
+        v = strtod(line.c_str() + p + key.size() + 3, nullptr);
+        return true;
+    }
+
+    bool jsonString(const string& line, const string& key, string& v) {
+        string tag = "\"" + key + "\":\"";
+        size_t p = line.find(tag);
+        if (p == string::npos) return false;
+        size_t end = line.find('"', p + tag.size());
+        v = line.substr(p + tag.size(), end - p - tag.size());
+        return true;
+    }
+
+    // The only files a run creates in the work directory; nothing else
+    // there is ever removed
+    const char* const DATA = "tree.bin";
+    const char* const SAVED = "saved.bin";
+    const char* const EMPTY = "empty.bin";
+    const char* const DUMP = "tree.out";
+
+    void removeScratch() {
+        error_code ec;
+        for (const char* f : {DATA, SAVED, EMPTY})
+            for (string suffix : {"", ".wal", ".wal.old", ".tmp"})
+                std::filesystem::remove(f + suffix, ec);
+        std::filesystem::remove(DUMP, ec);
+    }
+
+    // ns per operation by (entries, op) from an earlier --out file
+    map<pair<uint64_t, string>, double> readBaseline(const string& filename) {
+        map<pair<uint64_t, string>, double> base;
+        ifstream in(filename);
+        string line, op;
+        double entries, ns;
+        while (getline(in, line))
+            if (jsonNumber(line, "entries", entries) && jsonString(line, "op", op) && jsonNumber(line, "ns_per_op", ns))
+                base[{static_cast<uint64_t>(entries), op}] = ns;
+        return base;
+    }
+}
+
+/*──────────────────────────  Bench  ────────────────────────────*/
+class Bench {
+public:
+    TreeSpec spec;
+    uint64_t ops = 10000;
+    unsigned repeat = 3;
+
+    // Runs every measurement on a tree of `entries` nodes; files are
+    // created in the current directory
+    void run(uint64_t entries, vector<Result>& out);
+
+private:
+    mt19937_64 rng;
+    vector<Directory*> dirs, leaves;
+    vector<File*> files;
+
+    template <class T> T* pick(const vector<T*>& v) { return v[rng() % v.size()]; }
+    void collect(FileSystem& fs);
+};
+
+// Every directory, the leaf directories and every file of the tree
+void Bench::collect(FileSystem& fs) {
+    dirs.clear(); leaves.clear(); files.clear();
+    dirs.push_back(fs.root);
+    for (size_t i = 0; i < dirs.size(); ++i) {
+        Directory* d = dirs[i];
+        if (!d->entries.dirCount()) leaves.push_back(d);
+        d->entries.forEach([&](Directory* sub) { dirs.push_back(sub); },
+                           [&](File* f) { files.push_back(f); });
+    }
+}
+
+void Bench::run(uint64_t entries, vector<Result>& out) {
+    removeScratch();
+    rng.seed(spec.seed);
+    MuteCout mute;
+    auto record = [&](const char* op, uint64_t count, double seconds) {
+        out.push_back({entries, op, count, seconds});
+    };
+    // Times fn(i) for i < n
+    auto timed = [&](const char* op, uint64_t n, const function<void(uint64_t)>& fn) {
+        auto t0 = chrono::steady_clock::now();
+        for (uint64_t i = 0; i < n; ++i) fn(i);
+        record(op, n, secondsSince(t0));
+    };
+
+    unique_ptr<FileSystem> fs(new FileSystem(DATA));
+    TreeSpec sized = spec;
+    sized.entries = entries;
+    auto t0 = chrono::steady_clock::now();
+    fs->generateTree(fs->root, sized);
+    record("generate", entries, secondsSince(t0));
+    collect(*fs);
+
+    // ── Persistence ──
+    vector<double> saves, loads, fullLoads;
+    for (unsigned r = 0; r < repeat; ++r) {
+        t0 = chrono::steady_clock::now();
+        fs->saveToDisk(SAVED);
+        saves.push_back(secondsSince(t0));
+
+        unique_ptr<FileSystem> other(new FileSystem(EMPTY));
+        t0 = chrono::steady_clock::now();
+        other->loadFromDisk(SAVED);
+        loads.push_back(secondsSince(t0));
+        t0 = chrono::steady_clock::now();
+        other->loadAll();
+        fullLoads.push_back(secondsSince(t0));
+    }
+    record("save", 1, median(saves));
+    record("load", 1, median(loads));                          // header; directories on demand
+    record("load_all", 1, median(fullLoads));                  // every directory read
+
+    // ── Path lookups (the dentry cache answers repeats) ──
+    vector<string> paths;
+    for (uint64_t i = 0; i < ops; ++i) paths.push_back(fs->pathOf(pick(dirs)).substr(1));
+    timed("navigate", ops, [&](uint64_t i) { fs->navigateToPath(paths[i]); });
+
+    // ── Tree operations on random targets, journaled as usual ──
+    vector<Directory*> at(ops), to(ops);
+    for (uint64_t i = 0; i < ops; ++i) {
+        at[i] = pick(dirs);
+        do to[i] = pick(dirs); while (to[i] == at[i] && dirs.size() > 1);
+    }
+    auto name = [](const char* kind, uint64_t i) { return string(kind) + to_string(i); };
+    auto in = [&](Directory* d) { fs->curr = d; };
+
+    timed("mkdir", ops, [&](uint64_t i) { in(at[i]); fs->makeDirectory(name("bench_dir", i)); });
+    timed("create", ops, [&](uint64_t i) { in(at[i]); fs->createFile(name("bench_", i)); });
+    timed("rename", ops, [&](uint64_t i) { in(at[i]); fs->renameFile(name("bench_", i), name("renamed_", i)); });
+    timed("move", ops, [&](uint64_t i) { in(at[i]); fs->moveFile(name("renamed_", i), to[i]); });
+    timed("copy", ops, [&](uint64_t i) { in(to[i]); fs->copyFile(name("renamed_", i), at[i]); });
+
+    // Leaf directories hold `files` files each
+    uint64_t dirOps = max<uint64_t>(1, ops / 10);
+    vector<Directory*> copied(dirOps), into(dirOps);
+    vector<char> made(dirOps, 0);
+    for (uint64_t i = 0; i < dirOps; ++i) {
+        copied[i] = pick(leaves);
+        into[i] = to[i] == copied[i] ? at[i] : to[i];
+    }
+    timed("copy_dir", dirOps, [&](uint64_t i) {
+        if (!copied[i]->parent) return;
+        in(copied[i]->parent);
+        made[i] = fs->copyDirectory(copied[i]->name, into[i]);
+    });
+    // Only the copies: a failed copy (name taken) must not cost an original
+    timed("delete_dir", dirOps, [&](uint64_t i) {
+        if (!made[i]) return;
+        in(into[i]);
+        fs->deleteDirectoryByName(copied[i]->name);
+    });
+    timed("delete", ops, [&](uint64_t i) {
+        in(to[i]);
+        fs->deleteFileByName(name("renamed_", i));
+        in(at[i]);
+        fs->deleteFileByName(name("renamed_", i));
+    });
+    out.back().count *= 2;                                     // two files per step
+    timed("rmdir", ops, [&](uint64_t i) { in(at[i]); fs->deleteDirectoryByName(name("bench_dir", i)); });
+    fs->curr = fs->root;
+
+    // ── Name search over the whole tree, at most 100 matches ──
+    uint64_t searches = max<uint64_t>(1, ops / 10);
+    vector<string> names;
+    for (uint64_t i = 0; i < searches && !files.empty(); ++i) names.push_back(pick(files)->name);
+    if (!names.empty()) {
+        timed("find_exact", names.size(), [&](uint64_t i) { fs->searchFiles(names[i], NameMatch::Exact, 100); });
+        timed("find_prefix", names.size(), [&](uint64_t i) {
+            fs->searchFiles(names[i].substr(0, 3), NameMatch::Prefix, 100);
+        });
+        timed("find_substring", names.size(), [&](uint64_t i) {
+            fs->searchFiles(names[i].substr(names[i].size() / 2, 3), NameMatch::Substring, 100);
+        });
+    }
+
+    // ── Tree dumps through the renderer, into a file ──
+    for (TreeFormat format : {TreeFormat::Text, TreeFormat::JsonLines}) {
+        TreeRenderSpec how;
+        how.format = format;
+        how.framed = false;
+        ofstream dump(DUMP, ios::binary | ios::trunc);
+        t0 = chrono::steady_clock::now();
+        uint64_t nodes = fs->renderTree(TreeView(fs->root), fs->root, how, dump);
+        dump.close();
+        record(format == TreeFormat::Text ? "tree_text" : "tree_jsonl", nodes, secondsSince(t0));
+    }
+    std::filesystem::remove(DUMP);
+
+    t0 = chrono::steady_clock::now();
+    fs.reset();                                                // commits the journal
+    record("close", 1, secondsSince(t0));
+}
+
+/*──────────────────────────  main  ─────────────────────────────*/
+int main(int argc, char* argv[]) {
+    Bench bench;
+    vector<uint64_t> sizes = {1000, 10000, 100000, 1000000};
+    string outFile, baselineFile, label = "fsbench", workDir = "fsbench.tmp";
+    bool keep = false;
+
+    auto usage = [&] {
+        cerr << "usage: " << argv[0] << " [--sizes N,N,...] [--ops N] [--repeat N] [--out FILE]"
+             << " [--baseline FILE] [--label TEXT] [--dir DIR] [--keep]\n"
+             << "       [--fanout N] [--depth N] [--files N] [--name LEN] [--size DIST] [--age DAYS] [--seed S]\n"
+             << "  DIST: fixed:N | uniform:MIN-MAX | lognormal:MEDIAN,SIGMA\n";
+        return 2;
+    };
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--keep") { keep = true; continue; }
+        if (arg.compare(0, 2, "--") != 0 || i + 1 >= argc) return usage();
+        string value = argv[++i];
+        TreeSpec probe;                                        // parses counts like 1e6
+        if (arg == "--sizes") {
+            sizes.clear();
+            stringstream ss(value);
+            string item;
+            while (getline(ss, item, ',')) {
+                if (!probe.set("entries", item)) return usage();
+                sizes.push_back(probe.entries);
+            }
+        } else if (arg == "--ops" || arg == "--repeat") {
+            if (!probe.set("entries", value)) return usage();
+            if (arg == "--ops") bench.ops = probe.entries;
+            else bench.repeat = static_cast<unsigned>(min<uint64_t>(probe.entries, 1000));
+        }
+        else if (arg == "--out") outFile = value;
+        else if (arg == "--baseline") baselineFile = value;
+        else if (arg == "--label") label = value;
+        else if (arg == "--dir") workDir = value;
+        else if (!bench.spec.set(arg.substr(2), value)) return usage();
+    }
+
+    map<pair<uint64_t, string>, double> baseline;
+    if (!baselineFile.empty()) {
+        baseline = readBaseline(baselineFile);
+        if (baseline.empty()) cerr << "NO RESULTS IN BASELINE " << baselineFile << endl;
+    }
+    ofstream out;
+    if (!outFile.empty()) {
+        out.open(std::filesystem::absolute(outFile), ios::app);
+        if (!out) { cerr << "CANNOT OPEN " << outFile << endl; return 2; }
+    }
+    // Data files go to the work directory; it has no fs_data.txt to seed
+    // from.  It must be new or empty, and only a directory made here is
+    // removed again
+    std::error_code ec;
+    if (std::filesystem::exists(workDir, ec) && !std::filesystem::is_empty(workDir, ec)) {
+        cerr << "DIRECTORY " << workDir << " IS NOT EMPTY" << endl;
+        return 2;
+    }
+    bool made = std::filesystem::create_directories(workDir, ec);
+    std::filesystem::path home = std::filesystem::current_path();
+    std::filesystem::current_path(workDir, ec);
+    if (ec) { cerr << "CANNOT USE DIRECTORY " << workDir << endl; return 2; }
+
+    string started = formatTimestamp(wallClock());
+    cout << "FSBENCH " << label << ": " << bench.spec.describe() << ", ops=" << bench.ops
+         << ", repeat=" << bench.repeat << '\n'
+         << right << setw(10) << "ENTRIES" << "  " << left << setw(16) << "OPERATION" << right
+         << setw(10) << "COUNT" << setw(12) << "TOTAL MS" << setw(12) << "NS/OP" << setw(14) << "OPS/SEC"
+         << (baseline.empty() ? "" : "     CHANGE") << endl;
+    for (uint64_t entries : sizes) {
+        vector<Result> results;
+        bench.run(entries, results);
+        for (const Result& r : results) {
+            cout << setw(10) << r.entries << "  " << left << setw(16) << r.op << right << setw(10) << r.count
+                 << fixed << setprecision(2) << setw(12) << r.seconds * 1e3 << setprecision(0)
+                 << setw(12) << r.nsPerOp() << setw(14) << r.perSecond();
+            auto b = baseline.find({r.entries, r.op});
+            if (b != baseline.end() && b->second > 0)
+                cout << setw(10) << showpos << setprecision(1) << (r.nsPerOp() / b->second - 1) * 100 << '%' << noshowpos;
+            cout << defaultfloat << endl;
+            if (out.is_open())
+                out << "{\"label\":\"" << jsonEscape(label) << "\",\"started\":\"" << started
+                    << "\",\"spec\":\"" << bench.spec.describe() << "\",\"entries\":" << r.entries
+                    << ",\"op\":\"" << r.op << "\",\"count\":" << r.count
+                    << ",\"seconds\":" << setprecision(9) << r.seconds
+                    << ",\"ns_per_op\":" << setprecision(1) << fixed << r.nsPerOp() << defaultfloat
+                    << ",\"ops_per_sec\":" << setprecision(1) << fixed << r.perSecond() << defaultfloat << "}\n";
+        }
+        if (!keep) removeScratch();
+    }
+    std::filesystem::current_path(home, ec);
+    if (!keep && made) std::filesystem::remove(workDir, ec);   // only if empty
+    if (out.is_open()) {
+        out.close();                                           // a failed flush shows here
+        if (!out) cerr << "COULD NOT WRITE " << outFile << endl;
+    }
+    return outFile.empty() || out ? 0 : 1;
+}
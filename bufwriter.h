@@ -0,0 +1,71 @@
+#pragma once
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Output through one large buffer, handed to the stream in a single
+// write() when it fills up and at the end.  Listings of huge directories
+// and trees print millions of short lines; going through the stream line
+// by line (and flushing with endl) costs more than building them.
+// The buffer is either the writer's own or a caller's vector, which keeps
+// its capacity from one use to the next.
+class BufferedWriter {
+public:
+    explicit BufferedWriter(std::ostream& out, size_t capacity = 1 << 16) : out(out), buf(own) { buf.reserve(capacity); }
+    BufferedWriter(std::ostream& out, std::vector<char>& storage) : out(out), buf(storage) { buf.clear(); }
+    ~BufferedWriter() { flush(); }
+    BufferedWriter(const BufferedWriter&) = delete;
+    BufferedWriter& operator=(const BufferedWriter&) = delete;
+
+    BufferedWriter& write(const char* p, size_t n) {
+        if (buf.size() + n > buf.capacity()) {
+            flush();
+            if (n > buf.capacity()) {                          // too big to buffer
+                out.write(p, static_cast<std::streamsize>(n));
+                return *this;
+            }
+        }
+        buf.insert(buf.end(), p, p + n);
+        return *this;
+    }
+    BufferedWriter& operator<<(const std::string& s) { return write(s.data(), s.size()); }
+    BufferedWriter& operator<<(const char* s) { return write(s, std::strlen(s)); }
+    BufferedWriter& operator<<(char c) { return write(&c, 1); }
+    BufferedWriter& operator<<(uint64_t v) {
+        char tmp[24];
+        char* end = std::to_chars(tmp, tmp + sizeof(tmp), v).ptr;
+        return write(tmp, static_cast<size_t>(end - tmp));
+    }
+    BufferedWriter& operator<<(int64_t v) {
+        char tmp[24];
+        char* end = std::to_chars(tmp, tmp + sizeof(tmp), v).ptr;
+        return write(tmp, static_cast<size_t>(end - tmp));
+    }
+
+    // `s` right-aligned in `width` columns
+    BufferedWriter& right(const std::string& s, size_t width) {
+        for (size_t i = s.size(); i < width; ++i) *this << ' ';
+        return *this << s;
+    }
+    BufferedWriter& right(uint64_t v, size_t width) { return right(std::to_string(v), width); }
+    // `s` left-aligned in `width` columns
+    BufferedWriter& left(const std::string& s, size_t width) {
+        *this << s;
+        for (size_t i = s.size(); i < width; ++i) *this << ' ';
+        return *this;
+    }
+
+    void flush() {
+        if (!buf.empty()) out.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+        buf.clear();
+        out.flush();
+    }
+
+private:
+    std::ostream& out;
+    std::vector<char> own;
+    std::vector<char>& buf;
+};
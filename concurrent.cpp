@@ -0,0 +1,359 @@
+#include "filesystem.h"
+#include "journal.h"
+#include "metrics.h"
+#include "fmtguard.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <random>
+using namespace std;
+
+/*─────────────────────  Locking helpers  ──────────────────────*/
+namespace {
+    // Absolute path -> segments; "." is dropped and ".." takes one back
+    vector<string> splitPath(const string& path) {
+        vector<string> segs;
+        string seg;
+        for (size_t pos = 0; pos < path.size();) {
+            size_t end = path.find('/', pos);
+            if (end == string::npos) end = path.size();
+            seg.assign(path, pos, end - pos);
+            pos = end + 1;
+            if (seg.empty() || seg == ".") continue;
+            if (seg == "..") { if (!segs.empty()) segs.pop_back(); continue; }
+            segs.push_back(seg);
+        }
+        return segs;
+    }
+
+    string joinPath(const vector<string>& segs) {
+        if (segs.empty()) return "/";
+        string p;
+        for (const string& s : segs) p += "/" + s;
+        return p;
+    }
+
+    // Directory locks held by one operation, released in reverse order
+    class HeldLocks {
+    public:
+        HeldLocks() = default;
+        HeldLocks(const HeldLocks&) = delete;
+        HeldLocks& operator=(const HeldLocks&) = delete;
+        ~HeldLocks() {
+            for (auto it = held.rbegin(); it != held.rend(); ++it)
+                it->second ? it->first->lock.unlock() : it->first->lock.unlock_shared();
+        }
+        void take(Directory* d, bool exclusive) {
+            exclusive ? d->lock.lock() : d->lock.lock_shared();
+            held.emplace_back(d, exclusive);
+        }
+    private:
+        vector<pair<Directory*, bool>> held;
+    };
+
+    // One chain of directories from the root: the first `len` segments are
+    // walked, and the nodes at depth >= exclusiveFrom are locked exclusively.
+    // `at` ends up at the last one.
+    struct Walk {
+        const vector<string>* segs;
+        size_t len;
+        size_t exclusiveFrom;
+        Directory* at = nullptr;
+    };
+
+    // Locks one or two walks level by level.  Every caller takes its locks
+    // in (depth, address) order -- a single walk is already in depth order,
+    // and the two nodes of a level are taken lowest address first -- so two
+    // operations can never wait on each other in a cycle.  A node both
+    // walks pass through is locked once, exclusively if either needs it.
+    // Holding every ancestor keeps the chain from being moved or deleted
+    // underneath, since that needs an exclusive lock on one of them.
+    bool lockWalks(Directory* root, Walk* walks, size_t n, HeldLocks& held) {
+        size_t deepest = 0;
+        for (size_t i = 0; i < n; ++i) {
+            walks[i].at = root;
+            deepest = max(deepest, walks[i].len);
+        }
+        for (size_t depth = 0; depth <= deepest; ++depth) {
+            pair<Directory*, bool> level[2];
+            size_t k = 0;
+            for (size_t i = 0; i < n; ++i) {
+                if (depth > walks[i].len) continue;
+                bool exclusive = depth >= walks[i].exclusiveFrom;
+                if (k && level[0].first == walks[i].at) level[0].second |= exclusive;
+                else level[k++] = {walks[i].at, exclusive};
+            }
+            if (k == 2 && less<Directory*>()(level[1].first, level[0].first)) swap(level[0], level[1]);
+            for (size_t j = 0; j < k; ++j) held.take(level[j].first, level[j].second);
+
+            for (size_t i = 0; i < n; ++i) {
+                if (depth >= walks[i].len) continue;
+                walks[i].at = walks[i].at->entries.findDir((*walks[i].segs)[depth]);
+                if (!walks[i].at) return false;
+            }
+        }
+        return true;
+    }
+
+    // Locks the parent of the last segment: shared, or exclusive to modify it
+    Directory* lockParent(Directory* root, const vector<string>& segs, bool exclusive, HeldLocks& held) {
+        if (segs.empty()) return nullptr;
+        Walk w{&segs, segs.size() - 1, exclusive ? segs.size() - 1 : SIZE_MAX};
+        return lockWalks(root, &w, 1, held) ? w.at : nullptr;
+    }
+}
+
+// Every concurrent call holds the root shared, so an exclusive root lock
+// stops them all while the tree is encoded
+void FileSystem::checkpointIfDue() {
+    if (!journal || journal->size() < checkpointBytes) return;
+    lock_guard<RwLock> whole(root->lock);
+    if (journal->size() >= checkpointBytes) checkpoint();
+}
+
+/*────────────────────  Concurrent operations  ─────────────────*/
+bool FileSystem::mkdirPath(const string& path) {
+    OpTimer timer(Op::MakeDir);
+    checkpointIfDue();
+    vector<string> segs = splitPath(path);
+    HeldLocks held;
+    Directory* parent = lockParent(root, segs, true, held);
+    if (!parent || parent->entries.contains(segs.back())) return false;
+    Directory* d;
+    {
+        lock_guard<recursive_mutex> lock(nodeMtx);
+        d = newDirectory(segs.back(), parent);
+    }
+    versions.preserve(parent);
+    parent->entries.insert(d);
+    addUsage(parent, {0, 0, 1, 0});
+    if (journal) journal->append(J_MKDIR, {joinPath(segs)});
+    return true;
+}
+
+bool FileSystem::createPath(const string& path) {
+    OpTimer timer(Op::CreateFile);
+    checkpointIfDue();
+    vector<string> segs = splitPath(path);
+    HeldLocks held;
+    Directory* parent = lockParent(root, segs, true, held);
+    if (!parent || parent->entries.contains(segs.back())) return false;
+    Timestamp ts = now();
+    {
+        lock_guard<recursive_mutex> lock(nodeMtx);
+        newFile(parent, segs.back(), ts, ts);
+    }
+    addUsage(parent, {0, 1, 0, ts});
+    if (journal) journal->append(J_CREATE, {joinPath(segs), stampField(ts)});
+    return true;
+}
+
+bool FileSystem::writePath(const string& path, const string& data, bool append) {
+    OpTimer timer(Op::Write);
+    checkpointIfDue();
+    vector<string> segs = splitPath(path);
+    HeldLocks held;
+    Directory* parent = lockParent(root, segs, true, held);
+    File* f = parent ? parent->entries.findFile(segs.back()) : nullptr;
+    if (!f || (append && !Content::fits(f->content.size(), data.size()))) return false;
+    versions.preserve(f);
+    Usage before = usageOf(f);
+    if (append) f->content.append(data);
+    else        f->content.assign(data);
+    compressIfLarge(f, append);
+    f->modifiedAt = now();
+    fileChanged(f, before);
+    if (journal) journal->append(append ? J_APPEND : J_WRITE, {joinPath(segs), data, stampField(f->modifiedAt)});
+    return true;
+}
+
+bool FileSystem::readPath(const string& path, string& out) {
+    OpTimer timer(Op::Read);
+    vector<string> segs = splitPath(path);
+    HeldLocks held;
+    Directory* parent = lockParent(root, segs, false, held);
+    File* f = parent ? parent->entries.findFile(segs.back()) : nullptr;
+    if (!f) return false;
+    out = f->content.read(0, f->content.size());
+    return true;
+}
+
+// Sorted names, directories with a trailing '/'.  Uses forEach because
+// the cached sorted views are rebuilt lazily and not safe to share.
+bool FileSystem::listPath(const string& path, vector<string>& names) {
+    OpTimer timer(Op::List);
+    vector<string> segs = splitPath(path);
+    HeldLocks held;
+    Walk w{&segs, segs.size(), SIZE_MAX};
+    if (!lockWalks(root, &w, 1, held)) return false;
+    names.clear();
+    names.reserve(w.at->entries.size());
+    w.at->entries.forEach([&](Directory* d) { names.push_back(d->name + "/"); },
+                          [&](File* f) { names.push_back(f->name); });
+    sort(names.begin(), names.end());
+    return true;
+}
+
+bool FileSystem::removePath(const string& path) {
+    OpTimer timer(Op::RemoveFile);
+    checkpointIfDue();
+    vector<string> segs = splitPath(path);
+    HeldLocks held;
+    Directory* parent = lockParent(root, segs, true, held);
+    File* f = parent ? parent->entries.findFile(segs.back()) : nullptr;
+    if (!f) return false;
+    versions.preserve(parent);
+    parent->entries.erase(segs.back());
+    removeUsage(parent, usageOf(f));
+    {
+        lock_guard<recursive_mutex> lock(nodeMtx);
+        freeFile(f);
+    }
+    if (journal) journal->append(J_RMFILE, {joinPath(segs)});
+    return true;
+}
+
+// Anyone inside the subtree holds `parent` shared, so once it is ours
+// exclusively nothing below can be in use
+bool FileSystem::rmdirPath(const string& path) {
+    OpTimer timer(Op::RemoveDir);
+    checkpointIfDue();
+    vector<string> segs = splitPath(path);
+    HeldLocks held;
+    Directory* parent = lockParent(root, segs, true, held);
+    Directory* d = parent ? parent->entries.findDir(segs.back()) : nullptr;
+    if (!d) return false;
+    versions.preserve(parent);
+    parent->entries.erase(segs.back());
+    removeUsage(parent, subtreeUsage(d));
+    {
+        lock_guard<recursive_mutex> lock(nodeMtx);
+        detachTree(d);
+    }
+    if (journal) journal->append(J_RMDIR, {joinPath(segs)});
+    return true;
+}
+
+// Locks the source's parent and the target exclusively, together with
+// both chains of ancestors.  A moved directory needs no lock of its own:
+// every operation below it holds the source parent shared.
+bool FileSystem::movePath(const string& path, const string& targetDir) {
+    OpTimer timer(Op::MoveFile);
+    checkpointIfDue();
+    vector<string> src = splitPath(path);
+    vector<string> dst = splitPath(targetDir);
+    if (src.empty()) return false;
+    Walk walks[2] = {{&src, src.size() - 1, src.size() - 1},
+                     {&dst, dst.size(), dst.size()}};
+    HeldLocks held;
+    if (!lockWalks(root, walks, 2, held)) return false;
+    Directory* from = walks[0].at;
+    Directory* target = walks[1].at;
+    const string& name = src.back();
+    if (target->entries.contains(name)) return false;
+
+    versions.preserve(from);
+    versions.preserve(target);
+    Usage moved;
+    if (Directory* d = from->entries.findDir(name)) {
+        timer.relabel(Op::MoveDir);
+        for (Directory* t = target; t; t = t->parent)          // all locked by us
+            if (t == d) return false;
+        from->entries.erase(name);
+        d->parent = target;
+        target->entries.insert(d);
+        moved = subtreeUsage(d);
+    } else if (File* f = from->entries.findFile(name)) {
+        from->entries.erase(name);
+        target->entries.insert(f);
+        f->parent = target;
+        moved = usageOf(f);
+    } else {
+        return false;
+    }
+    removeUsage(from, moved);
+    addUsage(target, moved);
+    if (journal) journal->append(J_MOVE, {joinPath(src), joinPath(dst)});
+    return true;
+}
+
+// The exclusive root lock lets the calls in flight finish, so the view
+// never holds half of a move
+TreeView FileSystem::pinView() {
+    lock_guard<RwLock> whole(root->lock);
+    return pinTree();
+}
+
+/*──────────────────────  Stress benchmark  ────────────────────*/
+namespace {
+    constexpr unsigned STRESS_DIRS = 64;
+    constexpr unsigned STRESS_FILES = 32;                      // per directory at the start
+}
+
+// Runs the same mixed workload (50% read, 20% write, 15% create, 15%
+// move) with 1, 2, 4 ... maxThreads threads and reports the throughput of
+// each round.  Every round gets a fresh scratch FileSystem with no data
+// file and no journal, so the user's tree is left alone and the numbers
+// measure the directory locks, not the journal.  Every thread does
+// opsPerThread operations, so perfect scaling keeps the time per round
+// flat.
+bool FileSystem::stressBench(unsigned maxThreads, uint64_t opsPerThread) {
+    if (!maxThreads) maxThreads = max(1u, thread::hardware_concurrency());
+    if (!opsPerThread) return false;
+    string payload(64, 'x');
+
+    FormatGuard format(cout);
+    cout << "STRESS: " << STRESS_DIRS << " DIRS x " << STRESS_FILES << " FILES, "
+         << opsPerThread << " OPS PER THREAD (50% READ, 20% WRITE, 15% CREATE, 15% MOVE)\n"
+         << right << setw(8) << "THREADS" << setw(12) << "OPS" << setw(12) << "MS"
+         << setw(14) << "OPS/SEC" << setw(10) << "SPEEDUP" << setw(10) << "FAILED" << '\n';
+
+    double baseRate = 0;
+    for (unsigned threads = 1;; threads = min(threads * 2, maxThreads)) {
+        unique_ptr<FileSystem> fs(new FileSystem(""));
+        for (unsigned d = 0; d < STRESS_DIRS; ++d) {
+            string dir = "/d" + to_string(d);
+            fs->mkdirPath(dir);
+            for (unsigned f = 0; f < STRESS_FILES; ++f) fs->createPath(dir + "/f" + to_string(f));
+        }
+
+        atomic<uint64_t> failed{0};
+        auto worker = [&](unsigned id) {
+            minstd_rand rng(id + 1);
+            uint64_t misses = 0;
+            string out;
+            for (uint64_t i = 0; i < opsPerThread; ++i) {
+                unsigned r = rng() % 100;
+                string dir = "/d" + to_string(rng() % STRESS_DIRS);
+                string file = dir + "/f" + to_string(rng() % STRESS_FILES);
+                bool ok;
+                if (r < 50)      ok = fs->readPath(file, out);
+                else if (r < 70) ok = fs->writePath(file, payload);
+                else if (r < 85) ok = fs->createPath(dir + "/t" + to_string(id) + "_" + to_string(i));
+                else             ok = fs->movePath(file, "/d" + to_string(rng() % STRESS_DIRS));
+                if (!ok) ++misses;                             // moved away, or name taken
+            }
+            failed += misses;
+        };
+
+        auto t0 = chrono::steady_clock::now();
+        vector<thread> pool;
+        for (unsigned t = 0; t < threads; ++t) pool.emplace_back(worker, t);
+        for (thread& t : pool) t.join();
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+        fs.reset();
+
+        uint64_t ops = opsPerThread * threads;
+        double rate = ms > 0 ? ops / (ms / 1000) : 0.0;
+        if (threads == 1) baseRate = rate;
+        cout << setw(8) << threads << setw(12) << ops << setw(12) << fixed << setprecision(2) << ms
+             << setw(14) << setprecision(0) << rate
+             << setw(9) << setprecision(2) << (baseRate > 0 ? rate / baseRate : 0.0) << 'x'
+             << setw(10) << failed.load() << '\n';
+        if (threads == maxThreads) break;
+    }
+    return true;
+}
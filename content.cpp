@@ -0,0 +1,587 @@
+#include "content.h"
+#include "lz.h"
+#include "metrics.h"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <vector>
+using namespace std;
+
+/*───────────────────────  Blocks and tables  ───────────────────*/
+Content::Chunk* Content::newChunk(size_t capacity) {
+    Chunk* c = static_cast<Chunk*>(::operator new(sizeof(Chunk) + capacity));
+    addGauge(Gauge::ChunkBytes, static_cast<int64_t>(sizeof(Chunk) + capacity));
+    new (&c->refs) atomic<uint32_t>(1);
+    c->size = 0;
+    c->capacity = static_cast<uint32_t>(capacity);
+    c->packed = 0;
+    return c;
+}
+
+Content::Table* Content::newTable(uint32_t capacity, bool irregular) {
+    Table* t = static_cast<Table*>(::operator new(tableBytes(capacity, irregular)));
+    addGauge(Gauge::ExtentTableBytes, static_cast<int64_t>(tableBytes(capacity, irregular)));
+    new (&t->refs) atomic<uint32_t>(1);
+    t->count = 0;
+    t->capacity = capacity;
+    t->irregular = irregular;
+    t->size = 0;
+    return t;
+}
+
+void Content::freeTable(Table* t) {
+    addGauge(Gauge::ExtentTableBytes, -static_cast<int64_t>(tableBytes(t->capacity, t->irregular)));
+    t->refs.~atomic<uint32_t>();
+    ::operator delete(t);
+}
+
+size_t Content::length(Table* t, uint32_t i) {
+    if (t->irregular) return static_cast<size_t>(ends(t)[i] - (i ? ends(t)[i - 1] : 0));
+    return static_cast<size_t>(min<uint64_t>(CHUNK, t->size - uint64_t(i) * CHUNK));
+}
+
+void Content::drop(Chunk* c) {
+    if (c && c->refs.fetch_sub(1, memory_order_acq_rel) == 1) {
+        size_t capacity = c->capacity;
+        if (external(c)) {
+            mapped(c)->region->forget(mapped(c)->off, c);
+            addGauge(Gauge::MappedBytes, -static_cast<int64_t>(c->packed ? c->packed : c->size));
+            capacity = sizeof(Mapped);
+        }
+        addGauge(Gauge::ChunkBytes, -static_cast<int64_t>(sizeof(Chunk) + capacity));
+        c->refs.~atomic<uint32_t>();
+        ::operator delete(c);
+    }
+}
+
+void Content::drop(Table* t) {
+    if (t && t->refs.fetch_sub(1, memory_order_acq_rel) == 1) {
+        for (uint32_t i = 0; i < t->count; ++i) drop(slots(t)[i]);
+        freeTable(t);
+    }
+}
+
+void Content::retain() {
+    if (!rep) return;
+    if (isTable()) table()->refs.fetch_add(1, memory_order_relaxed);
+    else single()->refs.fetch_add(1, memory_order_relaxed);
+}
+
+void Content::release() {
+    if (isTable()) drop(table());
+    else drop(single());
+    rep = 0;
+}
+
+/*──────────────────────────  Content  ──────────────────────────*/
+Content& Content::operator=(const Content& other) {
+    if (rep != other.rep) {
+        release();
+        rep = other.rep;
+        retain();
+    }
+    return *this;
+}
+
+Content& Content::operator=(Content&& other) noexcept {
+    if (this != &other) {
+        release();
+        rep = other.rep;
+        other.rep = 0;
+    }
+    return *this;
+}
+
+uint64_t Content::size() const {
+    if (!rep) return 0;
+    return isTable() ? table()->size : single()->size;
+}
+
+bool Content::shared() const {
+    if (!rep) return false;
+    return (isTable() ? table()->refs.load(memory_order_acquire)
+                      : single()->refs.load(memory_order_acquire)) > 1;
+}
+
+uint64_t Content::read(uint64_t off, uint64_t len, char* out) const {
+    uint64_t done = 0;
+    forEachPiece(off, len, [&](const char* p, size_t n) {
+        memcpy(out + done, p, n);
+        done += n;
+    });
+    return done;
+}
+
+string Content::read(uint64_t off, uint64_t len) const {
+    uint64_t total = size();
+    string s(off < total ? static_cast<size_t>(min(len, total - off)) : 0, '\0');
+    if (!s.empty()) read(off, s.size(), &s[0]);
+    return s;
+}
+
+// Exact-size blocks: most content is written once and never grows
+void Content::assign(const char* p, size_t n) {
+    release();
+    if (!n) return;
+    if (n <= CHUNK) {
+        Chunk* c = newChunk(n);
+        memcpy(bytes(c), p, n);
+        c->size = static_cast<uint32_t>(n);
+        rep = reinterpret_cast<uintptr_t>(c);
+        return;
+    }
+    uint32_t count = chunkCount(n);
+    Table* t = newTable(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        size_t len = min(CHUNK, n - size_t(i) * CHUNK);
+        Chunk* c = newChunk(len);
+        memcpy(bytes(c), p + size_t(i) * CHUNK, len);
+        slots(t)[i] = c;
+    }
+    t->count = count;
+    t->size = n;
+    rep = reinterpret_cast<uintptr_t>(t) | TABLE_TAG;
+}
+
+bool Content::write(uint64_t off, const char* p, size_t n) {
+    if (!fits(off, n)) return false;
+    if (p) writeImpl(off, p, n);
+    return true;
+}
+
+bool Content::truncate(uint64_t n) {
+    uint64_t old = size();
+    if (n > MAX_SIZE) return false;
+    if (n >= old) {
+        if (n > old) writeImpl(old, nullptr, static_cast<size_t>(n - old));
+        return true;
+    }
+    if (n == 0) { release(); return true; }
+    if (!isTable()) {
+        Chunk* c = single();
+        // A mapped chunk is looked up (and counted) by its size: copy it too
+        if (c->refs.load(memory_order_acquire) > 1 || c->packed || external(c)) {
+            Chunk* d = newChunk(static_cast<size_t>(n));
+            memcpy(bytes(d), data(c), static_cast<size_t>(n));
+            d->size = static_cast<uint32_t>(n);
+            release();
+            rep = reinterpret_cast<uintptr_t>(d);
+        } else {
+            c->size = static_cast<uint32_t>(n);
+        }
+        return true;
+    }
+    if (table()->irregular) {
+        Table* t = ownIrregular(table()->count);
+        uint64_t* e = ends(t);
+        uint32_t keep = static_cast<uint32_t>(upper_bound(e, e + t->count, n - 1) - e) + 1;
+        for (uint32_t i = keep; i < t->count; ++i) drop(slots(t)[i]);
+        t->count = keep;
+        e[keep - 1] = n;
+        t->size = n;
+        return true;
+    }
+    // Bytes past the new end stay in the tail chunk; a later write zeroes them
+    Table* t = ownTable(old);
+    uint32_t keep = chunkCount(n);
+    for (uint32_t i = keep; i < t->count; ++i) drop(slots(t)[i]);
+    t->count = keep;
+    t->size = n;
+    return true;
+}
+
+/*────────────────────────  Write helpers  ──────────────────────*/
+// Takes over chunks that each hold c->size bytes.  Fixed-size ones make a
+// plain extent table, anything else an irregular one.
+void Content::adopt(Chunk* const* chunks, size_t count) {
+    release();
+    if (!count) return;
+    if (count == 1) {
+        rep = reinterpret_cast<uintptr_t>(chunks[0]);
+        return;
+    }
+    bool fixed = true;
+    for (size_t i = 0; i + 1 < count; ++i) fixed = fixed && chunks[i]->size == CHUNK;
+    Table* t = newTable(static_cast<uint32_t>(count), !fixed);
+    for (size_t i = 0; i < count; ++i) {
+        slots(t)[i] = chunks[i];
+        t->size += chunks[i]->size;
+        if (!fixed) ends(t)[i] = t->size;
+    }
+    t->count = static_cast<uint32_t>(count);
+    rep = reinterpret_cast<uintptr_t>(t) | TABLE_TAG;
+}
+
+// Content that stays within one chunk: a single block, grown by doubling
+void Content::writeSingle(uint64_t off, const char* p, size_t n) {
+    Chunk* c = single();
+    size_t old = c ? c->size : 0;
+    size_t end = static_cast<size_t>(off) + n;
+    size_t newSize = max(old, end);
+    if (!c || c->refs.load(memory_order_acquire) > 1 || c->capacity < newSize || c->packed) {
+        size_t have = c ? (c->packed || external(c) ? old : c->capacity) : 0;
+        size_t cap = c ? max(newSize, min(CHUNK, have * 2)) : newSize;
+        Chunk* d = newChunk(cap);
+        if (c) memcpy(bytes(d), data(c), old);
+        release();
+        rep = reinterpret_cast<uintptr_t>(d);
+        c = d;
+    }
+    if (off > old) memset(bytes(c) + old, 0, static_cast<size_t>(off) - old);
+    if (p) memcpy(bytes(c) + off, p, n);
+    else   memset(bytes(c) + off, 0, n);
+    c->size = static_cast<uint32_t>(newSize);
+}
+
+// Makes an irregular table private with room for `need` chunks
+Content::Table* Content::ownIrregular(uint32_t need) {
+    Table* old = table();
+    bool shared = old->refs.load(memory_order_acquire) > 1;
+    if (!shared && need <= old->capacity) return old;
+    Table* t = newTable(max(need, shared ? old->count : old->capacity * 2), true);
+    for (uint32_t i = 0; i < old->count; ++i) {
+        Chunk* c = slots(old)[i];
+        if (shared && c) c->refs.fetch_add(1, memory_order_relaxed);
+        slots(t)[i] = c;
+        ends(t)[i] = ends(old)[i];
+    }
+    t->count = old->count;
+    t->size = old->size;
+    if (shared) {
+        release();
+    } else {
+        freeTable(old);
+    }
+    rep = reinterpret_cast<uintptr_t>(t) | TABLE_TAG;
+    return t;
+}
+
+// Chunk i of a private irregular table, itself private and raw, with
+// room for `capacity` bytes
+Content::Chunk* Content::ownIrregularChunk(Table* t, uint32_t i, size_t capacity) {
+    Chunk* c = slots(t)[i];
+    size_t len = length(t, i);
+    if (c && c->refs.load(memory_order_acquire) == 1 && !c->packed && !external(c) && c->capacity >= capacity) return c;
+    Chunk* d = newChunk(max(capacity, len));
+    memcpy(bytes(d), data(c), len);                        // a hole copies zeros
+    d->size = static_cast<uint32_t>(len);
+    drop(c);
+    slots(t)[i] = d;
+    return d;
+}
+
+// Writes to content-defined chunks copy only the chunks they touch, and
+// growth goes into the last chunk and then into new fixed-size ones, so
+// a file keeps sharing whatever the write leaves alone
+void Content::writeIrregular(uint64_t off, const char* p, size_t n) {
+    uint64_t old = size(), end = off + n;
+    uint32_t count = table()->count;
+    uint64_t lastStart = count > 1 ? ends(table())[count - 2] : 0;
+    uint64_t grow = end > lastStart + CHUNK ? end - (lastStart + CHUNK) : 0;
+    Table* t = ownIrregular(count + chunkCount(grow));
+    uint64_t* e = ends(t);
+    // Bytes [from, to) into dst: zeros before `off`, then the data
+    auto put = [&](char* dst, uint64_t from, uint64_t to) {
+        uint64_t gap = min(to, max(from, off));
+        if (from < gap) memset(dst, 0, static_cast<size_t>(gap - from));
+        if (gap < to) {
+            if (p) memcpy(dst + (gap - from), p + (gap - off), static_cast<size_t>(to - gap));
+            else   memset(dst + (gap - from), 0, static_cast<size_t>(to - gap));
+        }
+    };
+    if (off < old) {
+        uint32_t i = static_cast<uint32_t>(upper_bound(e, e + t->count, off) - e);
+        for (uint64_t pos = off; pos < min(end, old); ++i) {
+            uint64_t start = i ? e[i - 1] : 0, stop = min(end, e[i]);
+            put(bytes(ownIrregularChunk(t, i, 0)) + (pos - start), pos, stop);
+            pos = stop;
+        }
+    }
+    if (end <= old) return;
+    uint32_t last = t->count - 1;
+    uint64_t stop = min(end, lastStart + CHUNK);
+    if (stop > old) {
+        Chunk* c = ownIrregularChunk(t, last, CHUNK);
+        put(bytes(c) + (old - lastStart), old, stop);
+        c->size = static_cast<uint32_t>(stop - lastStart);
+        e[last] = stop;
+    }
+    for (uint64_t pos = stop; pos < end; pos += CHUNK) {
+        uint64_t to = min(end, pos + CHUNK);
+        Chunk* c = nullptr;                                // only zeros: a hole
+        if (p && to > off) {
+            c = newChunk(CHUNK);
+            put(bytes(c), pos, to);
+            c->size = static_cast<uint32_t>(to - pos);
+        }
+        slots(t)[t->count] = c;
+        e[t->count++] = to;
+    }
+    t->size = end;
+}
+
+// Makes the extent table private and gives it slots for `newSize` bytes
+Content::Table* Content::ownTable(uint64_t newSize) {
+    uint32_t need = chunkCount(newSize);
+    if (!isTable()) {
+        Table* t = newTable(max<uint32_t>(need, 4));
+        if (Chunk* c = single()) {                         // our reference moves in
+            slots(t)[t->count++] = c;
+            t->size = c->size;
+        }
+        rep = reinterpret_cast<uintptr_t>(t) | TABLE_TAG;
+    } else if (table()->refs.load(memory_order_acquire) > 1) {
+        Table* old = table();
+        Table* t = newTable(max(need, old->count));
+        for (uint32_t i = 0; i < old->count; ++i) {
+            Chunk* c = slots(old)[i];
+            if (c) c->refs.fetch_add(1, memory_order_relaxed);
+            slots(t)[i] = c;
+        }
+        t->count = old->count;
+        t->size = old->size;
+        release();
+        rep = reinterpret_cast<uintptr_t>(t) | TABLE_TAG;
+    }
+    Table* t = table();
+    if (need > t->capacity) {                              // grow the pointer array
+        Table* g = newTable(max(need, t->capacity * 2));
+        memcpy(slots(g), slots(t), t->count * sizeof(Chunk*));
+        g->count = t->count;
+        g->size = t->size;
+        freeTable(t);
+        rep = reinterpret_cast<uintptr_t>(g) | TABLE_TAG;
+        t = g;
+    }
+    while (t->count < need) slots(t)[t->count++] = nullptr;
+    return t;
+}
+
+// Chunk i of a private table, itself private and full-size
+Content::Chunk* Content::ownChunk(Table* t, uint32_t i) {
+    Chunk* c = slots(t)[i];
+    if (c && c->refs.load(memory_order_acquire) == 1 && c->capacity >= CHUNK && !c->packed) return c;
+    Chunk* d = newChunk(CHUNK);
+    uint64_t start = uint64_t(i) * CHUNK;
+    size_t valid = t->size > start ? static_cast<size_t>(min<uint64_t>(CHUNK, t->size - start)) : 0;
+    if (c) {
+        size_t have = c->packed ? CHUNK : external(c) ? c->size : c->capacity;
+        memcpy(bytes(d), data(c), min(valid, have));
+        drop(c);
+    } else {
+        memset(bytes(d), 0, valid);                        // a hole within the file
+    }
+    slots(t)[i] = d;
+    return d;
+}
+
+void Content::writeImpl(uint64_t off, const char* p, size_t n) {
+    if (!n) return;
+    uint64_t old = size();
+    uint64_t end = off + n;
+    if (end <= CHUNK && !isTable()) { writeSingle(off, p, n); return; }
+    if (isTable() && table()->irregular) { writeIrregular(off, p, n); return; }
+
+    Table* t = ownTable(max(old, end));
+    for (uint64_t i = min(off, old) / CHUNK; i * CHUNK < end; ++i) {
+        uint64_t cs = i * CHUNK, ce = cs + CHUNK;
+        uint64_t ws = max(off, cs), we = min(end, ce);
+        if (cs >= old && !slots(t)[i] && (!p || ws >= we)) continue;   // new and all zeros: a hole
+        Chunk* c = ownChunk(t, static_cast<uint32_t>(i));
+        uint64_t zs = max(old, cs), ze = min(off, ce);     // gap before the write
+        if (zs < ze) memset(bytes(c) + (zs - cs), 0, static_cast<size_t>(ze - zs));
+        if (ws < we) {
+            if (p) memcpy(bytes(c) + (ws - cs), p + (ws - off), static_cast<size_t>(we - ws));
+            else   memset(bytes(c) + (ws - cs), 0, static_cast<size_t>(we - ws));
+        }
+    }
+    t->size = max(old, end);
+}
+
+const char* Content::zeros() {
+    static const char none[CHUNK] = {};
+    return none;
+}
+
+/*─────────────────────────  Compression  ───────────────────────*/
+const char* Content::unpack(const Chunk* c) {
+    thread_local unique_ptr<char[]> buf(new char[CHUNK]);
+    if (lzDecompress(stored(c), c->packed, buf.get(), CHUNK) == SIZE_MAX)
+        memset(buf.get(), 0, CHUNK);                           // damaged on disk: read zeros
+    return buf.get();
+}
+
+Content::Chunk* Content::pack(const Chunk* c, size_t len) {
+    constexpr size_t MIN_LEN = 256;                            // too small to gain anything
+    if (c->packed || len < MIN_LEN) return nullptr;
+    thread_local unique_ptr<char[]> buf(new char[lzBound(CHUNK)]);
+    size_t n = lzCompress(stored(c), len, buf.get(), len - len / 8);
+    if (!n) return nullptr;
+    Chunk* d = newChunk(n);
+    memcpy(bytes(d), buf.get(), n);
+    d->size = static_cast<uint32_t>(len);
+    d->packed = static_cast<uint32_t>(n);
+    return d;
+}
+
+void Content::compress(bool tail, bool unshare) {
+    if (!rep) return;
+    uint32_t holders = (isTable() ? table()->refs : single()->refs).load(memory_order_acquire);
+    if (holders > (unshare ? 2u : 1u)) return;
+    if (!isTable()) {
+        Chunk* c = single();
+        if (!tail && c->size < CHUNK) return;
+        if (Chunk* d = pack(c, c->size)) {
+            release();
+            rep = reinterpret_cast<uintptr_t>(d);
+        }
+        return;
+    }
+    // A private copy of a shared table holds every chunk a second time
+    bool copied = holders > 1;
+    Table* t = !copied ? table() : table()->irregular ? ownIrregular(table()->count) : ownTable(size());
+    for (uint32_t i = 0; i < t->count; ++i) {
+        size_t len = length(t, i);
+        Chunk* c = slots(t)[i];
+        if (!c || (!tail && i + 1 == t->count && len < CHUNK)) continue;
+        if (c->refs.load(memory_order_acquire) > (copied ? 2u : 1u)) continue;
+        if (Chunk* d = pack(c, len)) {
+            drop(c);
+            slots(t)[i] = d;
+        }
+    }
+}
+
+bool Content::compressed() const {
+    if (!rep) return false;
+    if (!isTable()) return single()->packed != 0;
+    Table* t = table();
+    for (uint32_t i = 0; i < t->count; ++i)
+        if (slots(t)[i] && slots(t)[i]->packed) return true;
+    return false;
+}
+
+uint64_t Content::storedSize() const {
+    if (!rep) return 0;
+    if (!isTable()) return single()->packed ? single()->packed : single()->size;
+    Table* t = table();
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < t->count; ++i) {
+        const Chunk* c = slots(t)[i];
+        if (c) total += c->packed ? c->packed : length(t, i);
+    }
+    return total;
+}
+
+bool Content::savedAsBlocks() const {
+    return isTable() || (rep && single()->packed);
+}
+
+/*───────────────────────  Mapped content  ─────────────────────*/
+Content::Region::Region(const char* base, uint64_t size, size_t expected) : base(base), regionSize(size) {
+    size_t n = 64;
+    while (n < expected * 2) n *= 2;
+    live.resize(n, Live{0, nullptr});
+}
+
+bool Content::Region::unused() {
+    lock_guard<mutex> lock(mtx);                               // a dropping chunk is done with it
+    return used == 0;
+}
+
+size_t Content::Region::find(uint64_t off) const {
+    size_t mask = live.size() - 1;
+    size_t i = home(off);
+    while (live[i].chunk && live[i].off != off) i = (i + 1) & mask;
+    return i;
+}
+
+Content::Chunk* Content::Region::chunk(uint64_t off, uint32_t len, uint32_t packed) {
+    uint64_t stored = packed ? packed : len;
+    if (off > regionSize || stored > regionSize - off) return nullptr;
+    lock_guard<mutex> lock(mtx);
+    size_t i = find(off);
+    if (Chunk* c = live[i].chunk) {
+        if (c->size == len && c->packed == packed) {
+            // Take a reference unless the last one is being dropped right now
+            uint32_t n = c->refs.load(memory_order_relaxed);
+            while (n && !c->refs.compare_exchange_weak(n, n + 1, memory_order_relaxed)) {}
+            if (n) return c;
+        }
+    } else if ((used + 1) * 2 > live.size()) {
+        vector<Live> old(live.size() * 2, Live{0, nullptr});
+        old.swap(live);
+        for (const Live& e : old)
+            if (e.chunk) live[find(e.off)] = e;
+        i = find(off);
+        ++used;
+    } else {
+        ++used;
+    }
+    Chunk* c = newChunk(sizeof(Mapped));
+    c->capacity = 0;
+    c->size = len;
+    c->packed = packed;
+    new (c + 1) Mapped{base + off, this, off};
+    addGauge(Gauge::MappedBytes, static_cast<int64_t>(stored));
+    live[i] = {off, c};                                        // replaces one being dropped
+    return c;
+}
+
+void Content::Region::forget(uint64_t off, Chunk* c) {
+    lock_guard<mutex> lock(mtx);
+    size_t i = find(off), mask = live.size() - 1;
+    if (live[i].chunk != c) return;                            // already replaced
+    // Backward-shift deletion: pull later entries of the run into the gap
+    // unless their home slot lies between the gap and them
+    for (size_t j = (i + 1) & mask; live[j].chunk; j = (j + 1) & mask) {
+        size_t k = home(live[j].off);
+        if (i <= j ? (k <= i || k > j) : (k <= i && k > j)) {
+            live[i] = live[j];
+            i = j;
+        }
+    }
+    live[i].chunk = nullptr;
+    --used;
+}
+
+// Raw content in fixed chunks, each a window on the region
+bool Content::loadMapped(uint64_t off, uint64_t len, Region& region) {
+    release();
+    vector<Chunk*> chunks;
+    chunks.reserve(static_cast<size_t>((len + CHUNK - 1) / CHUNK));
+    for (uint64_t pos = 0; pos < len; pos += CHUNK) {
+        Chunk* c = region.chunk(off + pos, static_cast<uint32_t>(min<uint64_t>(CHUNK, len - pos)), 0);
+        if (!c) {
+            for (Chunk* d : chunks) drop(d);
+            return false;
+        }
+        chunks.push_back(c);
+    }
+    adopt(chunks.data(), chunks.size());
+    return true;
+}
+
+bool Content::loadBlocks(const char* refs, size_t count, uint64_t size, Region& region) {
+    release();
+    vector<Chunk*> chunks;
+    chunks.reserve(count);
+    auto fail = [&] {
+        for (Chunk* c : chunks) drop(c);
+        return false;
+    };
+    uint64_t total = 0;
+    for (size_t i = 0; i < count; ++i) {
+        BlockRef r;
+        memcpy(&r, refs + i * sizeof(BlockRef), sizeof(r));
+        if (!r.len || r.len > CHUNK) return fail();
+        Chunk* c = region.chunk(r.off, r.len, r.packed);
+        if (!c) return fail();
+        chunks.push_back(c);
+        total += r.len;
+    }
+    if (total != size) return fail();
+    adopt(chunks.data(), chunks.size());
+    return true;
+}
@@ -0,0 +1,259 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// File content, shared between copies and stored in fixed-size extents.
+//
+// Content up to one CHUNK lives in a single exact-size block.  Anything
+// larger is an extent table: chunk i holds bytes [i*CHUNK, (i+1)*CHUNK),
+// so an offset maps straight to its chunk and an append only ever touches
+// the tail chunk (plus an occasional doubling of the pointer array).
+//
+// Blocks and tables are reference counted.  Copying a Content, and so
+// copying a file or a whole tree, only takes another reference.  Nothing
+// shared is modified: a write detaches the table (copying chunk pointers,
+// not bytes) and then each chunk it touches.  Empty content holds nothing.
+//
+// A chunk can also be held compressed (lz.h).  Reads decompress it into a
+// per-thread buffer; a write treats it like a shared chunk and replaces
+// it with a private, decompressed copy, so only the chunks a write
+// touches are expanded again.
+//
+// A table can also hold chunks of varying size, as `dedup` (dedup.h) cuts
+// them at content-defined boundaries.  Such an irregular table keeps each
+// chunk's end offset next to its pointer, found by binary search.  Writes
+// copy the chunks they touch, and the content grows in fixed chunks.
+//
+// Chunks can also refer to bytes they do not own, in a Region such as a
+// mapped snapshot.  Reads go straight to the region (so the OS pages them
+// in on first use); a write treats such a chunk like a shared one.
+//
+// Growing a table leaves the chunks that would only hold zeros out: a
+// hole is an empty slot, reads as zeros and takes memory only once
+// something is written into it.  Content is at most MAX_SIZE bytes, which
+// keeps the chunk count within 32 bits and a table's slots within 128 MB;
+// callers check sizes and offsets against it.
+class Content {
+public:
+    static constexpr size_t CHUNK = 64 * 1024;
+    static constexpr uint64_t MAX_SIZE = uint64_t(1) << 40;   // 1 TiB
+
+    // Whether [off, off + n) ends within MAX_SIZE
+    static bool fits(uint64_t off, uint64_t n) { return off <= MAX_SIZE && n <= MAX_SIZE - off; }
+
+    Content() = default;
+    explicit Content(const std::string& bytes) { assign(bytes.data(), bytes.size()); }
+    Content(const Content& other) : rep(other.rep) { retain(); }
+    Content(Content&& other) noexcept : rep(other.rep) { other.rep = 0; }
+    Content& operator=(const Content& other);
+    Content& operator=(Content&& other) noexcept;
+    ~Content() { release(); }
+
+    uint64_t size() const;
+    bool empty() const { return size() == 0; }
+
+    // Reads without materializing the file; returns the bytes delivered
+    uint64_t read(uint64_t off, uint64_t len, char* out) const;
+    std::string read(uint64_t off, uint64_t len) const;
+    // fn(const char*, size_t); a piece of a compressed chunk is only
+    // valid until fn returns
+    template <class Fn>
+    void forEachPiece(uint64_t off, uint64_t len, Fn fn) const;
+    template <class Fn>
+    void forEachPiece(Fn fn) const { forEachPiece(0, size(), fn); }
+
+    void assign(const char* p, size_t n);
+    void assign(const std::string& s) { assign(s.data(), s.size()); }
+    // These return false, and change nothing, past MAX_SIZE
+    bool append(const char* p, size_t n) { return write(size(), p, n); }
+    bool append(const std::string& s) { return append(s.data(), s.size()); }
+    bool write(uint64_t off, const char* p, size_t n);   // pwrite; a gap reads as zeros
+    bool truncate(uint64_t n);                           // shrink, or grow with a hole
+    void clear() { release(); }
+
+    bool shared() const;
+    const void* identity() const { return reinterpret_cast<const void*>(rep & ~TABLE_TAG); }
+
+    // Compresses the chunks that shrink by at least an eighth; leaves
+    // shared content and shared chunks alone.  tail = false keeps a
+    // partial last chunk raw, since appends would expand it right away.
+    // unshare = true also takes content that one other holder shares
+    // whole, such as the version a pinned view keeps: this copy gets
+    // compressed chunks of its own and the other keeps the raw ones.
+    void compress(bool tail = true, bool unshare = false);
+    bool compressed() const;                // any chunk compressed
+    uint64_t storedSize() const;            // bytes the chunks hold
+
+    // Block lists (snapshot.h): content saved as references to its
+    // chunks, so that a chunk shared by many files is saved once.  Tables
+    // and compressed chunks are saved this way, other content as bytes.
+    struct BlockRef {
+        uint64_t off;                       // the chunk's stored bytes
+        uint32_t packed;                    // compressed length, 0: raw
+        uint32_t len;                       // bytes it holds
+    };
+    class Region;
+    bool savedAsBlocks() const;
+    // fn(const void* identity, const char* stored, uint32_t packed, uint32_t len)
+    template <class Fn>
+    void forEachBlock(Fn fn) const;
+
+    // Content that stays in `region` instead of being copied: `len` raw
+    // bytes at `off`, or `count` BlockRef records at `refs`
+    bool loadMapped(uint64_t off, uint64_t len, Region& region);
+    bool loadBlocks(const char* refs, size_t count, uint64_t size, Region& region);
+
+private:
+    friend class BlockStore;
+    struct Chunk {
+        std::atomic<uint32_t> refs;
+        uint32_t size;                      // used only when standing alone
+        uint32_t capacity;                  // 0: the bytes are in a Region
+        uint32_t packed;                    // compressed length, 0: raw bytes
+    };
+    struct Mapped {                         // follows an external chunk's header
+        const char* at;
+        Region* region;
+        uint64_t off;
+    };
+    struct Table {
+        std::atomic<uint32_t> refs;
+        uint32_t count;                     // chunk slots in use
+        uint32_t capacity;
+        bool irregular;                     // chunks of varying size, ends() after slots()
+        uint64_t size;                      // total bytes
+    };
+    static constexpr uintptr_t TABLE_TAG = 1;
+
+    static char* bytes(Chunk* c) { return reinterpret_cast<char*>(c + 1); }
+    static const char* bytes(const Chunk* c) { return reinterpret_cast<const char*>(c + 1); }
+    static bool external(const Chunk* c) { return c->capacity == 0; }
+    static const Mapped* mapped(const Chunk* c) { return reinterpret_cast<const Mapped*>(c + 1); }
+    static const char* stored(const Chunk* c) { return external(c) ? mapped(c)->at : bytes(c); }
+    static const char* unpack(const Chunk* c);             // per-thread buffer
+    static const char* zeros();                            // CHUNK zero bytes, what a hole reads
+    static const char* data(const Chunk* c) { return !c ? zeros() : c->packed ? unpack(c) : stored(c); }
+    static Chunk* pack(const Chunk* c, size_t len);        // nullptr: not worth it
+    static Chunk** slots(Table* t) { return reinterpret_cast<Chunk**>(t + 1); }
+    static uint64_t* ends(Table* t) { return reinterpret_cast<uint64_t*>(slots(t) + t->capacity); }
+    static size_t length(Table* t, uint32_t i);            // bytes chunk i holds
+    static uint32_t chunkCount(uint64_t n) {               // n <= MAX_SIZE, so it fits
+        return static_cast<uint32_t>((n + CHUNK - 1) / CHUNK);
+    }
+    static Chunk* newChunk(size_t capacity);
+    static Table* newTable(uint32_t capacity, bool irregular = false);
+    static void freeTable(Table* t);
+    static size_t tableBytes(uint32_t capacity, bool irregular) {
+        return sizeof(Table) + capacity * (sizeof(Chunk*) + (irregular ? sizeof(uint64_t) : 0));
+    }
+    static void drop(Chunk* c);
+    static void drop(Table* t);
+
+    bool isTable() const { return rep & TABLE_TAG; }
+    Chunk* single() const { return reinterpret_cast<Chunk*>(rep); }
+    Table* table() const { return reinterpret_cast<Table*>(rep & ~TABLE_TAG); }
+
+    void retain();
+    void release();
+    void writeSingle(uint64_t off, const char* p, size_t n);
+    void adopt(Chunk* const* chunks, size_t count);        // each holding c->size bytes
+    Table* ownIrregular(uint32_t need);
+    Chunk* ownIrregularChunk(Table* t, uint32_t i, size_t capacity);
+    void writeIrregular(uint64_t off, const char* p, size_t n);
+    Table* ownTable(uint64_t newSize);
+    Chunk* ownChunk(Table* t, uint32_t i);
+    void writeImpl(uint64_t off, const char* p, size_t n);   // p == nullptr: zeros
+
+    uintptr_t rep = 0;                      // 0, Chunk*, or Table* | TABLE_TAG
+};
+
+template <class Fn>
+void Content::forEachPiece(uint64_t off, uint64_t len, Fn fn) const {
+    uint64_t total = size();
+    if (off >= total) return;
+    uint64_t end = (len > total - off) ? total : off + len;
+    if (!isTable()) {
+        fn(data(single()) + off, static_cast<size_t>(end - off));
+        return;
+    }
+    Table* t = table();
+    if (t->irregular) {
+        const uint64_t* e = ends(t);
+        size_t i = std::upper_bound(e, e + t->count, off) - e;
+        for (uint64_t pos = off; pos < end; ++i) {
+            uint64_t start = i ? e[i - 1] : 0;
+            size_t n = static_cast<size_t>(std::min(e[i], end) - pos);
+            fn(data(slots(t)[i]) + (pos - start), n);
+            pos += n;
+        }
+        return;
+    }
+    for (uint64_t pos = off; pos < end;) {
+        uint64_t i = pos / CHUNK, inChunk = pos % CHUNK;
+        size_t n = static_cast<size_t>(std::min<uint64_t>(CHUNK - inChunk, end - pos));
+        fn(data(slots(t)[i]) + inChunk, n);
+        pos += n;
+    }
+}
+
+template <class Fn>
+void Content::forEachBlock(Fn fn) const {
+    if (!rep) return;
+    if (!isTable()) {
+        const Chunk* c = single();
+        fn(static_cast<const void*>(c), stored(c), c->packed, c->size);
+        return;
+    }
+    Table* t = table();
+    for (uint32_t i = 0; i < t->count; ++i) {
+        const Chunk* c = slots(t)[i];
+        uint32_t len = static_cast<uint32_t>(length(t, i));
+        if (!c) fn(static_cast<const void*>(zeros()), zeros(), 0u, len);   // every hole: one zero block
+        else    fn(static_cast<const void*>(c), stored(c), c->packed, len);
+    }
+}
+
+// Read-only bytes that chunks can refer to in place; it must outlive them.
+// Chunks made from the same offset are shared while any of them lives, so
+// every file loaded from one range shares its chunks again.
+class Content::Region {
+public:
+    // `expected`: about how many chunks will be made, to size the table once
+    Region(const char* base, uint64_t size, size_t expected = 0);
+    Region(const Region&) = delete;
+    Region& operator=(const Region&) = delete;
+    bool unused();                                             // no chunk refers to it
+
+private:
+    friend class Content;
+    Chunk* chunk(uint64_t off, uint32_t len, uint32_t packed);   // nullptr: out of range
+    void forget(uint64_t off, Chunk* c);
+
+    // Open addressing with linear probing: one miss per lookup on tables
+    // of a million chunks, where a node-based map takes several
+    struct Live {
+        uint64_t off;
+        Chunk* chunk;                                          // nullptr: empty slot
+    };
+    size_t home(uint64_t off) const {
+        return static_cast<size_t>((off * 0x9e3779b97f4a7c15ull) >> 32) & (live.size() - 1);
+    }
+    size_t find(uint64_t off) const;                           // off's slot, or the empty one it would take
+
+    const char* base;
+    uint64_t regionSize;
+    std::mutex mtx;
+    std::vector<Live> live;                                    // no references held
+    size_t used = 0;
+};
+
+inline std::ostream& operator<<(std::ostream& os, const Content& c) {
+    c.forEachPiece([&](const char* p, size_t n) { os.write(p, static_cast<std::streamsize>(n)); });
+    return os;
+}
@@ -0,0 +1,60 @@
+#include "filesystem.h"
+#include "dcache.h"
+#include <cstring>
+using namespace std;
+
+/*─────────────────────────  DentryCache  ───────────────────────*/
+// The start directory is part of the key: relative paths from different
+// working directories are different walks
+string DentryCache::makeKey(const Directory* from, const string& path) {
+    string key(sizeof(from) + path.size(), '\0');
+    memcpy(&key[0], &from, sizeof(from));
+    memcpy(&key[sizeof(from)], path.data(), path.size());
+    return key;
+}
+
+bool DentryCache::lookup(const Directory* from, const string& path, Directory*& result) {
+    auto it = map.find(makeKey(from, path));
+    if (it == map.end()) {
+        ++counters.misses;
+        return false;
+    }
+    const Entry& e = *it->second;
+    for (const auto& dep : e.chain) {
+        if (dep.first->entries.generation() != dep.second) {
+            lru.erase(it->second);
+            map.erase(it);
+            ++counters.stale;
+            ++counters.misses;
+            return false;
+        }
+    }
+    lru.splice(lru.begin(), lru, it->second);
+    ++counters.hits;
+    result = e.result;
+    return true;
+}
+
+void DentryCache::store(const Directory* from, const string& path, Directory* result, Chain chain) {
+    if (!capacity) return;
+    string key = makeKey(from, path);
+    auto it = map.find(key);
+    if (it != map.end()) {
+        it->second->result = result;
+        it->second->chain = move(chain);
+        lru.splice(lru.begin(), lru, it->second);
+        return;
+    }
+    if (map.size() >= capacity) {
+        map.erase(lru.back().key);
+        lru.pop_back();
+        ++counters.evictions;
+    }
+    lru.push_front(Entry{key, result, move(chain)});
+    map.emplace(move(key), lru.begin());
+}
+
+void DentryCache::clear() {
+    map.clear();
+    lru.clear();
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class Directory;
+
+// Bounded cache of path walks (a dentry cache).
+//
+// Maps (start directory, path) to the directory the walk ended in, or to
+// nullptr when a segment did not exist.  Each entry remembers the
+// generation of every entry table the walk consulted; a later lookup
+// replays those checks in walk order and drops the entry at the first
+// mismatch.  Creating, deleting, renaming or moving a directory changes
+// its parent's generation, so exactly the walks through that parent go
+// stale.  Because the checks stop at the first changed directory, a
+// node deleted since the walk is never touched.  Least recently used
+// entries are evicted once the cache is full.
+class DentryCache {
+public:
+    using Chain = std::vector<std::pair<const Directory*, uint64_t>>;
+    struct Stats {
+        uint64_t hits = 0, misses = 0, stale = 0, evictions = 0;
+    };
+
+    explicit DentryCache(size_t capacity = 8192) : capacity(capacity) {}
+
+    // True (and `result` set) if the walk is cached and still valid
+    bool lookup(const Directory* from, const std::string& path, Directory*& result);
+    // `chain` lists every directory whose subdirectories the walk looked
+    // at, with the generation seen at the time
+    void store(const Directory* from, const std::string& path, Directory* result, Chain chain);
+    void clear();
+    void resetStats() { counters = Stats(); }
+
+    const Stats& stats() const { return counters; }
+    size_t size() const { return map.size(); }
+    size_t limit() const { return capacity; }
+
+private:
+    struct Entry {
+        std::string key;
+        Directory* result;
+        Chain chain;
+    };
+    static std::string makeKey(const Directory* from, const std::string& path);
+
+    size_t capacity;
+    std::list<Entry> lru;                       // most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> map;
+    Stats counters;
+};
@@ -0,0 +1,202 @@
+#include "dedup.h"
+#include "filesystem.h"
+#include "fmtguard.h"
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <unordered_set>
+using namespace std;
+
+/*─────────────────────  Content-defined chunking  ──────────────*/
+namespace {
+    constexpr size_t MIN_BLOCK = 2 * 1024;
+    constexpr size_t AVG_BLOCK = 8 * 1024;
+    constexpr size_t MAX_BLOCK = Content::CHUNK;
+    // Normalized chunking: a harder mask (15 bits) before the average
+    // size and an easier one (11 bits) after it pull lengths towards it
+    constexpr uint64_t MASK_HARD = 0x0003590703530000ull;
+    constexpr uint64_t MASK_EASY = 0x0000d90003530000ull;
+
+    constexpr array<uint64_t, 256> gearTable() {
+        array<uint64_t, 256> t{};
+        uint64_t x = 0x6a09e667f3bcc908ull;                     // splitmix64
+        for (auto& v : t) {
+            uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            v = z ^ (z >> 31);
+        }
+        return t;
+    }
+    constexpr array<uint64_t, 256> GEAR = gearTable();
+
+    inline uint64_t load64(const char* p) { uint64_t v; memcpy(&v, p, 8); return v; }
+    inline uint64_t rotl(uint64_t v, unsigned r) { return (v << r) | (v >> (64 - r)); }
+}
+
+size_t cdcCut(const unsigned char* p, size_t n) {
+    if (n <= MIN_BLOCK) return n;
+    size_t end = min(n, MAX_BLOCK), normal = min(end, AVG_BLOCK);
+    uint64_t h = 0;
+    size_t i = MIN_BLOCK;
+    for (; i < normal; ++i) {
+        h = (h << 1) + GEAR[p[i]];
+        if (!(h & MASK_HARD)) return i + 1;
+    }
+    for (; i < end; ++i) {
+        h = (h << 1) + GEAR[p[i]];
+        if (!(h & MASK_EASY)) return i + 1;
+    }
+    return end;
+}
+
+uint64_t blockHash(const char* p, size_t n) {
+    constexpr uint64_t K1 = 0x9e3779b97f4a7c15ull, K2 = 0xc2b2ae3d27d4eb4full;
+    uint64_t h = n * K1;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) h = rotl(h ^ (load64(p + i) * K2), 31) * K1;
+    if (i < n) {
+        uint64_t tail = 0;
+        memcpy(&tail, p + i, n - i);
+        h = rotl(h ^ (tail * K2), 31) * K1;
+    }
+    h ^= h >> 33;                                              // fmix64
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    return h ^ (h >> 33);
+}
+
+/*──────────────────────────  Block store  ──────────────────────*/
+BlockStore::~BlockStore() {
+    for (auto& bucket : byHash)
+        for (Content::Chunk* c : bucket.second) Content::drop(c);
+}
+
+// The store's chunk with these bytes, with a reference for the caller
+Content::Chunk* BlockStore::intern(const char* p, size_t len, bool compress) {
+    vector<Content::Chunk*>& bucket = byHash[blockHash(p, len)];
+    for (Content::Chunk* c : bucket) {
+        if (c->size == len && memcmp(Content::data(c), p, len) == 0) {
+            c->refs.fetch_add(1, memory_order_relaxed);
+            ++hits;
+            hitBytes += len;
+            return c;
+        }
+    }
+    Content::Chunk* c = Content::newChunk(len);
+    memcpy(Content::bytes(c), p, len);
+    c->size = static_cast<uint32_t>(len);
+    if (compress) {
+        if (Content::Chunk* d = Content::pack(c, len)) {
+            Content::drop(c);
+            c = d;
+        }
+    }
+    c->refs.fetch_add(1, memory_order_relaxed);                // the store's reference
+    bucket.push_back(c);
+    ++blocks;
+    bytes += len;
+    return c;
+}
+
+void BlockStore::sweep() {
+    for (auto it = byHash.begin(); it != byHash.end();) {
+        vector<Content::Chunk*>& bucket = it->second;
+        for (size_t i = 0; i < bucket.size();) {
+            Content::Chunk* c = bucket[i];
+            if (c->refs.load(memory_order_acquire) != 1) {     // 1: the store's own
+                ++i;
+                continue;
+            }
+            --blocks;
+            bytes -= c->size;
+            Content::drop(c);
+            bucket[i] = bucket.back();
+            bucket.pop_back();
+        }
+        it = bucket.empty() ? byHash.erase(it) : next(it);
+    }
+}
+
+void BlockStore::dedup(Content& c) {
+    constexpr size_t WINDOW = 1024 * 1024;                     // bytes read at a time
+    uint64_t total = c.size(), readPos = 0;
+    if (!total) return;
+    bool compress = c.compressed();
+    vector<Content::Chunk*> chunks;
+    string window;                                             // read but not yet cut
+    size_t start = 0;
+    for (;;) {
+        if (window.size() - start < MAX_BLOCK && readPos < total) {
+            window.erase(0, start);
+            start = 0;
+            size_t have = window.size(), more = static_cast<size_t>(min<uint64_t>(WINDOW, total - readPos));
+            window.resize(have + more);
+            c.read(readPos, more, &window[have]);
+            readPos += more;
+        }
+        size_t avail = window.size() - start;
+        if (!avail) break;
+        const char* p = window.data() + start;
+        size_t len = cdcCut(reinterpret_cast<const unsigned char*>(p), avail);
+        chunks.push_back(intern(p, len, compress));
+        start += len;
+    }
+    c.adopt(chunks.data(), chunks.size());
+}
+
+/*──────────────────  FileSystem: deduplication  ────────────────*/
+// Re-chunks every file in `scope` through the file system's block store,
+// so equal chunks in it, and in whatever earlier runs covered, are held
+// once.  The bytes do not change, so nothing is journaled.
+bool FileSystem::dedupFiles(Directory* scope) {
+    vector<File*> files = filesUnder(scope ? scope : root);
+    BlockStore& store = blockStore;
+    store.sweep();
+    uint64_t blocks = store.blocks, bytes = store.bytes, hits = store.hits, hitBytes = store.hitBytes;
+    size_t count = 0;
+    uint64_t logical = 0;
+    auto t0 = chrono::steady_clock::now();
+    for (File* f : files) {
+        if (f->content.empty()) continue;
+        versions.preserve(f);
+        logical += f->content.size();
+        store.dedup(f->content);
+        ++count;
+    }
+    double s = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    FormatGuard format(cout);
+    cout << fixed << setprecision(2) << "DEDUPLICATED " << count << " FILE(S): " << logical / 1e6
+         << " MB IN " << store.blocks - blocks << " NEW BLOCK(S) OF " << (store.bytes - bytes) / 1e6 << " MB, "
+         << store.hits - hits << " DUPLICATE BLOCK(S) SHARED (" << (store.hitBytes - hitBytes) / 1e6 << " MB), "
+         << store.blocks << " BLOCK(S) IN THE STORE, "
+         << setprecision(0) << (s > 0 ? logical / 1e6 / s : 0.0) << " MB/S" << endl;
+    return true;
+}
+
+// How much `scope` would take without sharing, against the distinct
+// chunks it holds
+bool FileSystem::dedupStats(Directory* scope) {
+    vector<File*> files = filesUnder(scope ? scope : root);
+    unordered_set<const void*> seen;
+    uint64_t logical = 0, unique = 0, stored = 0, blocks = 0;
+    for (File* f : files) {
+        f->content.forEachBlock([&](const void* id, const char*, uint32_t packed, uint32_t len) {
+            logical += len;
+            ++blocks;
+            if (!seen.insert(id).second) return;
+            unique += len;
+            stored += packed ? packed : len;
+        });
+    }
+    FormatGuard format(cout);
+    cout << fixed << setprecision(2)
+         << "FILES: " << files.size() << ", " << logical / 1e6 << " MB IN " << blocks << " BLOCK(S)\n"
+         << "UNIQUE: " << seen.size() << " BLOCK(S), " << unique / 1e6 << " MB (DEDUP RATIO "
+         << (unique ? double(logical) / unique : 1.0) << ")\n"
+         << "STORED: " << stored / 1e6 << " MB WITH COMPRESSION (RATIO "
+         << (stored ? double(logical) / stored : 1.0) << ")" << endl;
+    return true;
+}
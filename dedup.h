@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "content.h"
+
+// Content-defined chunking and the block store behind `dedup`.
+//
+// Fixed 64 KB chunks only match while copies line up on chunk boundaries:
+// one inserted byte shifts every chunk after it.  Content-defined chunks
+// end where a rolling hash of the last 64 bytes matches a mask (FastCDC's
+// gear hash with normalized chunking), so the boundaries move with the
+// data and an edit only changes the chunks around it.  Chunks are 2 KB to
+// 64 KB, about 8 KB on average.
+//
+// The store maps a hash of each chunk's bytes to the chunks seen so far.
+// A chunk that is already there is shared, reference counted like every
+// other Content chunk, instead of being stored again.  The file system
+// keeps one store for its lifetime, so a `dedup` run also matches the
+// blocks of earlier runs in other directories.  Only `dedup` feeds it:
+// writes, imports and loaded snapshots add raw chunks until the next run.
+
+// Length of the content-defined chunk starting at p, out of n bytes
+size_t cdcCut(const unsigned char* p, size_t n);
+
+// 64-bit hash of a chunk's bytes
+uint64_t blockHash(const char* p, size_t n);
+
+class BlockStore {
+public:
+    BlockStore() = default;
+    ~BlockStore();
+    BlockStore(const BlockStore&) = delete;
+    BlockStore& operator=(const BlockStore&) = delete;
+
+    // Re-chunks c at content-defined boundaries and shares every chunk the
+    // store already holds; new chunks of compressed content are compressed
+    void dedup(Content& c);
+    // Drops the chunks no file refers to any more
+    void sweep();
+
+    uint64_t blocks = 0, bytes = 0;          // chunks stored, raw bytes they hold
+    uint64_t hits = 0, hitBytes = 0;         // chunks found in the store instead
+
+private:
+    Content::Chunk* intern(const char* p, size_t len, bool compress);
+
+    std::unordered_map<uint64_t, std::vector<Content::Chunk*>> byHash;
+};
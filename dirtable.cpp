@@ -0,0 +1,196 @@
+#include "filesystem.h"
+#include "dirtable.h"
+#include "metrics.h"
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <string_view>
+using namespace std;
+
+namespace {
+    const string& nameOf(uintptr_t node) {
+        if (node & 1) return reinterpret_cast<Directory*>(node & ~uintptr_t(1))->name;
+        return reinterpret_cast<File*>(node)->name;
+    }
+}
+
+/*─────────────────────────  EntryTable  ────────────────────────*/
+EntryTable::~EntryTable() {
+    if (EntrySource* src = source.load(memory_order_acquire)) src->dropped();
+    addGauge(Gauge::EntryTableBytes, -static_cast<int64_t>(capacity * sizeof(Slot)));
+    delete[] slots;
+}
+
+uint64_t EntryTable::nextGeneration() {
+    static atomic<uint64_t> counter{0};
+    return counter.fetch_add(1, memory_order_relaxed) + 1;
+}
+
+uint32_t EntryTable::hashName(const string& name) {
+    size_t h = hash<string_view>()(name);
+    return static_cast<uint32_t>(h ^ (h >> 32));
+}
+
+size_t EntryTable::probe(const string& name, uint32_t h) const {
+    if (!capacity) return string::npos;
+    size_t mask = capacity - 1;
+    for (size_t i = h & mask;; i = (i + 1) & mask) {
+        const Slot& s = slots[i];
+        if (s.node == EMPTY) return string::npos;
+        if (s.node != TOMBSTONE && s.hash == h && nameOf(s.node) == name) return i;
+    }
+}
+
+void EntryTable::fault() const {
+    if (EntrySource* src = source.load(memory_order_acquire))
+        src->loadEntries(sourceDir, sourceIndex);
+}
+
+void EntryTable::setSource(EntrySource* src, Directory* owner, uint64_t index) {
+    sourceDir = owner;
+    sourceIndex = index;
+    source.store(src, memory_order_release);
+}
+
+Directory* EntryTable::findDir(const string& name) const {
+    ensure();
+    size_t i = probe(name, hashName(name));
+    if (i == string::npos || !(slots[i].node & DIR_TAG)) return nullptr;
+    return reinterpret_cast<Directory*>(slots[i].node & ~DIR_TAG);
+}
+
+File* EntryTable::findFile(const string& name) const {
+    ensure();
+    size_t i = probe(name, hashName(name));
+    if (i == string::npos || (slots[i].node & DIR_TAG)) return nullptr;
+    return reinterpret_cast<File*>(slots[i].node);
+}
+
+bool EntryTable::contains(const string& name) const {
+    ensure();
+    return probe(name, hashName(name)) != string::npos;
+}
+
+void EntryTable::rehash(size_t newCapacity) {
+    Slot* old = slots;
+    size_t oldCapacity = capacity;
+    slots = new Slot[newCapacity]();
+    addGauge(Gauge::EntryTableBytes, static_cast<int64_t>(newCapacity * sizeof(Slot)) -
+                                     static_cast<int64_t>(oldCapacity * sizeof(Slot)));
+    capacity = newCapacity;
+    tombstones = 0;
+    size_t mask = capacity - 1;
+    for (size_t i = 0; i < oldCapacity; ++i) {
+        if (old[i].node == EMPTY || old[i].node == TOMBSTONE) continue;
+        size_t j = old[i].hash & mask;
+        while (slots[j].node != EMPTY) j = (j + 1) & mask;
+        slots[j] = old[i];
+    }
+    delete[] old;
+}
+
+void EntryTable::reserve(size_t n) {
+    ensure();
+    size_t want = 8;
+    while (want * 3 < n * 4) want <<= 1;                       // keep load <= 3/4
+    if (want > capacity) rehash(want);
+}
+
+bool EntryTable::insertNode(uintptr_t node, const string& name) {
+    size_t used = dirs + files;
+    if ((used + tombstones + 1) * 4 > capacity * 3)
+        rehash(max<size_t>(8, capacity * (used * 2 >= capacity ? 2 : 1)));
+    uint32_t h = hashName(name);
+    size_t mask = capacity - 1;
+    size_t target = string::npos;
+    for (size_t i = h & mask;; i = (i + 1) & mask) {
+        Slot& s = slots[i];
+        if (s.node == EMPTY) {
+            if (target == string::npos) target = i;
+            break;
+        }
+        if (s.node == TOMBSTONE) {
+            if (target == string::npos) target = i;
+        } else if (s.hash == h && nameOf(s.node) == name) {
+            return false;                                      // name taken
+        }
+    }
+    if (slots[target].node == TOMBSTONE) --tombstones;
+    slots[target].hash = h;
+    slots[target].node = node;
+    if (node & DIR_TAG) { ++dirs; gen = nextGeneration(); }
+    else ++files;
+    invalidate();
+    return true;
+}
+
+bool EntryTable::insert(Directory* dir) {
+    ensure();
+    return insertLoaded(dir);
+}
+
+bool EntryTable::insert(File* file) {
+    ensure();
+    return insertLoaded(file);
+}
+
+bool EntryTable::insertLoaded(Directory* dir) {
+    return insertNode(reinterpret_cast<uintptr_t>(dir) | DIR_TAG, dir->name);
+}
+
+bool EntryTable::insertLoaded(File* file) {
+    return insertNode(reinterpret_cast<uintptr_t>(file), file->name);
+}
+
+bool EntryTable::erase(const string& name) {
+    ensure();
+    size_t i = probe(name, hashName(name));
+    if (i == string::npos) return false;
+    if (slots[i].node & DIR_TAG) { --dirs; gen = nextGeneration(); }
+    else --files;
+    size_t next = (i + 1) & (capacity - 1);
+    if (slots[next].node == EMPTY) {
+        slots[i].node = EMPTY;                                 // end of a run
+    } else {
+        slots[i].node = TOMBSTONE;
+        ++tombstones;
+    }
+    if (empty()) clear();
+    invalidate();
+    return true;
+}
+
+void EntryTable::clear() {
+    if (EntrySource* src = source.exchange(nullptr, memory_order_acq_rel)) src->dropped();
+    addGauge(Gauge::EntryTableBytes, -static_cast<int64_t>(capacity * sizeof(Slot)));
+    delete[] slots;
+    slots = nullptr;
+    if (dirs) gen = nextGeneration();
+    capacity = dirs = files = tombstones = 0;
+    dirView = {};
+    fileView = {};
+    invalidate();
+}
+
+const vector<Directory*>& EntryTable::sortedDirs() const {
+    ensure();
+    if (!sortedValid) {
+        dirView.clear();
+        fileView.clear();
+        dirView.reserve(dirs);
+        fileView.reserve(files);
+        forEach([&](Directory* d) { dirView.push_back(d); },
+                [&](File* f) { fileView.push_back(f); });
+        sort(dirView.begin(), dirView.end(),
+             [](const Directory* a, const Directory* b) { return a->name < b->name; });
+        sort(fileView.begin(), fileView.end(),
+             [](const File* a, const File* b) { return a->name < b->name; });
+        sortedValid = true;
+    }
+    return dirView;
+}
+
+const vector<File*>& EntryTable::sortedFiles() const {
+    sortedDirs();
+    return fileView;
+}
@@ -0,0 +1,130 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+struct File;
+class Directory;
+
+// Supplies the entries of a directory that has not been read yet (a lazily
+// loaded snapshot).  loadEntries fills dir->entries through insertLoaded
+// and ends with markResident; it may be called again by a thread that
+// raced for the same directory and must then do nothing.  dropped() says
+// an unread directory went away without being read.
+class EntrySource {
+public:
+    virtual ~EntrySource() = default;
+    virtual void loadEntries(Directory* dir, uint64_t index) = 0;
+    virtual void dropped() = 0;
+};
+
+// Per-directory index of subdirectories and files.
+//
+// One flat open-addressing table (linear probing, power-of-two capacity)
+// holds both kinds, so a name-collision check is a single probe sequence.
+// A slot is 16 bytes: the cached hash plus a tagged node pointer (low bit
+// set = Directory).  The key is the node's own `name` member, so the name
+// is stored exactly once (inline for short names thanks to SSO) and a
+// node must be erased *before* it is renamed and re-inserted afterwards.
+// Empty directories allocate nothing.  Listings use a sorted view that is
+// built on demand and cached until the next insert or erase.
+//
+// generation() changes whenever a subdirectory is added or removed (and
+// so on a rename or move).  Values come from one global counter and are
+// never reused, so a cached path walk can be validated against them.
+//
+// A table can also start out empty but backed by an EntrySource: the first
+// call that looks at the entries (any member below except generation,
+// clear, resident and the source's own calls) has the source fill it in.
+// clear() drops the source without loading anything, which is how an
+// unread subtree is thrown away.
+class EntryTable {
+public:
+    EntryTable() = default;
+    ~EntryTable();
+    EntryTable(const EntryTable&) = delete;
+    EntryTable& operator=(const EntryTable&) = delete;
+
+    Directory* findDir(const std::string& name) const;
+    File* findFile(const std::string& name) const;
+    bool contains(const std::string& name) const;
+
+    bool insert(Directory* dir);                // false if the name is taken
+    bool insert(File* file);
+    bool erase(const std::string& name);        // unlinks only, node stays alive
+    void clear();
+    void reserve(size_t n);
+
+    uint64_t generation() const { return gen; }
+
+    size_t dirCount() const { ensure(); return dirs; }
+    size_t fileCount() const { ensure(); return files; }
+    size_t size() const { ensure(); return dirs + files; }
+    bool empty() const { return size() == 0; }
+
+    // Lazy loading
+    void setSource(EntrySource* src, Directory* owner, uint64_t index);
+    bool resident() const { return !source.load(std::memory_order_acquire); }
+    bool insertLoaded(Directory* dir);          // for the source: no fault
+    bool insertLoaded(File* file);
+    void markResident() { source.store(nullptr, std::memory_order_release); }
+    // The source of an unread table and the index it was given (nullptr:
+    // resident); another thread may be reading the table at this moment
+    EntrySource* unreadSource(uint64_t& index) const {
+        EntrySource* src = source.load(std::memory_order_acquire);
+        if (src) index = sourceIndex;
+        return src;
+    }
+    // Reads an unread table now, before taking a lock the source must not
+    // be called under
+    void load() const { ensure(); }
+
+    const std::vector<Directory*>& sortedDirs() const;
+    const std::vector<File*>& sortedFiles() const;
+    bool sortedReady() const { return resident() && sortedValid; }   // the views cost nothing now
+
+    // Visits every entry in table order (cheaper than the sorted views)
+    template <class OnDir, class OnFile>
+    void forEach(OnDir onDir, OnFile onFile) const {
+        ensure();
+        for (size_t i = 0; i < capacity; ++i) {
+            uintptr_t n = slots[i].node;
+            if (n == EMPTY || n == TOMBSTONE) continue;
+            if (n & DIR_TAG) onDir(reinterpret_cast<Directory*>(n & ~DIR_TAG));
+            else             onFile(reinterpret_cast<File*>(n));
+        }
+    }
+
+    static uint32_t hashName(const std::string& name);
+
+private:
+    struct Slot {
+        uint32_t hash;
+        uintptr_t node;                         // EMPTY, TOMBSTONE or tagged pointer
+    };
+    static constexpr uintptr_t EMPTY = 0;
+    static constexpr uintptr_t TOMBSTONE = 2;
+    static constexpr uintptr_t DIR_TAG = 1;
+
+    size_t probe(const std::string& name, uint32_t h) const;   // slot index or npos
+    bool insertNode(uintptr_t node, const std::string& name);
+    void rehash(size_t newCapacity);
+    void invalidate() { sortedValid = false; }
+    void ensure() const { if (!resident()) fault(); }
+    void fault() const;
+    static uint64_t nextGeneration();
+
+    Slot* slots = nullptr;
+    size_t capacity = 0;
+    size_t dirs = 0, files = 0, tombstones = 0;
+    uint64_t gen = nextGeneration();
+    std::atomic<EntrySource*> source{nullptr};
+    Directory* sourceDir = nullptr;
+    uint64_t sourceIndex = 0;
+
+    mutable std::vector<Directory*> dirView;
+    mutable std::vector<File*> fileView;
+    mutable bool sortedValid = false;
+};
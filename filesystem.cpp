@@ -1,5 +1,11 @@
 #include "filesystem.h"
+#include "bufwriter.h"
+#include "snapshot.h"
+#include "journal.h"
+#include "metrics.h"
 #include <limits>
+#include <charconv>
+#include <filesystem>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -12,64 +18,224 @@
 #include <cctype>          // for tolower
 using namespace std;
 
-// Helper: current local timestamp “YYYY‑MM‑DD HH:MM:SS”
-static string getTimestamp() {
-    time_t now = time(nullptr);
-    char buf[32]{};
-    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", localtime(&now));
-    return string(buf);
-}
-
 /*────────────────────────────  File  ───────────────────────────*/
 File::File(const string& filename)
-    : name(filename), content(""),
-      createdAt(getTimestamp()), modifiedAt(createdAt) {}
+    : name(filename),
+      createdAt(wallClock()), modifiedAt(createdAt) {}
+
+File::File(const string& filename, Timestamp created, Timestamp modified)
+    : name(filename), createdAt(created), modifiedAt(modified) {}
 
 /*──────────────────────────  Directory  ────────────────────────*/
 Directory::Directory(const string& dirName, Directory* par)
     : name(dirName), parent(par) {}
 
-Directory::~Directory() {
-    for (auto& d : subDirs) delete d.second;
-    for (auto& f : files)   delete f.second;
-}
 
 /*──────────────────────────  FileSystem  ───────────────────────*/
-FileSystem::FileSystem() {
-    root = new Directory("root");
+FileSystem::FileSystem(const string& dataFile) : dataFile(dataFile) {
+    root = newDirectory("root", nullptr);
     curr = root;
-    loadFromDisk("fs_data.txt");
+    if (dataFile.empty()) return;                              // scratch tree: no file, no journal
+    // First run with the binary format: pick up the old text data file.
+    // A data file that is there but does not load is left alone, journal
+    // included, and never written over
+    bool imported = false;
+    error_code ec;
+    if (filesystem::exists(dataFile, ec) || ec) {
+        if (!loadFromDisk(dataFile)) {
+            cerr << "COULD NOT LOAD " << dataFile << ": STARTING EMPTY, CHANGES WILL NOT BE SAVED TO IT" << endl;
+            clearAll();                                        // whatever was read before it failed
+            keepDataFile = true;
+            return;
+        }
+    } else if (dataFile != "fs_data.txt") {
+        imported = loadFromDisk("fs_data.txt");
+    }
+
+    // Text data files are still rewritten as a whole; snapshots get a journal
+    size_t n = dataFile.size();
+    if (n >= 4 && dataFile.compare(n - 4, 4, ".txt") == 0) return;
+    openJournal();
+    if (imported) checkpoint();
 }
 
 FileSystem::~FileSystem() {
-    saveToDisk("fs_data.txt");
-    delete root;
+    if (journal) {
+        journal->close();
+        waitForCheckpoint();
+    } else if (!dataFile.empty()) {
+        saveToDisk(dataFile);
+    }
+    if (!metricsFile.empty()) {
+        size_t n = metricsFile.size();
+        bool json = n >= 5 && metricsFile.compare(n - 5, 5, ".json") == 0;
+        if (!writeMetrics(metricsFile, json)) cerr << "COULD NOT WRITE METRICS " << metricsFile << endl;
+    }
+    // dirPool / filePool release every node when they are destroyed
+}
+
+/*─────────────────────────  Node pools  ───────────────────────*/
+bool validName(const string& name) {
+    if (name.empty() || name == "." || name == "..") return false;
+#ifdef _WIN32
+    if (name.find('\\') != string::npos) return false;
+#endif
+    return name.find('/') == string::npos;
+}
+
+namespace {
+    constexpr size_t RECLAIM_NODES = 1024;     // smaller deletes are freed inline
+}
+
+Directory* FileSystem::newDirectory(const string& name, Directory* parent) {
+    Directory* d = dirPool.create(name, parent);
+    d->mvccEpoch = versions.current();                         // no view can see it yet
+    return d;
+}
+
+File* FileSystem::newFile(Directory* parent, const string& name, Timestamp created, Timestamp modified) {
+    if (!validName(name)) return nullptr;
+    File* f = filePool.create(name, created, modified);
+    f->mvccEpoch = versions.current();
+    versions.preserve(parent);
+    if (!parent->entries.insert(f)) {
+        filePool.destroy(f);
+        return nullptr;
+    }
+    f->parent = parent;
+    nameIndex.add(f);
+    return f;
+}
+
+// Caller has already unlinked `f` from its directory
+void FileSystem::freeFile(File* f) {
+    nameIndex.remove(f);
+    if (versions.active()) {                                   // a pinned view may still read it
+        vector<Directory*> dirs;
+        vector<File*> files{f};
+        if (versions.defer(dirs, files)) return;
+    }
+    filePool.destroy(f);
+}
+
+// Returns a subtree the caller has already unlinked to the pools.  Its
+// files leave the name index right away; freeing the nodes of anything
+// but a small subtree is left to the reclaimer thread, and nothing is
+// freed while a pinned view may still reach it.
+void FileSystem::detachTree(Directory* dir) {
+    vector<Directory*> dirs{dir};
+    vector<File*> files;
+    bool viewed = versions.active();                           // a view may still read unread parts
+    for (size_t i = 0; i < dirs.size(); ++i) {
+        if (!viewed && !dirs[i]->entries.resident()) continue;
+        dirs[i]->entries.forEach([&](Directory* d) { dirs.push_back(d); },
+                                 [&](File* f) { nameIndex.remove(f); files.push_back(f); });
+    }
+    if (versions.defer(dirs, files)) return;
+    if (dirs.size() + files.size() >= RECLAIM_NODES) {
+        reclaimer.reclaim(move(dirs), move(files));
+        return;
+    }
+    for (File* f : files) filePool.destroy(f);
+    for (Directory* d : dirs) dirPool.destroy(d);
+}
+
+// Make everything done so far durable
+bool FileSystem::sync() {
+    if (journal) return journal->commit();
+    return saveToDisk(dataFile);
+}
+
+// Timestamp for the operation in progress (a replayed record brings its
+// own, a bulk operation pins one for all the nodes it creates)
+Timestamp FileSystem::now() {
+    return pinnedStamp ? pinnedStamp : wallClock();
 }
 
 /*───────────── internal helper used by loadFromDisk ───────────*/
 namespace {
-    Directory* ensureDir(Directory* root, const string& relPath) {
-        Directory* cur = root;
-        stringstream ss(relPath);
-        string token;
-        while (getline(ss, token, '/')) {
-            if (token.empty()) continue;
-            auto it = cur->subDirs.find(token);
-            if (it == cur->subDirs.end()) {
-                Directory* neo = new Directory(token, cur);
-                cur->subDirs[token] = neo;
-                cur = neo;
-            } else
-                cur = it->second;
+    // Calls fn(segment) for every non-empty '/'-separated segment; stops
+    // (and returns false) as soon as fn does
+    template <class Fn>
+    bool forEachSegment(const string& path, Fn fn) {
+        string seg;
+        for (size_t pos = 0; pos < path.size();) {
+            size_t end = path.find('/', pos);
+            if (end == string::npos) end = path.size();
+            seg.assign(path, pos, end - pos);
+            pos = end + 1;
+            if (!seg.empty() && !fn(seg)) return false;
         }
-        return cur;
+        return true;
     }
+
+    bool hasSegment(const string& path, const char* name) {
+        return !forEachSegment(path, [&](const string& seg) { return seg != name; });
+    }
+}
+
+// Unlike walkPath, "." and ".." are ordinary names here
+Directory* FileSystem::ensureDir(const string& relPath) {
+    bool cacheable = !hasSegment(relPath, ".") && !hasSegment(relPath, "..");
+    Directory* cur = nullptr;
+    if (cacheable && dcache.lookup(root, relPath, cur) && cur) return cur;
+    cur = root;
+    DentryCache::Chain chain;
+    bool ok = forEachSegment(relPath, [&](const string& seg) {
+        Directory* next = cur->entries.findDir(seg);
+        if (!next) {
+            if (!validName(seg) || cur->entries.contains(seg)) return false;   // a file has the name
+            next = newDirectory(seg, cur);
+            versions.preserve(cur);
+            cur->entries.insert(next);
+            addUsage(cur, {0, 0, 1, 0});
+        }
+        chain.emplace_back(cur, cur->entries.generation());
+        cur = next;
+        return true;
+    });
+    if (!ok) return nullptr;
+    if (cacheable) dcache.store(root, relPath, cur, move(chain));
+    return cur;
 }
 
 /*──────────────────────  Persistence  ─────────────────────────*/
-void FileSystem::saveToDisk(const string& filename) {
+// "*.txt" keeps the line based text format, anything else is a snapshot
+bool FileSystem::saveToDisk(const string& filename) {
+    if (keepDataFile && filename == dataFile) {
+        cerr << "NOT SAVING " << filename << ": IT DID NOT LOAD" << endl;
+        return false;
+    }
+    size_t n = filename.size();
+    bool ok = (n >= 4 && filename.compare(n - 4, 4, ".txt") == 0)
+            ? exportText(filename) : saveSnapshot(filename);
+    if (!ok) cerr << "COULD NOT SAVE " << filename << endl;
+    return ok;
+}
+
+// Whether `filename` is the data file, however the path is spelled
+bool FileSystem::isDataFile(const string& filename) {
+    if (filename == dataFile) return true;
+    // Absolute first: a relative name that does not exist yet stays relative
+    auto resolve = [](const string& p, filesystem::path& out) {
+        error_code ec;
+        filesystem::path abs = filesystem::absolute(p, ec);
+        if (!ec) out = filesystem::weakly_canonical(abs, ec);
+        return !ec;
+    };
+    filesystem::path a, b;
+    return resolve(filename, a) && resolve(dataFile, b) && a == b;
+}
+
+bool FileSystem::loadFromDisk(const string& filename) {
+    if (isSnapshotFile(filename)) return loadSnapshot(filename);
+    return importText(filename);
+}
+
+bool FileSystem::exportText(const string& filename) {
+    OpTimer timer(Op::ExportText);
     ofstream out(filename, ios::binary);
-    if (!out) return;
+    if (!out) return false;
 
     queue<pair<Directory*, string>> q;
     q.push({root, ""});
@@ -80,156 +246,257 @@ void FileSystem::saveToDisk(const string& filename) {
         string path = it.second;
         q.pop();
 
-        for (const auto& d : dir->subDirs) {                   // sub‑dirs
-            string child = path + "/" + d.first;
+        for (Directory* d : dir->entries.sortedDirs()) {       // sub‑dirs
+            string child = path + "/" + d->name;
             out << "D|" << child << '\n';
-            q.push({d.second, child});
+            q.push({d, child});
         }
-        for (const auto& fp : dir->files) {                    // files
-            File* f = fp.second;
+        for (File* f : dir->entries.sortedFiles()) {           // files
             string filePath = path + "/" + f->name;
             out << "F|" << filePath << '|'
-                << f->createdAt << '|'
-                << f->modifiedAt << '|'
+                << formatTimestamp(f->createdAt) << '|'
+                << formatTimestamp(f->modifiedAt) << '|'
                 << f->content.size() << '\n';
-            if (!f->content.empty())
-                out.write(f->content.data(),
-                          static_cast<streamsize>(f->content.size()));
+            out << f->content;
             out << '\n';
         }
     }
+    return static_cast<bool>(out);
 }
 
-void FileSystem::loadFromDisk(const string& filename) {
-    ifstream in(filename, ios::binary);
-    if (!in) return;                                           // first run
+bool FileSystem::importText(const string& filename) {
+    OpTimer timer(Op::ImportText);
+    ifstream in(filename, ios::binary | ios::ate);
+    if (!in) return false;                                     // first run
+    uint64_t fileSize = static_cast<uint64_t>(in.tellg());
+    in.seekg(0);
 
+    Timestamp loadedAt = coarseClock();                        // for unreadable stamps
     string line;
     while (getline(in, line)) {
         if (line.rfind("D|", 0) == 0) {                        // dir line
-            ensureDir(root, line.substr(2));
+            ensureDir(line.substr(2));
         } else if (line.rfind("F|", 0) == 0) {                 // file line
             size_t p1 = line.find('|', 2);
-            size_t p2 = line.find('|', p1 + 1);
-            size_t p3 = line.find('|', p2 + 1);
+            size_t p2 = p1 == string::npos ? p1 : line.find('|', p1 + 1);
+            size_t p3 = p2 == string::npos ? p2 : line.find('|', p2 + 1);
+            if (p3 == string::npos) return false;              // malformed record
             string filePath  = line.substr(2, p1 - 2);
             string createdAt = line.substr(p1 + 1, p2 - p1 - 1);
             string modifiedAt= line.substr(p2 + 1, p3 - p2 - 1);
-            size_t len       = stoul(line.substr(p3 + 1));
+            uint64_t len = 0;
+            const char* first = line.data() + p3 + 1;
+            const char* last = line.data() + line.size();
+            auto [end, err] = from_chars(first, last, len);
+            // The content follows the header line, so it cannot be longer
+            // than what is left of the file
+            uint64_t left = fileSize - min(fileSize, static_cast<uint64_t>(in.tellg()));
+            if (err != errc() || end != last || first == last || len > left) return false;
 
             string content(len, '\0');
-            if (len) in.read(&content[0], static_cast<streamsize>(len));
+            if (len && !in.read(&content[0], static_cast<streamsize>(len))) return false;
             in.get();                                          // eat '\n'
 
             size_t lastSlash = filePath.find_last_of('/');
             string dirPart = (lastSlash == string::npos) ? "" : filePath.substr(0, lastSlash);
             string base = filePath.substr(lastSlash + 1);
 
-            Directory* parent = ensureDir(root, dirPart);
-            if (parent->files.count(base)) continue;           // already exists
-            File* f = new File(base);
-            f->createdAt  = createdAt;
-            f->modifiedAt = modifiedAt;
-            f->content    = move(content);
-            parent->files[base] = f;
+            Directory* parent = ensureDir(dirPart);
+            if (!parent || parent->entries.contains(base)) continue;   // already exists
+            Timestamp created = loadedAt, modified = loadedAt;
+            parseTimestamp(createdAt, created);
+            parseTimestamp(modifiedAt, modified);
+            File* f = newFile(parent, base, created, modified);
+            if (!f) continue;                                  // invalid name
+            f->content.assign(content);
+            addUsage(parent, usageOf(f));
         }
     }
     curr = root;
+    return true;
 }
 
 /*───────────────  Path navigation helper  ─────────────────────*/
 Directory* FileSystem::navigateToPath(const string& relPath) {
     if (relPath.empty() || relPath == "/") return root;
+    return walkPath(root, relPath);
+}
 
-    Directory* dir = root;
-    stringstream ss(relPath);
-    string token;
-    while (getline(ss, token, '/')) {
-        if (token.empty()) continue;
-        auto it = dir->subDirs.find(token);
-        if (it == dir->subDirs.end()) return nullptr;          // bad segment
-        dir = it->second;
-    }
+// Walk `path` segment by segment starting at `from` ("." and ".." allowed).
+// Walks without ".." are answered from the dentry cache when possible.
+Directory* FileSystem::walkPath(Directory* from, const string& path) {
+    OpTimer timer(Op::Navigate);
+    bool cacheable = !hasSegment(path, "..");
+    Directory* dir = from;
+    if (cacheable && dcache.lookup(from, path, dir)) return dir;
+    DentryCache::Chain chain;
+    forEachSegment(path, [&](const string& seg) {
+        if (seg == ".") return true;
+        if (seg == "..") {
+            if (dir->parent) dir = dir->parent;
+            return true;
+        }
+        chain.emplace_back(dir, dir->entries.generation());
+        dir = dir->entries.findDir(seg);
+        return dir != nullptr;                                 // bad segment
+    });
+    if (cacheable) dcache.store(from, path, dir, move(chain));
     return dir;
 }
 
-vector<string> FileSystem::listAndNumber(const map<string, Directory*> &dirs, const map<string, File*> &fls,bool showDirs) {
-    vector<string> names;
-    int idx = 1;
-    if (showDirs) {
-        cout << "DIRECTORIES:" << endl;
-        for (auto &d : dirs) {
-            cout << "  " << idx++ << ". " << d.first << endl;
-            names.push_back(d.first);
+// Absolute paths start at root, everything else is relative to curr
+Directory* FileSystem::resolveDir(const string& path) {
+    if (!path.empty() && path[0] == '/') return walkPath(root, path);
+    return walkPath(curr, path);
+}
+
+// Resolve everything but the last segment; the last segment goes to `base`
+Directory* FileSystem::resolveParent(const string& path, string& base) {
+    size_t lastSlash = path.find_last_of('/');
+    if (lastSlash == string::npos) {
+        base = path;
+        return curr;
+    }
+    base = path.substr(lastSlash + 1);
+    if (lastSlash == 0) return root;
+    return resolveDir(path.substr(0, lastSlash));
+}
+
+string FileSystem::childPath(Directory* dir, const string& name) {
+    string p = pathOf(dir);
+    if (p.size() > 1) p += '/';
+    return p + name;
+}
+
+string FileSystem::pathOf(Directory* dir) {
+    vector<string> v;
+    for (Directory* t = dir; t && t != root; t = t->parent) v.push_back(t->name);
+    string p;
+    for (int i = (int)v.size() - 1; i >= 0; --i) p += "/" + v[i];
+    return p.empty() ? "/" : p;
+}
+
+vector<File*> FileSystem::filesUnder(Directory* dir, bool inPathOrder) {
+    vector<File*> out;
+    vector<Directory*> stack{dir};
+    while (!stack.empty()) {
+        Directory* d = stack.back();
+        stack.pop_back();
+        if (!inPathOrder) {
+            d->entries.forEach([&](Directory* sub) { stack.push_back(sub); },
+                               [&](File* f) { out.push_back(f); });
+            continue;
         }
-        if (names.empty()) cout << "  (NO DIRECTORIES FOUND)" << endl;
+        for (File* f : d->entries.sortedFiles()) out.push_back(f);
+        const auto& subs = d->entries.sortedDirs();
+        for (auto it = subs.rbegin(); it != subs.rend(); ++it) stack.push_back(*it);
+    }
+    return out;
+}
+
+// Numbered names for a selection, in one buffered write; the numbers
+// index the directory's sorted view (see chooseFromList)
+size_t FileSystem::listAndNumber(Directory* dir, bool showDirs) {
+    BufferedWriter out(cout);
+    uint64_t idx = 0;
+    if (showDirs) {
+        out << "DIRECTORIES:\n";
+        for (Directory* d : dir->entries.sortedDirs()) out << "  " << ++idx << ". " << d->name << '\n';
+        if (!idx) out << "  (NO DIRECTORIES FOUND)\n";
     } else {
-        cout << "FILES:" << endl;
-        for (auto &f : fls) {
-            cout << "  " << idx++ << ". " << f.first << endl;
-            names.push_back(f.first);
-        }
-        if (names.empty()) cout << "  (NO FILES FOUND)" << endl;
+        out << "FILES:\n";
+        for (File* f : dir->entries.sortedFiles()) out << "  " << ++idx << ". " << f->name << '\n';
+        if (!idx) out << "  (NO FILES FOUND)\n";
     }
-    return names;
+    return idx;
 }
 
-string FileSystem::chooseFromList(const vector<string>& names, const string& prompt) {
-    if (names.empty()) return "";
-    int choice; 
+string FileSystem::chooseFromList(Directory* dir, bool fromDirs, const string& prompt) {
+    size_t count = fromDirs ? dir->entries.dirCount() : dir->entries.fileCount();
+    if (!count) return "";
+    long long choice;
     cout << prompt; 
     cin >> choice; 
     cin.ignore(numeric_limits<streamsize>::max(), '\n');
-    if (choice < 1 || choice > (int)names.size()) {
+    if (choice < 1 || static_cast<size_t>(choice) > count) {
         cout << "INVALID CHOICE." << endl;
         return "";
     }
-    return names[choice - 1];
+    return fromDirs ? dir->entries.sortedDirs()[choice - 1]->name : dir->entries.sortedFiles()[choice - 1]->name;
 }
 
-void FileSystem::makeDirectory(const string &name) {
-    if (curr->subDirs.count(name) || curr->files.count(name)) {
+bool FileSystem::makeDirectory(const string &name) {
+    OpTimer timer(Op::MakeDir);
+    if (!validName(name)) {
+        cout << "INVALID NAME." << endl;
+        return false;
+    }
+    if (curr->entries.contains(name)) {
         cout << "NAME ALREADY IN USE." << endl;
-    } else {
-        Directory* newDir = new Directory(name, curr);
-        curr->subDirs[name] = newDir;
-        cout << "DIRECTORY CREATED." << endl;
+        return false;
     }
+    versions.preserve(curr);
+    curr->entries.insert(newDirectory(name, curr));
+    addUsage(curr, {0, 0, 1, 0});
+    logOp(J_MKDIR, {childPath(curr, name)});
+    cout << "DIRECTORY CREATED." << endl;
+    return true;
 }
 
-void FileSystem::deleteFileByName(const string& name) {
-    if(!curr->files.count(name)) {
+bool FileSystem::deleteFileByName(const string& name) {
+    OpTimer timer(Op::RemoveFile);
+    File* f = curr->entries.findFile(name);
+    if (!f) {
         cout << "File not found!" << endl;
-        return;
+        return false;
     }
-    delete curr->files[name];
-    curr->files.erase(name);
+    versions.preserve(curr);
+    curr->entries.erase(name);
+    removeUsage(curr, usageOf(f));
+    freeFile(f);
+    logOp(J_RMFILE, {childPath(curr, name)});
     cout << "File deleted." << endl;
+    return true;
 }
 
-void FileSystem::deleteDirectoryByName(const string& name) {
-    if(!curr->subDirs.count(name)) {
+bool FileSystem::deleteDirectoryByName(const string& name) {
+    OpTimer timer(Op::RemoveDir);
+    Directory* d = curr->entries.findDir(name);
+    if (!d) {
         cout << "Directory not found!" << endl;
-        return;
+        return false;
     }
-    delete curr->subDirs[name];
-    curr->subDirs.erase(name);
+    versions.preserve(curr);
+    curr->entries.erase(name);
+    removeUsage(curr, subtreeUsage(d));
+    detachTree(d);
+    logOp(J_RMDIR, {childPath(curr, name)});
     cout << "Directory deleted." << endl;
+    return true;
 }
 
-void FileSystem::renameDirectory(const string &oldN, const string &newN) {
-    if (!curr->subDirs.count(oldN)) { 
+bool FileSystem::renameDirectory(const string &oldN, const string &newN) {
+    OpTimer timer(Op::RenameDir);
+    Directory* d = curr->entries.findDir(oldN);
+    if (!d) { 
         cout << "DIRECTORY NOT FOUND." << endl; 
-        return; 
+        return false; 
     }
-    if (curr->subDirs.count(newN) || curr->files.count(newN)) { 
+    if (!validName(newN)) {
+        cout << "INVALID NAME." << endl;
+        return false;
+    }
+    if (curr->entries.contains(newN)) { 
         cout << "NAME ALREADY EXISTS." << endl; 
-        return; 
+        return false; 
     }
-    curr->subDirs[newN] = curr->subDirs[oldN];
-    curr->subDirs[newN]->name = newN;
-    curr->subDirs.erase(oldN);
+    versions.preserve(curr);
+    curr->entries.erase(oldN);                                 // key is the name
+    d->name = newN;
+    curr->entries.insert(d);
+    logOp(J_RENAME, {childPath(curr, oldN), newN});
     cout << "DIRECTORY RENAMED." << endl;
+    return true;
 }
 
 void FileSystem::changeDirectory() {
@@ -237,9 +504,9 @@ void FileSystem::changeDirectory() {
     int idx = 1;
     
     cout << "AVAILABLE DIRECTORIES:" << endl;
-    for (auto& d : curr->subDirs) {
-        cout << "  " << idx++ << ". " << d.first << endl;
-        names.push_back(d.first);
+    for (Directory* d : curr->entries.sortedDirs()) {
+        cout << "  " << idx++ << ". " << d->name << endl;
+        names.push_back(d->name);
     }
     
     if (curr->parent) {
@@ -266,40 +533,58 @@ void FileSystem::changeDirectory() {
     if (selected == "..") {
         curr = curr->parent;
     } else {
-        curr = curr->subDirs[selected];
+        curr = curr->entries.findDir(selected);
     }
     cout << "NOW IN: "; printPath();
 }
 
-void FileSystem::createFile(const string &name) {
-    if (curr->files.count(name) || curr->subDirs.count(name)) { 
+bool FileSystem::createFile(const string &name) {
+    OpTimer timer(Op::CreateFile);
+    if (!validName(name)) {
+        cout << "INVALID NAME." << endl;
+        return false;
+    }
+    if (curr->entries.contains(name)) { 
         cout << "NAME ALREADY IN USE." << endl; 
-        return; 
+        return false; 
     }
-    File* newFile = new File(name);
-    curr->files[name] = newFile;
+    Timestamp ts = now();
+    addUsage(curr, usageOf(newFile(curr, name, ts, ts)));
+    logOp(J_CREATE, {childPath(curr, name), stampField(ts)});
     cout << "FILE CREATED." << endl;
+    return true;
 }
 
-void FileSystem::renameFile(const string &oldN, const string &newN) {
-    if (!curr->files.count(oldN)) { 
+bool FileSystem::renameFile(const string &oldN, const string &newN) {
+    OpTimer timer(Op::RenameFile);
+    File* f = curr->entries.findFile(oldN);
+    if (!f) { 
         cout << "FILE NOT FOUND." << endl; 
-        return; 
+        return false; 
     }
-    if (curr->files.count(newN) || curr->subDirs.count(newN)) { 
+    if (!validName(newN)) {
+        cout << "INVALID NAME." << endl;
+        return false;
+    }
+    if (curr->entries.contains(newN)) { 
         cout << "NAME ALREADY EXISTS." << endl; 
-        return; 
+        return false; 
     }
-    curr->files[newN] = curr->files[oldN];
-    curr->files[newN]->name = newN;
-    curr->files.erase(oldN);
+    versions.preserve(curr);
+    curr->entries.erase(oldN);                                 // key is the name
+    nameIndex.remove(f);
+    f->name = newN;
+    curr->entries.insert(f);
+    nameIndex.add(f);
+    logOp(J_RENAME, {childPath(curr, oldN), newN});
     cout << "FILE RENAMED." << endl;
+    return true;
 }
 
-void FileSystem::writeFile(const string &name, bool append) {
-    if (!curr->files.count(name)) {
+bool FileSystem::writeFile(const string &name, bool append) {
+    if (!curr->entries.findFile(name)) {
         cout << "FILE NOT FOUND." << endl;
-        return;
+        return false;
     }
 
     cout << "ENTER CONTENT (END WITH 'EOF' ON NEW LINE):\n";
@@ -308,54 +593,155 @@ void FileSystem::writeFile(const string &name, bool append) {
         if (line == "EOF") break;
         content += line + "\n";
     }
+    return writeFile(name, content, append);
+}
 
+bool FileSystem::writeFile(const string &name, const string &content, bool append) {
+    OpTimer timer(Op::Write);
+    File* f = curr->entries.findFile(name);
+    if (!f) {
+        cout << "FILE NOT FOUND." << endl;
+        return false;
+    }
+    if (append && !Content::fits(f->content.size(), content.size())) {
+        cout << "FILE WOULD EXCEED THE 1 TB LIMIT." << endl;
+        return false;
+    }
+    versions.preserve(f);
+    Usage before = usageOf(f);
     if (append) {
-        curr->files[name]->content += content;
+        f->content.append(content);                            // detaches a shared buffer
     } else {
-        curr->files[name]->content = content;
+        f->content.assign(content);
     }
-    curr->files[name]->modifiedAt = getTimestamp();
+    compressIfLarge(f, append);
+    f->modifiedAt = now();
+    fileChanged(f, before);
+    logOp(append ? J_APPEND : J_WRITE, {childPath(curr, name), content, stampField(f->modifiedAt)});
     cout << "WRITE SUCCESSFUL." << endl;
+    return true;
 }
 
-void FileSystem::readFile(const string &name) {
-    if (!curr->files.count(name)) { 
+bool FileSystem::readFile(const string &name) {
+    OpTimer timer(Op::Read);
+    File* f = curr->entries.findFile(name);
+    if (!f) { 
         cout << "FILE NOT FOUND." << endl; 
-        return; 
+        return false; 
     }
-    cout << "\n----- FILE CONTENT -----\n" << curr->files[name]->content 
+    cout << "\n----- FILE CONTENT -----\n" << f->content 
             << "\n------------------------" << endl;
+    return true;
+}
+
+// pread-style: streams `length` bytes from `offset` straight out of the
+// extents, nothing else of the file is touched
+bool FileSystem::readFileRange(const string &name, uint64_t offset, uint64_t length) {
+    OpTimer timer(Op::Read);
+    File* f = curr->entries.findFile(name);
+    if (!f) {
+        cout << "FILE NOT FOUND." << endl;
+        return false;
+    }
+    if (offset > f->content.size()) {
+        cout << "OFFSET PAST END OF FILE." << endl;
+        return false;
+    }
+    f->content.forEachPiece(offset, length, [](const char* p, size_t n) {
+        cout.write(p, static_cast<streamsize>(n));
+    });
+    return true;
+}
+
+// pwrite-style: overwrites in place, extending past the end (the gap is a
+// hole that reads as zeros)
+bool FileSystem::writeFileAt(const string &name, uint64_t offset, const string &data) {
+    OpTimer timer(Op::Write);
+    File* f = curr->entries.findFile(name);
+    if (!f) {
+        cout << "FILE NOT FOUND." << endl;
+        return false;
+    }
+    if (!Content::fits(offset, data.size())) {
+        cout << "FILE WOULD EXCEED THE 1 TB LIMIT." << endl;
+        return false;
+    }
+    versions.preserve(f);
+    Usage before = usageOf(f);
+    f->content.write(offset, data.data(), data.size());
+    compressIfLarge(f, false);
+    f->modifiedAt = now();
+    fileChanged(f, before);
+    logOp(J_PWRITE, {childPath(curr, name), to_string(offset), data, stampField(f->modifiedAt)});
+    cout << "WRITE SUCCESSFUL." << endl;
+    return true;
+}
+
+bool FileSystem::truncateFile(const string &name, uint64_t size) {
+    OpTimer timer(Op::Truncate);
+    File* f = curr->entries.findFile(name);
+    if (!f) {
+        cout << "FILE NOT FOUND." << endl;
+        return false;
+    }
+    if (size > Content::MAX_SIZE) {
+        cout << "FILE WOULD EXCEED THE 1 TB LIMIT." << endl;
+        return false;
+    }
+    versions.preserve(f);
+    Usage before = usageOf(f);
+    f->content.truncate(size);
+    f->modifiedAt = now();
+    fileChanged(f, before);
+    logOp(J_TRUNCATE, {childPath(curr, name), to_string(size), stampField(f->modifiedAt)});
+    cout << "FILE TRUNCATED." << endl;
+    return true;
 }
 
-void FileSystem::fileMetadata(const string &name) {
-    if (!curr->files.count(name)) { 
+bool FileSystem::fileMetadata(const string &name) {
+    File *f = curr->entries.findFile(name);
+    if (!f) { 
         cout << "FILE NOT FOUND." << endl; 
-        return; 
+        return false; 
     }
-    File *f = curr->files[name];
-    cout << "NAME: " << f->name << "\nCREATED: " << f->createdAt << "\nMODIFIED: " << f->modifiedAt << endl;
+    cout << "NAME: " << f->name << "\nCREATED: " << formatTimestamp(f->createdAt)
+         << "\nMODIFIED: " << formatTimestamp(f->modifiedAt) << endl;
+    return true;
 }
 
 void FileSystem::directoryMetadata() {
     cout << "\n----- DIRECTORY INFO -----" << endl;
     cout << "NAME: " << curr->name << "\nPATH: "; printPath();
-    cout << "SUBDIRECTORIES: " << curr->subDirs.size() << endl;
-    cout << "FILES: " << curr->files.size() << endl;
+    cout << "SUBDIRECTORIES: " << curr->entries.dirCount() << endl;
+    cout << "FILES: " << curr->entries.fileCount() << endl;
+    Usage u = curr->usage.get();
+    cout << "TOTAL SIZE: " << u.bytes << " BYTES IN " << u.files << " FILES, " << u.dirs
+         << " SUBDIRECTORIES AT ALL LEVELS" << endl;
+    if (u.files) cout << "NEWEST FILE: " << formatTimestamp(u.newest) << endl;
     cout << "-------------------------" << endl;
 }
 
-void FileSystem::searchFiles(const string &pattern) {
+// Tree-wide search through the name index; prints full paths, sorted.
+// `limit` (0 = all) caps the matches, `scope` keeps only that subtree.
+void FileSystem::searchFiles(const string &pattern, NameMatch mode, size_t limit, Directory* scope) {
+    OpTimer timer(Op::Find);
     cout << "SEARCH RESULTS:" << endl;
-    bool found = false;
-    
-    for (auto& f : curr->files) {
-        if (f.first.find(pattern) != string::npos) {
-            cout << "  " << f.first << endl;
-            found = true;
+    if (scope == root) scope = nullptr;
+    vector<string> paths;
+    nameIndex.search(pattern, mode, [&](File* f) {
+        if (scope) {
+            Directory* d = f->parent;
+            while (d && d != scope) d = d->parent;
+            if (!d) return true;
         }
-    }
-    
-    if (!found) cout << "  (NO MATCHING FILES)" << endl;
+        paths.push_back(childPath(f->parent, f->name));
+        return !limit || paths.size() < limit;
+    });
+    if (!limit || paths.size() < limit)                        // the index only knows what was read
+        searchUnread(pattern, mode, limit, scope ? scope : root, paths);
+    sort(paths.begin(), paths.end());
+    for (const string& p : paths) cout << "  " << p << endl;
+    if (paths.empty()) cout << "  (NO MATCHING FILES)" << endl;
 }
 
 void FileSystem::batchCreateFiles() {
@@ -363,6 +749,8 @@ void FileSystem::batchCreateFiles() {
     string input;
     getline(cin, input);
     
+    Timestamp saved = pinnedStamp;
+    if (!pinnedStamp) pinnedStamp = coarseClock();             // one stamp per batch
     size_t pos = 0;
     while ((pos = input.find(',')) != string::npos) {
         string filename = input.substr(0, pos);
@@ -370,6 +758,7 @@ void FileSystem::batchCreateFiles() {
         input.erase(0, pos + 1);
     }
     if (!input.empty()) createFile(input);
+    pinnedStamp = saved;
 }
 
 void FileSystem::deleteAll() {
@@ -384,19 +773,22 @@ void FileSystem::deleteAll() {
         return;
     }
 
-    // Delete everything recursively starting from root
-    for (auto& dir : root->subDirs) {
-        delete dir.second;
-    }
-    for (auto& file : root->files) {
-        delete file.second;
-    }
-    root->subDirs.clear();
-    root->files.clear();
-    
+    clearAll();
     cout << "All files and directories deleted.\n";
 }
 
+void FileSystem::clearAll() {
+    // The old tree goes to the reclaimer whole; it walks and frees it
+    nameIndex.clear();
+    dcache.clear();
+    vector<Directory*> dirs;
+    vector<File*> files;
+    if (!versions.defer(dirs, files, root)) reclaimer.reclaimTree(root);
+    root = newDirectory("root", nullptr);
+    curr = root;
+    logOp(J_CLEAR, {});
+}
+
 void FileSystem::printPath() {
     vector<string> v; 
     Directory *t = curr;
@@ -410,103 +802,138 @@ void FileSystem::showHelp() {
             << "1. PATHS: Use numbers to navigate\n"
             << "2. FILES: Create before writing\n"
             << "3. CONTENT: Use 'EOF' to end input\n"
-            << "4. SEARCH: Partial names work\n"
+            << "4. SEARCH: Whole tree by name; contents below the current directory\n"
             << "5. BATCH: Create multiple files\n"
             << "===============\n";
 }
 
-void FileSystem::printTreeHelper(Directory* dir, int depth) {
-    for (int i = 0; i < depth; ++i) cout << "  ";
-    cout << "+ " << dir->name << "/" << endl;
-    for (const auto& filePair : dir->files) {
-        for (int i = 0; i < depth + 1; ++i) cout << "  ";
-        cout << "- " << filePair.first << endl;
-    }
-    for (const auto& subdirPair : dir->subDirs) {
-        printTreeHelper(subdirPair.second, depth + 1);
-    }
+void FileSystem::printTree() {
+    printTree(TreeView(root));
 }
 
-void FileSystem::printTree() {
-    cout << "\n===== FILE SYSTEM TREE =====" << endl;
-    printTreeHelper(root, 0);
-    cout << "===========================\n" << endl;
+// The whole tree in the indented text layout (treerender.cpp)
+void FileSystem::printTree(const TreeView& view) {
+    renderTree(view, view.root(), TreeRenderSpec(), cout);
 }
 
-void FileSystem::moveFile(const string& name, Directory* target) {
-    if (!curr->files.count(name)) {
+bool FileSystem::moveFile(const string& name, Directory* target) {
+    OpTimer timer(Op::MoveFile);
+    File* f = curr->entries.findFile(name);
+    if (!f) {
         cout << "FILE NOT FOUND." << endl;
-        return;
+        return false;
     }
-    if (target->files.count(name) || target->subDirs.count(name)) {
+    if (target->entries.contains(name)) {
         cout << "TARGET ALREADY HAS AN ITEM WITH THIS NAME." << endl;
-        return;
+        return false;
     }
-    target->files[name] = curr->files[name];
-    curr->files.erase(name);
+    versions.preserve(curr);
+    versions.preserve(target);
+    curr->entries.erase(name);
+    target->entries.insert(f);
+    f->parent = target;
+    Usage moved = usageOf(f);
+    removeUsage(curr, moved);
+    addUsage(target, moved);
+    logOp(J_MOVE, {childPath(curr, name), pathOf(target)});
     cout << "FILE MOVED." << endl;
+    return true;
 }
 
-void FileSystem::moveDirectory(const string& name, Directory* target) {
-    if (!curr->subDirs.count(name)) {
+bool FileSystem::moveDirectory(const string& name, Directory* target) {
+    OpTimer timer(Op::MoveDir);
+    Directory* d = curr->entries.findDir(name);
+    if (!d) {
         cout << "DIRECTORY NOT FOUND." << endl;
-        return;
+        return false;
     }
-    if (target->subDirs.count(name) || target->files.count(name)) {
+    if (target->entries.contains(name)) {
         cout << "TARGET ALREADY HAS AN ITEM WITH THIS NAME." << endl;
-        return;
+        return false;
+    }
+    for (Directory* t = target; t; t = t->parent) {
+        if (t == d) {
+            cout << "CANNOT MOVE A DIRECTORY INTO ITSELF." << endl;
+            return false;
+        }
     }
-    target->subDirs[name] = curr->subDirs[name];
-    curr->subDirs[name]->parent = target;
-    curr->subDirs.erase(name);
+    versions.preserve(curr);
+    versions.preserve(target);
+    curr->entries.erase(name);
+    d->parent = target;
+    target->entries.insert(d);
+    Usage moved = subtreeUsage(d);
+    removeUsage(curr, moved);
+    addUsage(target, moved);
+    logOp(J_MOVE, {childPath(curr, name), pathOf(target)});
     cout << "DIRECTORY MOVED." << endl;
+    return true;
 }
 
-void FileSystem::copyFile(const string& name, Directory* target) {
-    if (!curr->files.count(name)) {
+bool FileSystem::copyFile(const string& name, Directory* target) {
+    OpTimer timer(Op::CopyFile);
+    File* orig = curr->entries.findFile(name);
+    if (!orig) {
         cout << "FILE NOT FOUND." << endl;
-        return;
+        return false;
     }
-    if (target->files.count(name) || target->subDirs.count(name)) {
+    if (target->entries.contains(name)) {
         cout << "TARGET ALREADY HAS AN ITEM WITH THIS NAME." << endl;
-        return;
+        return false;
     }
-    File* orig = curr->files[name];
-    File* copy = new File(orig->name);
-    copy->content = orig->content;
-    copy->createdAt = getTimestamp();
-    copy->modifiedAt = copy->createdAt;
-    target->files[name] = copy;
+    Timestamp ts = now();
+    File* copy = newFile(target, orig->name, ts, ts);
+    copy->content = orig->content;                             // shares the buffer
+    addUsage(target, usageOf(copy));
+    logOp(J_COPY, {childPath(curr, name), pathOf(target), stampField(ts)});
     cout << "FILE COPIED." << endl;
+    return true;
 }
 
-void FileSystem::copyDirectoryHelper(Directory* orig, Directory* target) {
-    Directory* copy = new Directory(orig->name, target);
-    for (auto& f : orig->files) {
-        File* fcopy = new File(f.second->name);
-        fcopy->content = f.second->content;
-        fcopy->createdAt = getTimestamp();
-        fcopy->modifiedAt = fcopy->createdAt;
-        copy->files[f.first] = fcopy;
+// Copies `orig` into `target` level by level.  The copy is only linked
+// into `target` at the end, so copying a directory into its own subtree
+// never walks into the nodes it creates.
+void FileSystem::copyDirectoryHelper(Directory* orig, Directory* target, Timestamp ts) {
+    Directory* top = newDirectory(orig->name, target);
+    vector<pair<Directory*, Directory*>> work{{orig, top}};    // (source, copy)
+    while (!work.empty()) {
+        Directory* src = work.back().first;
+        Directory* copy = work.back().second;
+        work.pop_back();
+        Usage u = src->usage.get();                            // every copied file gets `ts`
+        copy->usage.set({u.bytes, u.files, u.dirs, u.files ? ts : 0});
+        copy->entries.reserve(src->entries.size());
+        src->entries.forEach(
+            [&](Directory* d) {
+                Directory* sub = newDirectory(d->name, copy);
+                copy->entries.insert(sub);
+                work.push_back({d, sub});
+            },
+            [&](File* f) {
+                newFile(copy, f->name, ts, ts)->content = f->content;
+            });
     }
-    for (auto& d : orig->subDirs) {
-        copyDirectoryHelper(d.second, copy);
-    }
-    target->subDirs[orig->name] = copy;
+    versions.preserve(target);
+    target->entries.insert(top);
+    addUsage(target, subtreeUsage(top));
 }
 
-void FileSystem::copyDirectory(const string& name, Directory* target) {
-    if (!curr->subDirs.count(name)) {
+bool FileSystem::copyDirectory(const string& name, Directory* target) {
+    OpTimer timer(Op::CopyDir);
+    Directory* orig = curr->entries.findDir(name);
+    if (!orig) {
         cout << "DIRECTORY NOT FOUND." << endl;
-        return;
+        return false;
     }
-    if (target->subDirs.count(name) || target->files.count(name)) {
+    if (target->entries.contains(name)) {
         cout << "TARGET ALREADY HAS AN ITEM WITH THIS NAME." << endl;
-        return;
+        return false;
     }
-    Directory* orig = curr->subDirs[name];
-    copyDirectoryHelper(orig, target);
+    Timestamp ts = pinnedStamp ? pinnedStamp : coarseClock();  // one stamp per copy
+    copyDirectoryHelper(orig, target, ts);
+    logOp(J_COPY, {childPath(curr, name), pathOf(target), stampField(ts)});
     cout << "DIRECTORY COPIED." << endl;
+    return true;
 }
 
 void FileSystem::mainMenu() {
@@ -548,26 +975,7 @@ void FileSystem::contentOps() {
         }
         cin.ignore(numeric_limits<streamsize>::max(), '\n');
         if (c == 1) changeDirectory();
-        else if (c == 2) {
-            // List directories and files with info
-            cout << "\nDIRECTORIES:" << endl;
-            int idx = 1;
-            for (auto& d : curr->subDirs) {
-                cout << "  " << idx++ << ". " << d.first
-                     << " [Subdirs: " << d.second->subDirs.size()
-                     << ", Files: " << d.second->files.size() << "]" << endl;
-            }
-            if (curr->subDirs.empty()) cout << "  (NO DIRECTORIES FOUND)" << endl;
-
-            cout << "\nFILES:" << endl;
-            idx = 1;
-            for (auto& f : curr->files) {
-                cout << "  " << idx++ << ". " << f.first
-                     << " [Created: " << f.second->createdAt
-                     << ", Modified: " << f.second->modifiedAt << "]" << endl;
-            }
-            if (curr->files.empty()) cout << "  (NO FILES FOUND)" << endl;
-        }
+        else if (c == 2) browseContents();                   // paged, see listing.cpp
         else if (c == 3) {
             cout << "CREATE (1) Directory or (2) File? ";
             int t; cin >> t; cin.ignore();
@@ -582,12 +990,12 @@ void FileSystem::contentOps() {
             cout << "DELETE (1) Directory or (2) File? ";
             int t; cin >> t; cin.ignore();
             if (t == 1) {
-                auto names = listAndNumber(curr->subDirs, curr->files, true);
-                string sel = chooseFromList(names, "SELECT DIR NUMBER TO DELETE: ");
+                listAndNumber(curr, true);
+                string sel = chooseFromList(curr, true, "SELECT DIR NUMBER TO DELETE: ");
                 if (!sel.empty()) deleteDirectoryByName(sel);
             } else if (t == 2) {
-                auto names = listAndNumber(curr->subDirs, curr->files, false);
-                string sel = chooseFromList(names, "SELECT FILE NUMBER TO DELETE: ");
+                listAndNumber(curr, false);
+                string sel = chooseFromList(curr, false, "SELECT FILE NUMBER TO DELETE: ");
                 if (!sel.empty()) deleteFileByName(sel);
             } else cout << "INVALID TYPE.\n";
         }
@@ -595,16 +1003,16 @@ void FileSystem::contentOps() {
             cout << "RENAME (1) Directory or (2) File? ";
             int t; cin >> t; cin.ignore();
             if (t == 1) {
-                auto names = listAndNumber(curr->subDirs, curr->files, true);
-                string oldN = chooseFromList(names, "SELECT DIR NUMBER TO RENAME: ");
+                listAndNumber(curr, true);
+                string oldN = chooseFromList(curr, true, "SELECT DIR NUMBER TO RENAME: ");
                 if (oldN.empty()) continue;
                 string newN;
                 cout << "ENTER NEW NAME: ";
                 getline(cin, newN);
                 renameDirectory(oldN, newN);
             } else if (t == 2) {
-                auto names = listAndNumber(curr->subDirs, curr->files, false);
-                string oldN = chooseFromList(names, "SELECT FILE NUMBER TO RENAME: ");
+                listAndNumber(curr, false);
+                string oldN = chooseFromList(curr, false, "SELECT FILE NUMBER TO RENAME: ");
                 if (oldN.empty()) continue;
                 string newN;
                 cout << "ENTER NEW NAME: ";
@@ -613,24 +1021,24 @@ void FileSystem::contentOps() {
             } else cout << "INVALID TYPE.\n";
         }
         else if (c == 6) {
-            auto names = listAndNumber(curr->subDirs, curr->files, false);
-            string sel = chooseFromList(names, "SELECT FILE TO EDIT: ");
+            listAndNumber(curr, false);
+            string sel = chooseFromList(curr, false, "SELECT FILE TO EDIT: ");
             if (sel.empty()) continue;
             cout << "EDIT MODE: (1) Overwrite, (2) Append? ";
             int mode; cin >> mode; cin.ignore();
             writeFile(sel, mode == 2);
         }
         else if (c == 7) {
-            auto names = listAndNumber(curr->subDirs, curr->files, false);
-            string sel = chooseFromList(names, "SELECT FILE TO READ: ");
+            listAndNumber(curr, false);
+            string sel = chooseFromList(curr, false, "SELECT FILE TO READ: ");
             if (!sel.empty()) readFile(sel);
         }
         else if (c == 8) {
             cout << "MOVE (1) Directory or (2) File? ";
             int t; cin >> t; cin.ignore();
             if (t == 1) {
-                auto names = listAndNumber(curr->subDirs, curr->files, true);
-                string sel = chooseFromList(names, "SELECT DIR NUMBER TO MOVE: ");
+                listAndNumber(curr, true);
+                string sel = chooseFromList(curr, true, "SELECT DIR NUMBER TO MOVE: ");
                 if (sel.empty()) continue;
                 cout << "ENTER TARGET PATH (e.g. path after root/): ";
                 string path; getline(cin, path);
@@ -638,8 +1046,8 @@ void FileSystem::contentOps() {
                 if (!target) { cout << "INVALID PATH.\n"; continue; }
                 moveDirectory(sel, target);
             } else if (t == 2) {
-                auto names = listAndNumber(curr->subDirs, curr->files, false);
-                string sel = chooseFromList(names, "SELECT FILE NUMBER TO MOVE: ");
+                listAndNumber(curr, false);
+                string sel = chooseFromList(curr, false, "SELECT FILE NUMBER TO MOVE: ");
                 if (sel.empty()) continue;
                 cout << "ENTER TARGET PATH (e.g. path after root/): ";
                 string path; getline(cin, path);
@@ -652,8 +1060,8 @@ void FileSystem::contentOps() {
             cout << "COPY (1) Directory or (2) File? ";
             int t; cin >> t; cin.ignore();
             if (t == 1) {
-                auto names = listAndNumber(curr->subDirs, curr->files, true);
-                string sel = chooseFromList(names, "SELECT DIR NUMBER TO COPY: ");
+                listAndNumber(curr, true);
+                string sel = chooseFromList(curr, true, "SELECT DIR NUMBER TO COPY: ");
                 if (sel.empty()) continue;
                 cout << "ENTER TARGET PATH (e.g. path after root/): ";
                 string path; getline(cin, path);
@@ -661,8 +1069,8 @@ void FileSystem::contentOps() {
                 if (!target) { cout << "INVALID PATH.\n"; continue; }
                 copyDirectory(sel, target);
             } else if (t == 2) {
-                auto names = listAndNumber(curr->subDirs, curr->files, false);
-                string sel = chooseFromList(names, "SELECT FILE NUMBER TO COPY: ");
+                listAndNumber(curr, false);
+                string sel = chooseFromList(curr, false, "SELECT FILE NUMBER TO COPY: ");
                 if (sel.empty()) continue;
                 cout << "ENTER TARGET PATH (path after root/): ";
                 string path; getline(cin, path);
@@ -678,8 +1086,11 @@ void FileSystem::contentOps() {
 
 void FileSystem::searchMenu() {
     cout << "\nSEARCH MENU:" << endl
-            << " 1. SEARCH FILES" << endl
-            << " 2. RETURN" << endl;
+            << " 1. SEARCH FILES (NAME CONTAINS)" << endl
+            << " 2. SEARCH BY PREFIX" << endl
+            << " 3. SEARCH EXACT NAME" << endl
+            << " 4. SEARCH FILE CONTENTS" << endl
+            << " 5. RETURN" << endl;
 }
 
 void FileSystem::batchMenu() {
@@ -707,7 +1118,7 @@ void FileSystem::start() {
         else if (ch == 5) deleteAll();
         else if (ch == 6) printTree();
         else if (ch == 7) {
-            saveToDisk("fs_data.txt");
+            if (!sync()) cout << "CHANGES COULD NOT BE WRITTEN." << endl;
             cout << "GOODBYE!" << endl; break; 
         }
         else cout << "INVALID." << endl;
@@ -722,18 +1133,25 @@ void FileSystem::searchOps() {
         if (!(cin >> s)) {
             cin.clear();
             cin.ignore(numeric_limits<streamsize>::max(), '\n');
-            cout << "INVALID INPUT. Please enter 1-2.\n";
+            cout << "INVALID INPUT. Please enter 1-5.\n";
             continue;
         }
         cin.ignore(numeric_limits<streamsize>::max(), '\n');
         
-        if (s == 1) {
+        if (s == 4) {
+            string pattern;
+            cout << "ENTER TEXT TO FIND: ";
+            getline(cin, pattern);
+            if (!grepContent(pattern, curr)) cout << "EMPTY PATTERN." << endl;
+        }
+        else if (s >= 1 && s <= 3) {
             string pattern;
             cout << "ENTER SEARCH PATTERN: ";
             getline(cin, pattern);
-            searchFiles(pattern);
+            searchFiles(pattern, s == 1 ? NameMatch::Substring
+                               : s == 2 ? NameMatch::Prefix : NameMatch::Exact);
         }
-        else if (s == 2) break;
+        else if (s == 5) break;
         else cout << "INVALID." << endl;
     }
 }
@@ -758,8 +1176,9 @@ void FileSystem::batchOps() {
 }
 
 void FileSystem::listContents(bool showDirectories) {
+    OpTimer timer(Op::List);
     if (showDirectories) {
-        listAndNumber(curr->subDirs, curr->files, true);
+        listAndNumber(curr, true);
     }
-    listAndNumber(curr->subDirs, curr->files, false);
+    listAndNumber(curr, false);
 }
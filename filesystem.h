@@ -7,60 +7,166 @@
 #include <queue>
 #include <fstream>
 #include <sstream>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <initializer_list>
+#include "pool.h"
+#include "rwlock.h"
+#include "dirtable.h"
+#include "timestamp.h"
+#include "content.h"
+#include "nameindex.h"
+#include "reclaim.h"
+#include "dcache.h"
+#include "mvcc.h"
+#include "usage.h"
+#include "listing.h"
+#include "treerender.h"
+#include "dedup.h"
+
+class Journal;
+class Directory;
+class LazySnapshot;
+struct SnapshotImage;
+struct TreeSpec;
+struct TreeStats;
+struct HostTransfer;
+struct QuerySpec;
+
+// Whether `name` can name a file or directory: not empty, "." or "..",
+// and without a path separator.  Host exports join names onto real paths.
+bool validName(const std::string& name);
 
 struct File {
     std::string name;
-    std::string content;
-    std::string createdAt;
-    std::string modifiedAt;
+    Content content;                           // shared with copies until written
+    Timestamp createdAt;                       // ns since the epoch
+    Timestamp modifiedAt;
+    Directory* parent = nullptr;
+    File* nameNext = nullptr;                  // NameIndex bookkeeping
+    File* namePrev = nullptr;
+    uint32_t indexId = NameIndex::NONE;
+    uint64_t mvccEpoch = 0;                    // see VersionStore
     File(const std::string& filename);
+    File(const std::string& filename, Timestamp created, Timestamp modified);
 };
 
 class Directory {
 public:
     std::string name;
     Directory* parent;
-    std::map<std::string, Directory*> subDirs;
-    std::map<std::string, File*> files;
+    EntryTable entries;                        // sub-directories and files
+    RwLock lock;                               // taken by the concurrent API only
+    DirUsage usage;                            // recursive totals, see usage.h
+    uint64_t mvccEpoch = 0;                    // see VersionStore
     Directory(const std::string& dirName, Directory* par = nullptr);
-    ~Directory();
 };
 
 class FileSystem {
 private:
+    friend class LazySnapshot;
+    friend class Bench;                        // fsbench drives the operations directly
+    // Snapshots still read on demand; declared first, so content that
+    // points into their mappings is gone before they are.  A checkpoint
+    // holds them too while it encodes.
+    std::vector<std::shared_ptr<LazySnapshot>> lazySnapshots;
+    // Node storage; children are released through detachTree, not ~Directory
+    NodePool<Directory> dirPool;
+    NodePool<File> filePool;
+    Reclaimer reclaimer{dirPool, filePool};    // frees large deletes off-thread
+    VersionStore versions{reclaimer};          // pinned views (mvcc.h)
     Directory* root;
     Directory* curr;
 
+    Directory* newDirectory(const std::string& name, Directory* parent);
+    NameIndex nameIndex;                       // every file, by name
+    std::recursive_mutex nodeMtx;              // pools + name index: concurrent API and lazy loads
+
+    // Creates a file inside `parent` (nullptr if the name is taken)
+    File* newFile(Directory* parent, const std::string& name, Timestamp created, Timestamp modified);
+    void freeFile(File* f);
+    void detachTree(Directory* dir);
+    Directory* ensureDir(const std::string& relPath);
+
     // ── Persistence ──────────────────────────────────────────────
-    void saveToDisk(const std::string& filename);
-    void loadFromDisk(const std::string& filename);
+    bool saveToDisk(const std::string& filename);
+    bool loadFromDisk(const std::string& filename);
+    bool exportText(const std::string& filename);
+    bool importText(const std::string& filename);
+    bool saveSnapshot(const std::string& filename);            // snapshot.cpp
+    SnapshotImage encodeSnapshot(const TreeView& view, uint64_t journalSeq);
+    bool loadSnapshot(const std::string& filename);
+    bool replaceWithSnapshot(const std::string& filename);      // the old tree stays on failure
+    void loadAll();                                             // reads every unread directory
+    void releaseSnapshots();                                    // unmaps those nothing points into
+    void searchUnread(const std::string& pattern, NameMatch mode, size_t limit, Directory* scope,
+                      std::vector<std::string>& paths);
+
+    std::string dataFile;
+    bool keepDataFile = false;                 // it did not load: never written
+    bool isDataFile(const std::string& filename);
+
+    // ── Journal (journal.cpp) ─────────────────────────────────────
+    std::unique_ptr<Journal> journal;
+    std::thread checkpointThread;
+    bool checkpointWritten = true;             // set by checkpointThread, read after the join
+    uint64_t snapshotSeq = 0;                  // last record in the snapshot
+    uint64_t checkpointBytes = 64u << 20;      // journal size that triggers one
+    bool replaying = false;
+    Timestamp pinnedStamp = 0;                 // nonzero: stamp for the bulk op / replayed record
+
+    void logOp(uint8_t op, std::initializer_list<std::string> fields);
+    void applyJournalRecord(uint8_t op, const std::vector<std::string>& fields);
+    void openJournal();
+    bool checkpoint();                         // false: this one or the last one failed
+    bool waitForCheckpoint();                  // whether the last one was written
+    bool sync();
+    Timestamp now();
 
     // ── Path helper ───────────────────────────────────────────────
+    DentryCache dcache;                        // path walks, see dcache.h
     Directory* navigateToPath(const std::string& relPath);
+    Directory* walkPath(Directory* from, const std::string& path);
+    Directory* resolveDir(const std::string& path);
+    Directory* resolveParent(const std::string& path, std::string& base);
+    std::string pathOf(Directory* dir);
+    std::string childPath(Directory* dir, const std::string& name);
+    // Every file below `dir`; in path order (sorted views) if `inPathOrder`
+    std::vector<File*> filesUnder(Directory* dir, bool inPathOrder = false);
 
     // ── Core operations ───────────────────────────────────────────
-    std::vector<std::string> listAndNumber(const std::map<std::string, Directory*>& dirs, const std::map<std::string, File*>& fls, bool showDirs = true);
-    std::string chooseFromList(const std::vector<std::string>& names, const std::string& prompt);
+    size_t listAndNumber(Directory* dir, bool showDirs = true);
+    std::string chooseFromList(Directory* dir, bool fromDirs, const std::string& prompt);
 
-    void makeDirectory(const std::string& name);
-    void deleteDirectoryByName(const std::string& name);
-    void renameDirectory(const std::string& oldN, const std::string& newN);
+    bool makeDirectory(const std::string& name);
+    bool deleteDirectoryByName(const std::string& name);
+    bool renameDirectory(const std::string& oldN, const std::string& newN);
     void changeDirectory();
-    void createFile(const std::string& name);
-    void deleteFileByName(const std::string& name);
-    void renameFile(const std::string& oldN, const std::string& newN);
-    void writeFile(const std::string& name, bool append);
-    void readFile(const std::string& name);
-    void fileMetadata(const std::string& name);
+    bool createFile(const std::string& name);
+    bool deleteFileByName(const std::string& name);
+    bool renameFile(const std::string& oldN, const std::string& newN);
+    bool writeFile(const std::string& name, bool append);
+    bool writeFile(const std::string& name, const std::string& content, bool append);
+    bool readFile(const std::string& name);
+    bool readFileRange(const std::string& name, uint64_t offset, uint64_t length);
+    bool writeFileAt(const std::string& name, uint64_t offset, const std::string& data);
+    bool truncateFile(const std::string& name, uint64_t size);
+    bool fileMetadata(const std::string& name);
     void directoryMetadata();
-    void searchFiles(const std::string& pattern);
+    void searchFiles(const std::string& pattern, NameMatch mode = NameMatch::Substring,
+                     size_t limit = 0, Directory* scope = nullptr);
+    bool runQuery(const QuerySpec& spec, Directory* scope);    // query.cpp
     void batchCreateFiles();
     void printPath();
     void showHelp();
     void listContents(bool showDirectories = true);
     void deleteAll();
+    void clearAll();
     void printTree();
-    void printTreeHelper(Directory* dir, int depth);
+    void printTree(const TreeView& view);
 
     // Menu handlers
     void searchOps();
@@ -72,14 +178,108 @@ private:
     void contentOps();
 
     // Move / copy helpers
-    void moveFile(const std::string& name, Directory* target);
-    void moveDirectory(const std::string& name, Directory* target);
-    void copyFile(const std::string& name, Directory* target);
-    void copyDirectory(const std::string& name, Directory* target);
-    void copyDirectoryHelper(Directory* orig, Directory* target);
+    bool moveFile(const std::string& name, Directory* target);
+    bool moveDirectory(const std::string& name, Directory* target);
+    bool copyFile(const std::string& name, Directory* target);
+    bool copyDirectory(const std::string& name, Directory* target);
+    void copyDirectoryHelper(Directory* orig, Directory* target, Timestamp ts);
+
+    // ── Content search (grep.cpp) ─────────────────────────────────
+    bool grepContent(const std::string& pattern, Directory* scope = nullptr,
+                     size_t limit = 0, unsigned threads = 0);   // 0 threads: one per core
+    bool grepBench(const std::string& pattern, Directory* scope = nullptr);
+
+    // ── Compression tier (lz.cpp) ─────────────────────────────────
+    uint64_t compressAbove = 0;                // files this large stay compressed, 0 = off
+    void compressIfLarge(File* f, bool appended);
+    bool compressFiles(Directory* scope, uint64_t minSize, uint64_t coldSeconds);
+    bool compressStats(Directory* scope);
+
+    // ── Block deduplication (dedup.cpp) ───────────────────────────
+    BlockStore blockStore;                     // fed by `dedup` runs only
+    bool dedupFiles(Directory* scope);
+    bool dedupStats(Directory* scope);
+
+    // ── Concurrent API (concurrent.cpp) ───────────────────────────
+    void checkpointIfDue();
+    static bool stressBench(unsigned maxThreads, uint64_t opsPerThread);
+
+    // ── Point-in-time views (mvcc.cpp) ────────────────────────────
+    std::map<uint64_t, TreeView> views;        // pinned by `snapshot`, by epoch
+    TreeView pinTree();
+    void searchView(const TreeView& view, const std::string& pattern, NameMatch mode, size_t limit);
+    bool snapshotCommand(const std::vector<std::string>& args);
+
+    // ── Metrics (metrics.cpp) ─────────────────────────────────────
+    std::string metricsFile;                   // written on exit when set
+    bool statsCommand(const std::vector<std::string>& args);
+    bool writeMetrics(const std::string& filename, bool json);
+
+    // ── Recursive usage (usage.cpp) ───────────────────────────────
+    Usage usageOf(const File* f) const;
+    Usage subtreeUsage(const Directory* d) const;              // d's totals plus d itself
+    Timestamp newestIn(const Directory* d) const;
+    void addUsage(Directory* at, const Usage& u);
+    void removeUsage(Directory* at, const Usage& u);
+    void dropNewest(Directory* at, Timestamp gone);
+    void fileChanged(File* f, const Usage& before);             // before: usageOf(f) then
+    void tallyUsage(Directory* top, std::vector<Directory*>& order, std::vector<Usage>& totals);
+    bool checkUsage(Directory* top);
+    bool duCommand(const std::vector<std::string>& args);
+    void listLong(Directory* dir);
+
+    // ── Paged listings (listing.cpp) ──────────────────────────────
+    std::string pagePath;                      // listing `page next` continues
+    ListCursor pageCursor;
+    size_t pageSize = 100;
+    void listPage(Directory* dir, ListCursor& cursor, size_t count, std::vector<ListEntry>& out);
+    bool printPage(Directory* dir, ListCursor& cursor, size_t count);
+    bool pageCommand(const std::vector<std::string>& args);
+    void browseContents();
+
+    // ── Tree dumps (treerender.cpp) ───────────────────────────────
+    uint64_t renderTree(const TreeView& view, Directory* top, const TreeRenderSpec& spec, std::ostream& out);
+    bool treeCommand(const std::vector<std::string>& args);
+    bool treeBench(Directory* scope);
+
+    // ── Tree generator (treegen.cpp) ──────────────────────────────
+    TreeStats generateTree(Directory* at, const TreeSpec& spec);
+
+    // ── Host directory trees (hostio.cpp) ─────────────────────────
+    bool importHost(const std::string& hostDir, Directory* at, unsigned threads, HostTransfer& stats);
+    bool exportHost(Directory* from, const std::string& hostDir, unsigned threads, HostTransfer& stats);
+
+    // ── Script mode (script.cpp) ──────────────────────────────────
+    bool runCommand(const std::vector<std::string>& args, std::istream& in);
 
 public:
-    FileSystem();
+    // An empty dataFile makes a scratch tree: nothing is loaded, journaled
+    // or saved on exit
+    explicit FileSystem(const std::string& dataFile = "fs_data.bin");
     ~FileSystem();
     void start();
+    int runScript(std::istream& in, bool verbose = false);
+    // Operation latencies and memory use are written to `filename` on
+    // exit: JSON for *.json, Prometheus text format otherwise
+    void dumpMetricsOnExit(const std::string& filename) { metricsFile = filename; }
+
+    // ── Concurrent API (concurrent.cpp) ───────────────────────────
+    // Path-based operations that may be called from many threads at once.
+    // Paths are absolute ("." and ".." are resolved lexically) and `curr`
+    // is never used.  Each call locks the directories on its path from the
+    // root down: shared on the way, exclusive on the one it modifies.  The
+    // cursor-based operations above take no locks and must not run while
+    // any of these are in flight.
+    bool mkdirPath(const std::string& path);
+    bool createPath(const std::string& path);
+    bool writePath(const std::string& path, const std::string& data, bool append = false);
+    bool readPath(const std::string& path, std::string& out);
+    bool listPath(const std::string& path, std::vector<std::string>& names);
+    bool removePath(const std::string& path);
+    bool rmdirPath(const std::string& path);
+    bool movePath(const std::string& path, const std::string& targetDir);
+    // Consistent view of the whole tree that other threads can read while
+    // it changes; a read locks the node's stripe (mvcc.h) only.  Waits
+    // only for the calls in flight to finish
+    TreeView pinView();
 };
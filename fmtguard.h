@@ -0,0 +1,41 @@
+#pragma once
+#include <iostream>
+#include <streambuf>
+
+// Puts back a stream's format flags and precision when it goes out of
+// scope, so a table printed with fixed / setprecision leaves the stream
+// as it found it on every return path.
+class FormatGuard {
+public:
+    explicit FormatGuard(std::ios_base& stream) : stream(stream), flags(stream.flags()), prec(stream.precision()) {}
+    ~FormatGuard() {
+        stream.flags(flags);
+        stream.precision(prec);
+    }
+    FormatGuard(const FormatGuard&) = delete;
+    FormatGuard& operator=(const FormatGuard&) = delete;
+
+private:
+    std::ios_base& stream;
+    std::ios_base::fmtflags flags;
+    std::streamsize prec;
+};
+
+// Sends cout to a sink that drops everything while it is in scope: the
+// operations report every step on cout, and script mode and the bench
+// keep stdout for their own output.  MuteCout(false) leaves cout alone.
+class MuteCout {
+public:
+    explicit MuteCout(bool on = true) { if (on) old = std::cout.rdbuf(&sink); }
+    ~MuteCout() { if (old) std::cout.rdbuf(old); }
+    MuteCout(const MuteCout&) = delete;
+    MuteCout& operator=(const MuteCout&) = delete;
+
+private:
+    struct NullBuf : std::streambuf {
+        int overflow(int c) override { return c; }
+        std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+    };
+    NullBuf sink;
+    std::streambuf* old = nullptr;
+};
@@ -0,0 +1,303 @@
+#include "filesystem.h"
+#include "grep.h"
+#include "metrics.h"
+#include "fmtguard.h"
+#include "parallel.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <string>
+#include <vector>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#define GREP_SSE2 1
+#if defined(__GNUC__)
+#define GREP_AVX2 1
+#endif
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+using namespace std;
+
+/*──────────────────────────  Scanners  ─────────────────────────*/
+namespace {
+    inline unsigned lowestBit(uint32_t mask) {
+#if defined(_MSC_VER)
+        unsigned long i;
+        _BitScanForward(&i, mask);
+        return static_cast<unsigned>(i);
+#else
+        return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+    }
+
+    // m >= 2 for every scanner below; single bytes go straight to memchr
+    const char* findScalar(const char* hay, size_t n, const char* needle, size_t m) {
+        const char* end = hay + n;
+        for (const char* p = hay; static_cast<size_t>(end - p) >= m; ++p) {
+            p = static_cast<const char*>(memchr(p, needle[0], end - p - m + 1));
+            if (!p) return nullptr;
+            if (memcmp(p + 1, needle + 1, m - 1) == 0) return p;
+        }
+        return nullptr;
+    }
+
+#ifdef GREP_SSE2
+    // A position is a candidate when both its first and its last byte
+    // match; the bytes in between are only compared for candidates.
+    const char* findSse2(const char* hay, size_t n, const char* needle, size_t m) {
+        const __m128i first = _mm_set1_epi8(needle[0]);
+        const __m128i last  = _mm_set1_epi8(needle[m - 1]);
+        size_t i = 0;
+        for (; i + m - 1 + 16 <= n; i += 16) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hay + i));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hay + i + m - 1));
+            uint32_t mask = static_cast<uint32_t>(
+                _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last))));
+            for (; mask; mask &= mask - 1) {
+                size_t at = i + lowestBit(mask);
+                if (memcmp(hay + at + 1, needle + 1, m - 2) == 0) return hay + at;
+            }
+        }
+        return findScalar(hay + i, n - i, needle, m);
+    }
+#endif
+
+#ifdef GREP_AVX2
+    __attribute__((target("avx2")))
+    const char* findAvx2(const char* hay, size_t n, const char* needle, size_t m) {
+        const __m256i first = _mm256_set1_epi8(needle[0]);
+        const __m256i last  = _mm256_set1_epi8(needle[m - 1]);
+        size_t i = 0;
+        for (; i + m - 1 + 32 <= n; i += 32) {
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(hay + i));
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(hay + i + m - 1));
+            uint32_t mask = static_cast<uint32_t>(
+                _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last))));
+            for (; mask; mask &= mask - 1) {
+                size_t at = i + lowestBit(mask);
+                if (memcmp(hay + at + 1, needle + 1, m - 2) == 0) return hay + at;
+            }
+        }
+        return findSse2(hay + i, n - i, needle, m);
+    }
+#endif
+
+    using Finder = const char* (*)(const char*, size_t, const char*, size_t);
+    struct Scanner { Finder find; const char* name; };
+
+    const Scanner& scanner() {
+        static const Scanner s = [] {
+#ifdef GREP_AVX2
+            if (__builtin_cpu_supports("avx2")) return Scanner{findAvx2, "avx2"};
+#endif
+#ifdef GREP_SSE2
+            return Scanner{findSse2, "sse2"};
+#else
+            return Scanner{findScalar, "scalar"};
+#endif
+        }();
+        return s;
+    }
+}
+
+const char* scannerName() { return scanner().name; }
+
+const char* findBytes(const char* hay, size_t n, const char* needle, size_t m) {
+    if (m == 0 || m > n) return m == 0 ? hay : nullptr;
+    if (m == 1) return static_cast<const char*>(memchr(hay, needle[0], n));
+    return scanner().find(hay, n, needle, m);
+}
+
+void scanContent(const Content& c, uint64_t begin, uint64_t end,
+                 const string& needle, vector<uint64_t>& out, size_t cap) {
+    size_t m = needle.size();
+    end = min(end, c.size());
+    if (!m || begin >= end) return;
+    const char* nd = needle.data();
+    string carry;                          // last m-1 bytes before the piece
+    uint64_t pos = begin;                  // offset of the current piece
+    bool done = false;
+    auto hit = [&](uint64_t at) {
+        if (at >= end) done = true;        // only the look-ahead is left
+        else out.push_back(at);
+        if (cap && out.size() >= cap) done = true;
+    };
+    c.forEachPiece(begin, end - begin + m - 1, [&](const char* p, size_t n) {
+        if (done) return;
+        if (!carry.empty()) {              // matches straddling the boundary
+            string buf = carry;
+            buf.append(p, min(n, m - 1));
+            for (const char* q = buf.data(); !done; ++q) {
+                size_t left = buf.data() + buf.size() - q;
+                q = findBytes(q, left, nd, m);
+                if (!q || static_cast<size_t>(q - buf.data()) >= carry.size()) break;
+                hit(pos - carry.size() + (q - buf.data()));
+            }
+        }
+        for (const char* q = p; !done; ++q) {
+            q = findBytes(q, p + n - q, nd, m);
+            if (!q) break;
+            hit(pos + (q - p));
+        }
+        if (n >= m - 1) carry.assign(p + n - (m - 1), m - 1);
+        else {
+            carry.append(p, n);
+            if (carry.size() > m - 1) carry.erase(0, carry.size() - (m - 1));
+        }
+        pos += n;
+    });
+}
+
+/*──────────────────────────  Work plan  ────────────────────────*/
+// Files are cut into tasks of at most GRAIN bytes, and consecutive small
+// tasks are grouped into units of about GRAIN bytes.  Workers claim whole
+// units; the caller consumes them strictly in order, so the output is
+// the same for any number of threads.
+namespace {
+    constexpr uint64_t GRAIN = 1u << 20;
+    constexpr size_t UNIT_TASKS = 4096;
+
+    struct GrepTask {
+        const File* file;
+        uint64_t begin, end;
+        vector<uint64_t> hits;
+    };
+
+    struct GrepPlan {
+        vector<GrepTask> tasks;
+        vector<size_t> unitStart{0};       // unit u = tasks[unitStart[u], unitStart[u+1])
+        uint64_t bytes = 0;
+        size_t units() const { return unitStart.size() - 1; }
+    };
+
+    GrepPlan planGrep(const vector<File*>& files) {
+        GrepPlan plan;
+        uint64_t unitBytes = 0;
+        auto closeUnit = [&] {
+            if (plan.tasks.size() > plan.unitStart.back()) plan.unitStart.push_back(plan.tasks.size());
+            unitBytes = 0;
+        };
+        for (const File* f : files) {
+            uint64_t size = f->content.size();
+            if (!size) continue;
+            plan.bytes += size;
+            if (size > GRAIN) {                                // slices stand alone
+                closeUnit();
+                for (uint64_t off = 0; off < size; off += GRAIN) {
+                    plan.tasks.push_back({f, off, min(size, off + GRAIN), {}});
+                    closeUnit();
+                }
+                continue;
+            }
+            plan.tasks.push_back({f, 0, size, {}});
+            unitBytes += size;
+            if (unitBytes >= GRAIN || plan.tasks.size() - plan.unitStart.back() >= UNIT_TASKS) closeUnit();
+        }
+        closeUnit();
+        return plan;
+    }
+
+    // Scans the plan on `threads` workers.  `ready(u)` runs on the calling
+    // thread for each unit in order as soon as it is done; returning false
+    // stops the search.  `cap` (0 = none) bounds the hits of one task.
+    void runGrep(GrepPlan& plan, const string& needle, unsigned threads, size_t cap,
+                 const function<bool(size_t)>& ready) {
+        runOrdered(plan.units(), threads, [&](size_t u) {
+            for (size_t t = plan.unitStart[u]; t < plan.unitStart[u + 1]; ++t) {
+                GrepTask& task = plan.tasks[t];
+                scanContent(task.file->content, task.begin, task.end, needle, task.hits, cap);
+            }
+        }, ready);
+    }
+}
+
+/*────────────────────────  Content search  ─────────────────────*/
+// Prints PATH:OFFSET for every occurrence of `pattern` in the contents
+// of the files below `scope`, in path and offset order, while the
+// workers are still scanning.  `limit` (0 = all) caps the matches.
+bool FileSystem::grepContent(const string& pattern, Directory* scope, size_t limit, unsigned threads) {
+    OpTimer timer(Op::Grep);
+    if (pattern.empty()) return false;
+    vector<File*> files = filesUnder(scope ? scope : root, true);
+    GrepPlan plan = planGrep(files);
+
+    cout << "CONTENT MATCHES:" << endl;
+    size_t matches = 0, inFiles = 0;
+    const File* lastFile = nullptr;
+    string path;
+    runGrep(plan, pattern, threads ? threads : defaultThreads(), limit, [&](size_t u) {
+        for (size_t t = plan.unitStart[u]; t < plan.unitStart[u + 1]; ++t) {
+            GrepTask& task = plan.tasks[t];
+            if (task.hits.empty()) continue;
+            if (task.file != lastFile) {
+                lastFile = task.file;
+                path = childPath(task.file->parent, task.file->name);
+                ++inFiles;
+            }
+            for (uint64_t off : task.hits) {
+                cout << "  " << path << ':' << off << '\n';
+                if (++matches == limit) return false;
+            }
+            vector<uint64_t>().swap(task.hits);
+        }
+        return true;
+    });
+    if (!matches) cout << "  (NO MATCHES)" << endl;
+    else cout << matches << " MATCH(ES) IN " << inFiles << " FILE(S)" << endl;
+    return true;
+}
+
+// Times the same search as a naive std::string::find loop over each
+// file's materialized content, then with the vectorized scanner on 1, 2,
+// 4, ... threads up to the core count, and checks that they all agree.
+bool FileSystem::grepBench(const string& pattern, Directory* scope) {
+    if (pattern.empty()) return false;
+    vector<File*> files = filesUnder(scope ? scope : root, true);
+    GrepPlan plan = planGrep(files);
+    double mb = plan.bytes / 1e6;
+
+    using Clock = chrono::steady_clock;
+    auto ms = [](Clock::time_point a, Clock::time_point b) {
+        return chrono::duration<double, milli>(b - a).count();
+    };
+
+    FormatGuard format(cout);
+    cout << "GREP BENCHMARK: \"" << pattern << "\" OVER " << files.size() << " FILE(S), "
+         << fixed << setprecision(1) << mb << " MB, SCANNER " << scannerName() << '\n'
+         << left << setw(10) << "MODE" << right << setw(8) << "THREADS" << setw(12) << "MS"
+         << setw(12) << "MB/S" << setw(10) << "SPEEDUP" << setw(12) << "MATCHES" << '\n';
+
+    auto t0 = Clock::now();
+    size_t naive = 0;
+    for (const File* f : files) {
+        string s = f->content.read(0, f->content.size());
+        for (size_t p = s.find(pattern); p != string::npos; p = s.find(pattern, p + 1)) ++naive;
+    }
+    double base = ms(t0, Clock::now());
+    auto row = [&](const char* mode, unsigned threads, double t, size_t n) {
+        cout << left << setw(10) << mode << right << setw(8) << threads
+             << setw(12) << setprecision(2) << t
+             << setw(12) << setprecision(0) << (t > 0 ? mb / (t / 1000) : 0.0)
+             << setw(10) << setprecision(2) << (t > 0 ? base / t : 0.0)
+             << setw(12) << n << (n == naive ? "" : "  MISMATCH") << '\n';
+    };
+    row("naive", 1, base, naive);
+
+    unsigned maxThreads = defaultThreads();
+    for (unsigned threads = 1;; threads = min(threads * 2, maxThreads)) {
+        for (GrepTask& task : plan.tasks) vector<uint64_t>().swap(task.hits);
+        size_t found = 0;
+        auto t1 = Clock::now();
+        runGrep(plan, pattern, threads, 0, [&](size_t u) {
+            for (size_t t = plan.unitStart[u]; t < plan.unitStart[u + 1]; ++t) found += plan.tasks[t].hits.size();
+            return true;
+        });
+        row("simd", threads, ms(t1, Clock::now()), found);
+        if (threads == maxThreads) break;
+    }
+    return true;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class Content;
+
+// Substring scanning for content search.
+//
+// findBytes filters candidate positions 16 or 32 at a time by comparing
+// the needle's first and last byte against the haystack (SSE2, or AVX2
+// when the CPU has it), and only compares the bytes in between for the
+// candidates that survive.  Other targets fall back to memchr + memcmp.
+const char* findBytes(const char* hay, size_t n, const char* needle, size_t m);
+
+// Appends the offset of every match starting in [begin, end) of `c`.
+// The scan reads up to needle.size() - 1 bytes past `end` so that ranges
+// can be searched independently, and matches across extent boundaries
+// are found as well.  Stops early once `out` holds `cap` offsets (0 = no
+// cap).
+void scanContent(const Content& c, uint64_t begin, uint64_t end,
+                 const std::string& needle, std::vector<uint64_t>& out, size_t cap = 0);
+
+// Name of the scanner findBytes dispatches to ("avx2", "sse2", "scalar")
+const char* scannerName();
@@ -0,0 +1,400 @@
+#include "filesystem.h"
+#include "hostio.h"
+#include "snapshot.h"
+#include "metrics.h"
+#include "parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
+#include <string>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+using namespace std;
+
+string HostTransfer::report(const char* verb) const {
+    ostringstream out;
+    out << verb << ' ' << files << " FILES AND " << dirs << " DIRECTORIES (" << fixed << setprecision(1)
+        << bytes / 1e6 << " MB) IN " << setprecision(2) << seconds << " s: " << setprecision(1)
+        << (seconds > 0 ? bytes / 1e6 / seconds : 0.0) << " MB/s, " << setprecision(0)
+        << (seconds > 0 ? files / seconds : 0.0) << " FILES/s, " << threads << " THREADS";
+    if (skipped) out << ", " << skipped << " SKIPPED (NAME TAKEN)";
+    if (failed) out << ", " << failed << " FAILED";
+    return out.str();
+}
+
+/*────────────────────────  Host files  ─────────────────────────*/
+namespace {
+    constexpr uint64_t BATCH_BYTES = 8u << 20;
+    constexpr size_t BATCH_FILES = 1024;
+    constexpr uint64_t MAP_ABOVE = 1u << 20;                   // larger files are mapped, not read
+
+#ifdef _WIN32
+    // file_clock has no conversion to system_clock before C++20
+    Timestamp fromFileTime(std::filesystem::file_time_type t) {
+        auto sys = chrono::system_clock::now() + chrono::duration_cast<chrono::system_clock::duration>(
+                       t - std::filesystem::file_time_type::clock::now());
+        return chrono::duration_cast<chrono::nanoseconds>(sys.time_since_epoch()).count();
+    }
+    std::filesystem::file_time_type toFileTime(Timestamp t) {
+        auto sys = chrono::system_clock::time_point(chrono::duration_cast<chrono::system_clock::duration>(chrono::nanoseconds(t)));
+        return std::filesystem::file_time_type::clock::now()
+             + chrono::duration_cast<std::filesystem::file_time_type::duration>(sys - chrono::system_clock::now());
+    }
+#endif
+
+    // Size and modification time of a regular file (links not followed);
+    // false for anything else
+    bool statHostFile(const string& path, uint64_t& size, Timestamp& modified) {
+#ifndef _WIN32
+        struct stat st;
+        if (lstat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) return false;
+        size = static_cast<uint64_t>(st.st_size);
+#ifdef __APPLE__
+        const timespec& t = st.st_mtimespec;
+#else
+        const timespec& t = st.st_mtim;
+#endif
+        modified = static_cast<Timestamp>(t.tv_sec) * 1000000000 + t.tv_nsec;
+        return true;
+#else
+        error_code ec;
+        if (!std::filesystem::is_regular_file(std::filesystem::symlink_status(path, ec))) return false;
+        size = std::filesystem::file_size(path, ec);
+        auto t = std::filesystem::last_write_time(path, ec);
+        if (ec) return false;
+        modified = fromFileTime(t);
+        return true;
+#endif
+    }
+
+    // Whole file into `out`: small files through a per-thread buffer,
+    // large ones copied from a mapping straight into their chunks
+    bool readHostFile(const string& path, uint64_t size, Content& out) {
+        if (size >= MAP_ABOVE) {
+            MappedFile map(path);
+            if (!map.ok()) return false;
+            out.assign(map.data(), map.size());
+            return true;
+        }
+        thread_local string buffer;
+        if (buffer.size() < MAP_ABOVE) buffer.resize(MAP_ABOVE);
+        size_t n = 0;
+#ifndef _WIN32
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        for (;;) {                                             // until EOF: the file may have grown
+            if (n == buffer.size()) buffer.resize(buffer.size() * 2);
+            ssize_t got = read(fd, &buffer[n], buffer.size() - n);
+            if (got < 0) {
+                if (errno == EINTR) continue;
+                close(fd);
+                return false;
+            }
+            if (got == 0) break;
+            n += static_cast<size_t>(got);
+        }
+        close(fd);
+#else
+        ifstream in(path, ios::binary);
+        if (!in) return false;
+        while (in) {
+            if (n == buffer.size()) buffer.resize(buffer.size() * 2);
+            in.read(&buffer[n], static_cast<streamsize>(buffer.size() - n));
+            n += static_cast<size_t>(in.gcount());
+        }
+        if (in.bad()) return false;
+#endif
+        out.assign(buffer.data(), n);
+        return true;
+    }
+
+    // Writes `c` piece by piece (a compressed chunk is decoded into the
+    // per-thread buffer) and gives the file `modified` as its time.  A
+    // symbolic link already at `path` is not followed: the write fails
+    bool writeHostFile(const string& path, const Content& c, Timestamp modified) {
+#ifndef _WIN32
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW, 0644);
+        if (fd < 0) return false;
+        bool ok = true;
+        c.forEachPiece([&](const char* p, size_t n) {
+            while (ok && n) {
+                ssize_t put = write(fd, p, n);
+                if (put < 0) {
+                    if (errno != EINTR) ok = false;
+                    continue;
+                }
+                p += put;
+                n -= static_cast<size_t>(put);
+            }
+        });
+        timespec times[2];
+        times[0].tv_sec = 0;
+        times[0].tv_nsec = UTIME_OMIT;                         // access time: leave it
+        times[1].tv_sec = static_cast<time_t>(modified / 1000000000);
+        times[1].tv_nsec = static_cast<long>(modified % 1000000000);
+        if (times[1].tv_nsec < 0) {
+            times[1].tv_sec -= 1;
+            times[1].tv_nsec += 1000000000;
+        }
+        ok = ok && futimens(fd, times) == 0;
+        ok = (close(fd) == 0) && ok;
+        return ok;
+#else
+        error_code ec;
+        if (std::filesystem::is_symlink(std::filesystem::symlink_status(path, ec))) return false;
+        {
+            ofstream out(path, ios::binary | ios::trunc);
+            if (!out) return false;
+            c.forEachPiece([&](const char* p, size_t n) { out.write(p, static_cast<streamsize>(n)); });
+            if (!out.flush()) return false;
+        }
+        std::filesystem::last_write_time(path, toFileTime(modified), ec);
+        return !ec;
+#endif
+    }
+
+    // fn(i) for i < count on up to `threads` threads
+    void runParallel(size_t count, unsigned threads, const function<void(size_t)>& fn) {
+        threads = max(1u, min<unsigned>(threads, static_cast<unsigned>(min<size_t>(count, 1u << 16))));
+        atomic<size_t> next{0};
+        auto worker = [&] {
+            for (size_t i; (i = next.fetch_add(1)) < count;) fn(i);
+        };
+        vector<thread> pool;
+        for (unsigned t = 1; t < threads; ++t) pool.emplace_back(worker);
+        worker();
+        for (thread& t : pool) t.join();
+    }
+
+    // Cuts items 0 .. count-1 into runs of about BATCH_BYTES (or
+    // BATCH_FILES items); batch b is [start[b], start[b + 1])
+    template <class SizeOf>
+    vector<size_t> planBatches(size_t count, SizeOf sizeOf) {
+        vector<size_t> start{0};
+        uint64_t bytes = 0;
+        for (size_t i = 0; i < count; ++i) {
+            bytes += sizeOf(i);
+            if (bytes >= BATCH_BYTES || i + 1 - start.back() >= BATCH_FILES) {
+                start.push_back(i + 1);
+                bytes = 0;
+            }
+        }
+        if (start.back() != count) start.push_back(count);
+        return start;
+    }
+
+    struct HostEntry {
+        string name;
+        uint64_t size;
+        Timestamp modified;
+    };
+
+    struct HostDir {
+        string path;                                           // on the host
+        size_t parent = 0;                                     // index; 0 is the top
+        string name;
+        Directory* node = nullptr;                             // where it goes, nullptr: skipped
+        vector<string> subdirs;                                // sorted, until queued
+        vector<HostEntry> files;                               // sorted
+        bool listed = false;
+    };
+
+    // Subdirectories and regular files of one host directory
+    void listHostDir(HostDir& d) {
+        error_code ec;
+        std::filesystem::directory_iterator it(d.path, ec), end;
+        if (ec) return;
+        for (; it != end; it.increment(ec)) {
+            if (ec) return;
+            string name = it->path().filename().string();
+            string path = d.path + "/" + name;
+            std::filesystem::file_status st = it->symlink_status(ec);
+            if (ec) continue;
+            if (std::filesystem::is_directory(st)) {
+                d.subdirs.push_back(move(name));
+                continue;
+            }
+            HostEntry e{move(name), 0, 0};
+            if (statHostFile(path, e.size, e.modified)) d.files.push_back(move(e));
+        }
+        sort(d.subdirs.begin(), d.subdirs.end());
+        sort(d.files.begin(), d.files.end(), [](const HostEntry& a, const HostEntry& b) { return a.name < b.name; });
+        d.listed = true;
+    }
+}
+
+/*────────────────────────  Host import  ────────────────────────*/
+// Copies everything below the host directory `hostDir` into `at`.
+// Existing directories are merged into, files whose name is taken are
+// skipped.  Nodes are made directly, so the caller checkpoints afterwards.
+bool FileSystem::importHost(const string& hostDir, Directory* at, unsigned threads, HostTransfer& stats) {
+    OpTimer timer(Op::HostImport);
+    auto t0 = chrono::steady_clock::now();
+    stats = HostTransfer();
+    stats.threads = threads = threads ? threads : defaultThreads();
+    error_code ec;
+    if (!std::filesystem::is_directory(hostDir, ec)) return false;
+
+    // ── List one level at a time, its directories in parallel ──
+    vector<HostDir> dirs(1);
+    dirs[0].path = hostDir;
+    for (size_t begin = 0; begin < dirs.size();) {
+        size_t end = dirs.size();
+        runParallel(end - begin, threads, [&](size_t i) { listHostDir(dirs[begin + i]); });
+        for (size_t i = begin; i < end; ++i) {
+            if (!dirs[i].listed) stats.failed++;
+            vector<string> subdirs = move(dirs[i].subdirs);
+            for (string& name : subdirs) {
+                HostDir d;
+                d.path = dirs[i].path + "/" + name;
+                d.parent = i;
+                d.name = move(name);
+                dirs.push_back(move(d));
+            }
+        }
+        begin = end;
+    }
+
+    // ── Directories, parents first ──
+    struct Pending {
+        Directory* dir;
+        const HostEntry* entry;
+        string path;
+        Content content;
+        bool ok;
+    };
+    vector<Pending> files;
+    dirs[0].node = at;
+    for (size_t i = 0; i < dirs.size(); ++i) {
+        HostDir& d = dirs[i];
+        if (i) {
+            Directory* parent = dirs[d.parent].node;
+            if (!parent) continue;
+            d.node = parent->entries.findDir(d.name);
+            if (!d.node) {
+                if (parent->entries.contains(d.name)) {        // a file has the name
+                    stats.skipped++;
+                    continue;
+                }
+                d.node = newDirectory(d.name, parent);
+                versions.preserve(parent);
+                parent->entries.insert(d.node);
+                addUsage(parent, {0, 0, 1, 0});
+                stats.dirs++;
+            }
+        }
+        for (const HostEntry& e : d.files) {
+            if (d.node->entries.contains(e.name)) stats.skipped++;
+            else files.push_back({d.node, &e, d.path + "/" + e.name, Content(), false});
+        }
+    }
+
+    // ── Files: read in batches by the workers, linked here in order ──
+    vector<size_t> start = planBatches(files.size(), [&](size_t i) { return files[i].entry->size; });
+    runOrdered(start.size() - 1, threads,
+        [&](size_t b) {
+            for (size_t i = start[b]; i < start[b + 1]; ++i)
+                files[i].ok = readHostFile(files[i].path, files[i].entry->size, files[i].content);
+        },
+        [&](size_t b) {
+            for (size_t i = start[b]; i < start[b + 1]; ++i) {
+                Pending& p = files[i];
+                if (!p.ok) {
+                    stats.failed++;
+                    continue;
+                }
+                File* f = newFile(p.dir, p.entry->name, p.entry->modified, p.entry->modified);
+                if (!f) {
+                    stats.skipped++;
+                    continue;
+                }
+                f->content = move(p.content);
+                compressIfLarge(f, false);
+                addUsage(p.dir, usageOf(f));
+                stats.files++;
+                stats.bytes += f->content.size();
+            }
+            return true;
+        });
+    stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    return true;
+}
+
+/*────────────────────────  Host export  ────────────────────────*/
+// Writes everything below `from` into the host directory `hostDir`,
+// creating it if needed; existing host files of the same name are
+// overwritten
+bool FileSystem::exportHost(Directory* from, const string& hostDir, unsigned threads, HostTransfer& stats) {
+    OpTimer timer(Op::HostExport);
+    auto t0 = chrono::steady_clock::now();
+    stats = HostTransfer();
+    stats.threads = threads = threads ? threads : defaultThreads();
+    error_code ec;
+    std::filesystem::create_directories(hostDir, ec);
+    if (!std::filesystem::is_directory(hostDir, ec)) return false;
+
+    // ── Directories, made here; files collected ──
+    struct Pending {
+        const File* file;
+        string path;
+        bool ok;
+    };
+    vector<Pending> files;
+    vector<pair<Directory*, string>> dirs{{from, hostDir}};
+    for (size_t i = 0; i < dirs.size(); ++i) {
+        Directory* d = dirs[i].first;
+        string path = dirs[i].second;
+        for (Directory* sub : d->entries.sortedDirs()) {
+            if (!validName(sub->name)) {                       // would leave hostDir
+                stats.failed++;
+                continue;
+            }
+            string child = path + "/" + sub->name;
+            // An existing entry is used only if it is a real directory: a
+            // link to one would take the export outside hostDir
+            std::filesystem::file_status st = std::filesystem::symlink_status(child, ec);
+            bool usable = std::filesystem::exists(st) ? std::filesystem::is_directory(st)
+                                                      : std::filesystem::create_directory(child, ec);
+            if (!usable) {
+                stats.failed++;
+                continue;
+            }
+            stats.dirs++;
+            dirs.push_back({sub, move(child)});
+        }
+        for (const File* f : d->entries.sortedFiles()) {
+            if (validName(f->name)) files.push_back({f, path + "/" + f->name, false});
+            else stats.failed++;
+        }
+    }
+
+    // ── Files, written in batches by the workers ──
+    vector<size_t> start = planBatches(files.size(), [&](size_t i) { return files[i].file->content.size(); });
+    runOrdered(start.size() - 1, threads,
+        [&](size_t b) {
+            for (size_t i = start[b]; i < start[b + 1]; ++i)
+                files[i].ok = writeHostFile(files[i].path, files[i].file->content, files[i].file->modifiedAt);
+        },
+        [&](size_t b) {
+            for (size_t i = start[b]; i < start[b + 1]; ++i) {
+                if (!files[i].ok) {
+                    stats.failed++;
+                    continue;
+                }
+                stats.files++;
+                stats.bytes += files[i].file->content.size();
+            }
+            return true;
+        });
+    stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    return true;
+}
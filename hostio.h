@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// Mirroring real directory trees into the simulator and back
+// (`hostimport`, `hostexport`).
+//
+// Both directions run in three steps.  The directories are listed (on
+// import one level at a time, every directory of a level in parallel),
+// the directories are made on the calling thread, and the files are cut
+// into batches of about BATCH_BYTES that worker threads read or write.
+// On import the calling thread links each batch into the tree, in order,
+// as soon as it is read, so the tree grows while later batches are still
+// being read.  Small files are read with read(2) into a per-worker
+// buffer, large ones are mapped and copied straight into their chunks;
+// export writes every chunk from where it is, with no whole-file copy.
+// File times survive the round trip (the host's modification time is
+// used as both times on import).  Symbolic links and special files are
+// skipped.
+
+struct HostTransfer {
+    uint64_t dirs = 0, files = 0, bytes = 0;
+    uint64_t skipped = 0;                      // name already taken
+    uint64_t failed = 0;                       // could not be read / written
+    unsigned threads = 0;
+    double seconds = 0;
+
+    // "IMPORTED 10 FILES AND 2 DIRECTORIES (1.0 MB) IN ..."
+    std::string report(const char* verb) const;
+};
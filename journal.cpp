@@ -0,0 +1,398 @@
+#include "filesystem.h"
+#include "journal.h"
+#include "snapshot.h"
+#include "metrics.h"
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+using namespace std;
+
+namespace {
+    uint32_t checksum(const char* p, size_t n) {                // FNV-1a
+        uint32_t h = 2166136261u;
+        for (size_t i = 0; i < n; ++i) {
+            h ^= static_cast<unsigned char>(p[i]);
+            h *= 16777619u;
+        }
+        return h;
+    }
+
+    template <class T>
+    void putRaw(string& buf, T v) {
+        buf.append(reinterpret_cast<const char*>(&v), sizeof(v));
+    }
+
+    template <class T>
+    bool getRaw(const char*& p, const char* end, T& v) {
+        if (static_cast<size_t>(end - p) < sizeof(v)) return false;
+        memcpy(&v, p, sizeof(v));
+        p += sizeof(v);
+        return true;
+    }
+
+    constexpr auto FLUSH_INTERVAL = chrono::milliseconds(5);
+    constexpr size_t FLUSH_EARLY_BYTES = 4u << 20;
+
+    bool syncFile(FILE* f) {
+#ifdef _WIN32
+        return _commit(_fileno(f)) == 0;
+#else
+        return fdatasync(fileno(f)) == 0;
+#endif
+    }
+
+    // Cuts an unbuffered journal back to `size` after a failed write
+    void cutFile(FILE* f, uint64_t size) {
+        clearerr(f);
+#ifdef _WIN32
+        _chsize_s(_fileno(f), static_cast<__int64>(size));
+#else
+        if (ftruncate(fileno(f), static_cast<off_t>(size)) != 0) {}
+#endif
+    }
+
+    // Unbuffered, so a failed write leaves nothing behind in the FILE
+    FILE* openAppend(const string& path, const char* mode) {
+        FILE* f = fopen(path.c_str(), mode);
+        if (f) setvbuf(f, nullptr, _IONBF, 0);
+        return f;
+    }
+
+    // Adds the records of `from` after the intact records of `to` and
+    // syncs; a torn tail of `to` would hide everything appended after it
+    bool appendJournal(const string& from, const string& to) {
+        auto skip = [](uint64_t, uint8_t, const vector<string>&) {};
+        Journal::ReplayResult kept = Journal::replay(to, UINT64_MAX, skip);
+        error_code ec;
+        filesystem::resize_file(to, kept.validBytes, ec);
+        if (ec) return false;
+        FILE* in = fopen(from.c_str(), "rb");
+        FILE* out = in ? fopen(to.c_str(), "ab") : nullptr;
+        bool ok = out != nullptr;
+        vector<char> buf(1 << 20);
+        while (ok) {
+            size_t n = fread(buf.data(), 1, buf.size(), in);
+            if (n && fwrite(buf.data(), 1, n, out) != n) ok = false;
+            if (n < buf.size()) break;
+        }
+        ok = ok && !ferror(in) && fflush(out) == 0 && syncFile(out);
+        if (out) fclose(out);
+        if (in) fclose(in);
+        return ok;
+    }
+}
+
+/*──────────────────────  Timestamp fields  ────────────────────*/
+string stampField(Timestamp t) {
+    string f;
+    putRaw(f, t);
+    return f;
+}
+
+Timestamp stampValue(const string& field) {
+    Timestamp t = 0;
+    if (field.size() != sizeof(t)) return wallClock();
+    memcpy(&t, field.data(), sizeof(t));
+    return t;
+}
+
+/*───────────────────────────  Journal  ─────────────────────────*/
+Journal::~Journal() { close(); }
+
+bool Journal::open(const string& p, uint64_t validBytes, uint64_t seq) {
+    close();
+    error_code ec;
+    if (filesystem::exists(p, ec) && filesystem::file_size(p, ec) != validBytes)
+        filesystem::resize_file(p, validBytes, ec);            // drop torn tail
+    file = openAppend(p, "ab");
+    if (!file) return false;
+    path = p;
+    fileBytes = validBytes;
+    nextSeq = seq;
+    stopping = false;
+    flusher = thread(&Journal::flusherLoop, this);
+    return true;
+}
+
+void Journal::close() {
+    if (!file) return;
+    {
+        lock_guard<mutex> lock(mtx);
+        stopping = true;
+    }
+    cv.notify_all();
+    if (flusher.joinable()) flusher.join();
+    if (!commit()) cerr << "JOURNAL WRITE FAILED: " << path << endl;
+    fclose(file);
+    file = nullptr;
+}
+
+uint64_t Journal::append(uint8_t op, initializer_list<string> fields) {
+    string payload;
+    size_t need = 10;
+    for (const string& f : fields) need += 4 + f.size();
+    payload.reserve(need);
+    putRaw<uint64_t>(payload, 0);                              // seq, patched below
+    putRaw<uint8_t>(payload, op);
+    putRaw<uint8_t>(payload, static_cast<uint8_t>(fields.size()));
+    for (const string& f : fields) {
+        putRaw<uint32_t>(payload, static_cast<uint32_t>(f.size()));
+        payload += f;
+    }
+
+    lock_guard<mutex> lock(mtx);
+    uint64_t seq = nextSeq++;
+    memcpy(&payload[0], &seq, sizeof(seq));
+    putRaw<uint32_t>(pending, static_cast<uint32_t>(payload.size()));
+    putRaw<uint32_t>(pending, checksum(payload.data(), payload.size()));
+    pending += payload;
+    if (pending.size() >= FLUSH_EARLY_BYTES) cv.notify_all();
+    return seq;
+}
+
+// fileBytes is advanced by the flusher, so both are read under the lock
+uint64_t Journal::size() const {
+    lock_guard<mutex> lock(mtx);
+    return fileBytes + pending.size();
+}
+
+// Called with `lock` held; releases it around the actual I/O
+void Journal::writeOut(unique_lock<mutex>& lock) {
+    string batch;
+    batch.swap(pending);
+    uint64_t at = fileBytes;
+    writing = true;
+    lock.unlock();
+    OpTimer timer(Op::JournalFlush);
+    bool ok = fwrite(batch.data(), 1, batch.size(), file) == batch.size() && syncFile(file);
+    if (!ok) cutFile(file, at);                                 // no torn record to stop replay
+    lock.lock();
+    if (ok) {
+        fileBytes += batch.size();
+    } else {
+        if (!failed.exchange(true)) cerr << "JOURNAL WRITE FAILED: " << path << endl;
+        pending.insert(0, batch);                              // ahead of what came since
+    }
+    writing = false;
+    cv.notify_all();
+}
+
+bool Journal::commit() {
+    if (!file) return true;
+    unique_lock<mutex> lock(mtx);
+    cv.wait(lock, [&] { return !writing; });
+    if (!pending.empty()) writeOut(lock);
+    return healthy();
+}
+
+void Journal::flusherLoop() {
+    unique_lock<mutex> lock(mtx);
+    while (!stopping) {
+        cv.wait_for(lock, FLUSH_INTERVAL, [&] {
+            return stopping || pending.size() >= FLUSH_EARLY_BYTES;
+        });
+        if (!pending.empty() && !writing && healthy()) writeOut(lock);   // commit() retries
+    }
+}
+
+bool Journal::rotate(const string& oldPath) {
+    if (!file || !commit()) return false;
+    lock_guard<mutex> lock(mtx);                               // keep appends out
+    fclose(file);
+    // An old journal still there belongs to a snapshot that never landed
+    // and is the only copy of its records: add these after them instead
+    // of replacing it.  The current file is only emptied once they are
+    // safely appended.
+    error_code ec;
+    bool ok = filesystem::exists(oldPath, ec) ? appendJournal(path, oldPath)
+                                              : rename(path.c_str(), oldPath.c_str()) == 0 && syncParentDir(oldPath);
+    file = openAppend(path, ok ? "wb" : "ab");
+    if (ok) fileBytes = 0;
+    return ok && file;
+}
+
+Journal::ReplayResult Journal::replay(const string& p, uint64_t afterSeq, const Apply& apply) {
+    ReplayResult r;
+    ifstream in(p, ios::binary);
+    if (!in) return r;
+    string buf((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+
+    const char* pos = buf.data();
+    const char* end = pos + buf.size();
+    vector<string> fields;
+    while (true) {
+        const char* rec = pos;
+        uint32_t len, sum;
+        if (!getRaw(pos, end, len) || !getRaw(pos, end, sum)) break;
+        if (static_cast<size_t>(end - pos) < len || checksum(pos, len) != sum) break;
+        const char* body = pos;
+        const char* bodyEnd = pos + len;
+        pos = bodyEnd;
+
+        uint64_t seq;
+        uint8_t op, count;
+        if (!getRaw(body, bodyEnd, seq) || !getRaw(body, bodyEnd, op) || !getRaw(body, bodyEnd, count)) {
+            pos = rec;
+            break;
+        }
+        fields.clear();
+        bool ok = true;
+        for (uint8_t i = 0; i < count && ok; ++i) {
+            uint32_t flen;
+            ok = getRaw(body, bodyEnd, flen) && static_cast<size_t>(bodyEnd - body) >= flen;
+            if (ok) { fields.emplace_back(body, flen); body += flen; }
+        }
+        if (!ok) { pos = rec; break; }
+
+        r.lastSeq = max(r.lastSeq, seq);
+        if (seq > afterSeq) {
+            apply(seq, op, fields);
+            r.applied++;
+        }
+    }
+    r.validBytes = static_cast<uint64_t>(pos - buf.data());
+    return r;
+}
+
+/*──────────────────  FileSystem: journaling  ───────────────────*/
+void FileSystem::logOp(uint8_t op, initializer_list<string> fields) {
+    if (!journal || replaying) return;
+    journal->append(op, fields);
+    if (journal->size() >= checkpointBytes) checkpoint();
+}
+
+// Re-applies one journal record through the regular operations.
+// Records carry their own timestamps so replayed files keep them.
+void FileSystem::applyJournalRecord(uint8_t op, const vector<string>& f) {
+    auto need = [&](size_t n) { return f.size() >= n; };
+    if (op == J_CLEAR) { clearAll(); return; }
+    if (!need(1)) return;
+
+    string base;
+    Directory* parent = resolveParent(f[0], base);
+    if (!parent) return;
+    Directory* saved = curr;
+    curr = parent;
+    switch (op) {
+    case J_MKDIR:  makeDirectory(base); break;
+    case J_RMFILE: deleteFileByName(base); break;
+    case J_RMDIR:  deleteDirectoryByName(base); break;
+    case J_CREATE:
+        if (need(2)) { pinnedStamp = stampValue(f[1]); createFile(base); }
+        break;
+    case J_WRITE:
+    case J_APPEND:
+        if (need(3)) { pinnedStamp = stampValue(f[2]); writeFile(base, f[1], op == J_APPEND); }
+        break;
+    case J_PWRITE:
+        if (need(4)) {
+            pinnedStamp = stampValue(f[3]);
+            writeFileAt(base, strtoull(f[1].c_str(), nullptr, 10), f[2]);
+        }
+        break;
+    case J_TRUNCATE:
+        if (need(3)) {
+            pinnedStamp = stampValue(f[2]);
+            truncateFile(base, strtoull(f[1].c_str(), nullptr, 10));
+        }
+        break;
+    case J_RENAME:
+        if (!need(2)) break;
+        if (parent->entries.findDir(base)) renameDirectory(base, f[1]);
+        else renameFile(base, f[1]);
+        break;
+    case J_MOVE:
+    case J_COPY: {
+        if (!need(2)) break;
+        Directory* target = navigateToPath(f[1]);
+        if (!target) break;
+        if (op == J_COPY && need(3)) pinnedStamp = stampValue(f[2]);
+        bool isDir = parent->entries.findDir(base) != nullptr;
+        if (op == J_MOVE) isDir ? moveDirectory(base, target) : moveFile(base, target);
+        else              isDir ? copyDirectory(base, target) : copyFile(base, target);
+        break;
+    }
+    default: break;
+    }
+    pinnedStamp = 0;
+    curr = saved;
+}
+
+// Loads the last checkpoint, then replays the previous and the current
+// journal on top of it and keeps appending to the current one.
+void FileSystem::openJournal() {
+    string walPath = dataFile + ".wal";
+    string oldPath = dataFile + ".wal.old";
+    uint64_t lastSeq = snapshotSeq;
+
+    auto apply = [&](uint64_t, uint8_t op, const vector<string>& fields) {
+        applyJournalRecord(op, fields);
+    };
+    streambuf* out = cout.rdbuf(nullptr);                      // ops are chatty
+    replaying = true;
+    Journal::ReplayResult oldRun, cur;
+    {
+        OpTimer timer(Op::JournalReplay);
+        oldRun = Journal::replay(oldPath, snapshotSeq, apply);
+        // A crash during rotate() can leave records in both files
+        cur    = Journal::replay(walPath, max(snapshotSeq, oldRun.lastSeq), apply);
+    }
+    replaying = false;
+    cout.rdbuf(out);
+    cout.clear();
+    lastSeq = max({lastSeq, oldRun.lastSeq, cur.lastSeq});
+    curr = root;
+
+    journal.reset(new Journal());
+    if (!journal->open(walPath, cur.validBytes, lastSeq + 1)) {
+        cerr << "COULD NOT OPEN JOURNAL " << walPath << endl;
+        journal.reset();
+        snapshotSeq = lastSeq;                                 // saving the data file now covers them
+        return;
+    }
+    if (filesystem::exists(oldPath)) checkpoint();             // finish a cut-off one
+}
+
+// Compacts the journal into a new snapshot.  Here the tree is only
+// pinned (O(1)) and the journal switched to a fresh file; encoding the
+// pinned view, writing it and dropping the old journal happen on a
+// background thread while the tree keeps changing; directories that are
+// still unread are copied from their snapshot, not read in.  Returns false if
+// the journal could not be written or switched, or the previous snapshot
+// was never written (its records are still in the old journal).
+bool FileSystem::checkpoint() {
+    OpTimer timer(Op::Checkpoint);
+    if (!journal) return saveToDisk(dataFile);
+    bool previous = waitForCheckpoint();
+    releaseSnapshots();
+    string oldPath = dataFile + ".wal.old";
+    uint64_t seq = journal->lastSeq();
+    auto view = make_shared<TreeView>(pinTree());
+    if (!journal->rotate(oldPath)) {
+        cerr << "COULD NOT ROTATE JOURNAL" << endl;
+        return false;
+    }
+    string target = dataFile;
+    auto snapshots = lazySnapshots;                            // the encoder reads unread directories there
+    checkpointThread = thread([this, view, seq, target, oldPath, snapshots] {
+        OpTimer timer(Op::CheckpointWrite);
+        SnapshotImage image = encodeSnapshot(*view, seq);
+        view->release();                                       // the image pins what it needs
+        checkpointWritten = image.writeTo(target);
+        if (checkpointWritten) remove(oldPath.c_str());
+        else cerr << "CHECKPOINT FAILED: " << target << endl;
+    });
+    return previous;
+}
+
+bool FileSystem::waitForCheckpoint() {
+    if (checkpointThread.joinable()) checkpointThread.join();
+    return checkpointWritten;
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <functional>
+#include <initializer_list>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include "timestamp.h"
+
+// ── Journal record types ─────────────────────────────────────────
+enum JournalOp : uint8_t {
+    J_MKDIR  = 1,               // path
+    J_CREATE = 2,               // path, timestamp (see stampField)
+    J_WRITE  = 3,               // path, content, timestamp
+    J_APPEND = 4,               // path, content, timestamp
+    J_RMFILE = 5,               // path
+    J_RMDIR  = 6,               // path
+    J_RENAME = 7,               // path, new name
+    J_MOVE   = 8,               // path, target directory
+    J_COPY   = 9,               // path, target directory, timestamp
+    J_CLEAR  = 10,              // (no fields)
+    J_PWRITE = 11,              // path, offset, data, timestamp
+    J_TRUNCATE = 12,            // path, size, timestamp
+};
+
+// Timestamp fields are 8 raw bytes; a field of any other length reads as
+// the current time.
+std::string stampField(Timestamp t);
+Timestamp stampValue(const std::string& field);
+
+// Append-only operation log.
+//
+// Each record is framed as  [u32 payload length][u32 checksum][payload]
+// with payload = [u64 seq][u8 op][u8 field count]{[u32 len][bytes]}.
+// append() only copies the record into memory; a flusher thread writes
+// and fsyncs whatever has accumulated every few milliseconds, so many
+// operations share one fsync (group commit).  A torn record at the tail
+// fails its checksum and ends replay.
+//
+// A batch that does not get written (disk full, file size limit) is cut
+// back off the file, so later records are not hidden behind a torn one,
+// and stays pending; the journal is then marked failed for good, and
+// commit() retries the write but keeps reporting the failure.
+class Journal {
+public:
+    struct ReplayResult {
+        uint64_t lastSeq = 0;   // highest sequence number seen
+        uint64_t validBytes = 0;// length of the intact prefix
+        uint64_t applied = 0;   // records handed to the callback
+    };
+    using Apply = std::function<void(uint64_t seq, uint8_t op, const std::vector<std::string>& fields)>;
+
+    Journal() = default;
+    ~Journal();
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    // Opens (or creates) `path`, cutting it back to `validBytes`.
+    bool open(const std::string& path, uint64_t validBytes, uint64_t nextSeq);
+    void close();
+    bool isOpen() const { return file != nullptr; }
+
+    uint64_t append(uint8_t op, std::initializer_list<std::string> fields);
+    bool commit();                                  // write + fsync now; false: failed
+    bool healthy() const { return !failed.load(std::memory_order_acquire); }
+    bool rotate(const std::string& oldPath);        // current file -> oldPath
+    uint64_t size() const;
+    uint64_t lastSeq() const { return nextSeq - 1; }
+
+    static ReplayResult replay(const std::string& path, uint64_t afterSeq, const Apply& apply);
+
+private:
+    void flusherLoop();
+    void writeOut(std::unique_lock<std::mutex>& lock);
+
+    std::string path;
+    FILE* file = nullptr;
+    uint64_t fileBytes = 0;
+    uint64_t nextSeq = 1;
+
+    mutable std::mutex mtx;
+    std::condition_variable cv;
+    std::string pending;                            // records not yet written
+    bool writing = false;
+    bool stopping = false;
+    std::atomic<bool> failed{false};                // a write failed (latched)
+    std::thread flusher;
+};
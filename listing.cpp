@@ -0,0 +1,214 @@
+#include "filesystem.h"
+#include "listing.h"
+#include "bufwriter.h"
+#include "metrics.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <limits>
+using namespace std;
+
+/*─────────────────────────  Entries  ───────────────────────────*/
+bool parseListOrder(const string& text, ListOrder& order) {
+    if (text == "name") order = ListOrder::Name;
+    else if (text == "mtime" || text == "time") order = ListOrder::Modified;
+    else if (text == "size") order = ListOrder::Size;
+    else return false;
+    return true;
+}
+
+const string& ListEntry::name() const { return dir ? dir->name : file->name; }
+uint64_t ListEntry::size() const { return dir ? dir->usage.get().bytes : file->content.size(); }
+int64_t ListEntry::modified() const { return dir ? dir->usage.newestTime() : file->modifiedAt; }
+
+namespace {
+    // Newest and largest first: the value is inverted so that every
+    // order is ascending in its rank
+    uint64_t rankOf(ListOrder order, uint64_t size, Timestamp modified) {
+        switch (order) {
+        case ListOrder::Modified: return ~(static_cast<uint64_t>(modified) ^ (1ull << 63));
+        case ListOrder::Size:     return ~size;
+        default:                  return 0;
+        }
+    }
+
+    ListEntry entryOf(ListOrder order, Directory* d) {
+        Usage u = order == ListOrder::Name ? Usage() : d->usage.get();
+        return {d, nullptr, rankOf(order, u.bytes, u.newest)};
+    }
+    ListEntry entryOf(ListOrder order, File* f) {
+        return {nullptr, f, order == ListOrder::Name ? 0 : rankOf(order, f->content.size(), f->modifiedAt)};
+    }
+
+    // List order: directories first, then rank, then name
+    bool before(const ListEntry& a, const ListEntry& b) {
+        bool af = a.file != nullptr, bf = b.file != nullptr;
+        if (af != bf) return bf;
+        if (a.rank != b.rank) return a.rank < b.rank;
+        return a.name() < b.name();
+    }
+
+    bool afterCursor(const ListCursor& cur, const ListEntry& e) {
+        if (!cur.started) return true;
+        bool isFile = e.file != nullptr;
+        if (isFile != cur.lastIsFile) return isFile;
+        if (e.rank != cur.lastRank) return e.rank > cur.lastRank;
+        return e.name() > cur.lastName;
+    }
+}
+
+/*──────────────────────────  Pages  ────────────────────────────*/
+// Up to `count` entries of `dir` after the cursor, in its order
+void FileSystem::listPage(Directory* dir, ListCursor& cur, size_t count, vector<ListEntry>& out) {
+    OpTimer timer(Op::List);
+    out.clear();
+    if (cur.done || !count) return;
+    size_t want = count + 1;                                   // one more tells whether the end is reached
+
+    if (cur.order == ListOrder::Name && dir->entries.sortedReady()) {
+        const vector<Directory*>& dirs = dir->entries.sortedDirs();
+        const vector<File*>& files = dir->entries.sortedFiles();
+        auto byName = [](const auto* node, const string& name) { return node->name <= name; };
+        size_t d = 0, f = 0;
+        if (cur.started && !cur.lastIsFile)
+            d = partition_point(dirs.begin(), dirs.end(), [&](const Directory* n) { return byName(n, cur.lastName); }) - dirs.begin();
+        if (cur.started && cur.lastIsFile) {
+            d = dirs.size();
+            f = partition_point(files.begin(), files.end(), [&](const File* n) { return byName(n, cur.lastName); }) - files.begin();
+        }
+        for (; d < dirs.size() && out.size() < want; ++d) out.push_back({dirs[d], nullptr, 0});
+        for (; f < files.size() && out.size() < want; ++f) out.push_back({nullptr, files[f], 0});
+    } else {
+        // The `want` first entries after the cursor, kept in a max-heap
+        auto consider = [&](const ListEntry& e) {
+            if (!afterCursor(cur, e)) return;
+            if (out.size() < want) {
+                out.push_back(e);
+                push_heap(out.begin(), out.end(), before);
+            } else if (before(e, out.front())) {
+                pop_heap(out.begin(), out.end(), before);
+                out.back() = e;
+                push_heap(out.begin(), out.end(), before);
+            }
+        };
+        dir->entries.forEach([&](Directory* d) { consider(entryOf(cur.order, d)); },
+                             [&](File* f) { consider(entryOf(cur.order, f)); });
+        sort_heap(out.begin(), out.end(), before);
+    }
+
+    if (out.size() < want) cur.done = true;
+    else out.pop_back();
+    if (out.empty()) return;
+    const ListEntry& last = out.back();
+    cur.started = true;
+    cur.lastIsFile = last.file != nullptr;
+    cur.lastRank = last.rank;
+    cur.lastName = last.name();
+    cur.returned += out.size();
+}
+
+// Prints the next page in the `ls -l` layout, numbered from the cursor;
+// false once the listing is finished
+bool FileSystem::printPage(Directory* dir, ListCursor& cur, size_t count) {
+    uint64_t first = cur.returned + 1;
+    vector<ListEntry> page;
+    listPage(dir, cur, count, page);
+    BufferedWriter out(cout);
+    uint64_t n = first;
+    for (const ListEntry& e : page) {
+        out << "  ";
+        out.right(n++, 8) << ". ";
+        out.right(e.size(), 14) << "  ";
+        bool dated = e.file || e.dir->usage.get().files;
+        out.left(dated ? formatTimestamp(e.modified()) : string("-"), 19) << "  " << e.name();
+        if (e.dir) out << '/';
+        out << '\n';
+    }
+    if (page.empty() && first == 1) out << "  (EMPTY DIRECTORY)\n";
+    else if (page.empty()) out << "  (NO MORE ENTRIES)\n";
+    else {
+        out << "ENTRIES " << first << '-' << n - 1;
+        out << (cur.done ? " (END)\n" : " (MORE: page next)\n");
+    }
+    return !page.empty();
+}
+
+// page [-n SIZE] [-sort name|mtime|size] [PATH]: the first page of a new
+// listing;  page next: the page after it
+bool FileSystem::pageCommand(const vector<string>& args) {
+    if (args.size() == 2 && args[1] == "next") {
+        Directory* dir = pagePath.empty() ? nullptr : resolveDir(pagePath);
+        if (!dir) return false;                                // none started, or it is gone
+        printPage(dir, pageCursor, pageSize);
+        return true;
+    }
+    ListCursor cur;
+    size_t size = 100;
+    size_t i = 1;
+    for (; i + 1 < args.size() && (args[i] == "-n" || args[i] == "-sort"); i += 2) {
+        if (args[i] == "-sort") {
+            if (!parseListOrder(args[i + 1], cur.order)) return false;
+            continue;
+        }
+        const string& value = args[i + 1];
+        if (value.empty() || !isdigit(static_cast<unsigned char>(value[0]))) return false;
+        char* end = nullptr;
+        errno = 0;
+        size = strtoull(value.c_str(), &end, 10);
+        if (*end || errno == ERANGE || !size) return false;
+    }
+    if (i + 1 < args.size()) return false;
+    Directory* dir = resolveDir(i < args.size() ? args[i] : "");
+    if (!dir) return false;
+    pagePath = pathOf(dir);
+    pageCursor = cur;
+    pageSize = size;
+    printPage(dir, pageCursor, pageSize);
+    return true;
+}
+
+/*───────────────────────  Menu listing  ────────────────────────*/
+// Content menu, option 2: pages of MENU_PAGE entries, each printed
+// in one write; the next page only on request
+void FileSystem::browseContents() {
+    constexpr size_t MENU_PAGE = 50;
+    ListCursor cur;
+    cout << "SORT BY NAME (1), MODIFIED (2) OR SIZE (3) [1]: ";
+    string line;
+    getline(cin, line);
+    if (line == "2") cur.order = ListOrder::Modified;
+    else if (line == "3") cur.order = ListOrder::Size;
+
+    bool filesShown = false;
+    for (;;) {
+        vector<ListEntry> page;
+        listPage(curr, cur, MENU_PAGE, page);
+        {
+            BufferedWriter out(cout);
+            if (cur.returned == page.size()) {                 // first page
+                out << "\nDIRECTORIES:\n";
+                if (page.empty() || page.front().file) out << "  (NO DIRECTORIES FOUND)\n";
+            }
+            uint64_t n = cur.returned - page.size();
+            for (const ListEntry& e : page) {
+                if (e.file && !filesShown) {
+                    out << "\nFILES:\n";
+                    filesShown = true;
+                }
+                out << "  " << ++n << ". " << e.name();
+                if (e.dir) {
+                    out << " [Subdirs: " << static_cast<uint64_t>(e.dir->entries.dirCount())
+                        << ", Files: " << static_cast<uint64_t>(e.dir->entries.fileCount()) << "]\n";
+                } else {
+                    out << " [Created: " << formatTimestamp(e.file->createdAt)
+                        << ", Modified: " << formatTimestamp(e.file->modifiedAt) << "]\n";
+                }
+            }
+            if (cur.done && !filesShown) out << "\nFILES:\n  (NO FILES FOUND)\n";
+        }
+        if (cur.done) return;
+        cout << "ENTER: NEXT PAGE, Q: BACK TO MENU: ";
+        if (!getline(cin, line) || line == "q" || line == "Q") return;
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+class Directory;
+struct File;
+
+// Paged directory listings (`page` in script mode, the content menu).
+//
+// A cursor holds the key of the last entry it returned, not a position,
+// so the next page starts right after that entry even if entries were
+// added or removed in between.  In name order nothing is skipped or shown
+// twice.  Modified and Size order follow the values as they are when each
+// page is cut: an entry whose time or size changed between pages can move
+// across the cursor and be skipped or shown again.  A page
+// is cut from the entry table with a bounded heap, in O(n log page) time
+// and O(page) memory, without sorting or copying the directory.  When the
+// directory's sorted view is already built (any full listing builds it),
+// a name-ordered page is a binary search into it instead.
+//
+// Directories come before files.  Within each, Name is ascending; Modified
+// (newest first) and Size (largest first) break ties by name.  A
+// directory's size and time are its recursive totals (usage.h).
+
+enum class ListOrder : uint8_t { Name, Modified, Size };
+
+bool parseListOrder(const std::string& text, ListOrder& order);    // "name", "mtime", "size"
+
+struct ListEntry {
+    Directory* dir = nullptr;                  // one of the two
+    File* file = nullptr;
+    uint64_t rank = 0;                         // the order's value, ascending in list order
+
+    const std::string& name() const;
+    uint64_t size() const;
+    int64_t modified() const;                  // ns since the epoch
+};
+
+struct ListCursor {
+    ListOrder order = ListOrder::Name;
+    bool started = false;                      // false: before the first entry
+    bool done = false;                         // the last page was returned
+    bool lastIsFile = false;                   // key of the last entry returned
+    uint64_t lastRank = 0;
+    std::string lastName;
+    uint64_t returned = 0;                     // entries so far, for numbering
+};
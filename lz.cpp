@@ -0,0 +1,218 @@
+#include "filesystem.h"
+#include "lz.h"
+#include "fmtguard.h"
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <vector>
+using namespace std;
+
+/*──────────────────────────  Block codec  ──────────────────────*/
+namespace {
+    constexpr size_t MIN_MATCH = 4;
+    constexpr size_t LAST_LITERALS = 5;    // a block always ends in literals ...
+    constexpr size_t MATCH_LIMIT = 12;     // ... and no match starts this close to the end
+    constexpr size_t MAX_OFFSET = 65535;
+    constexpr unsigned HASH_BITS = 12;
+
+    inline uint32_t load32(const char* p) { uint32_t v; memcpy(&v, p, 4); return v; }
+    inline uint64_t load64(const char* p) { uint64_t v; memcpy(&v, p, 8); return v; }
+    inline unsigned hash4(uint32_t v) { return (v * 2654435761u) >> (32 - HASH_BITS); }
+
+    // Bytes src and ref have in common, reading src no further than limit
+    inline size_t commonBytes(const char* src, const char* ref, const char* limit) {
+        const char* p = src;
+        while (p + 8 <= limit) {
+            uint64_t diff = load64(p) ^ load64(ref);
+            if (diff) {
+#if defined(__GNUC__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+                return (p - src) + (__builtin_ctzll(diff) >> 3);
+#else
+                break;
+#endif
+            }
+            p += 8;
+            ref += 8;
+        }
+        while (p < limit && *p == *ref) { ++p; ++ref; }
+        return p - src;
+    }
+
+    // 15 in a token nibble means the length goes on in 255-terminated bytes
+    inline char* putLength(char* op, size_t len) {
+        for (; len >= 255; len -= 255) *op++ = static_cast<char>(255);
+        *op++ = static_cast<char>(len);
+        return op;
+    }
+}
+
+size_t lzCompress(const char* src, size_t n, char* dst, size_t cap) {
+    const char* end = src + n;
+    const char* anchor = src;              // first literal not yet written
+    char* op = dst;
+    char* oend = dst + cap;
+
+    // One sequence: literals [lit, lit + litLen), then a match (none for the last)
+    auto emit = [&](const char* lit, size_t litLen, size_t matchLen, size_t offset) {
+        size_t worst = 1 + litLen / 255 + 1 + litLen + 2 + matchLen / 255 + 1;
+        if (static_cast<size_t>(oend - op) < worst) return false;
+        char* token = op++;
+        unsigned t = static_cast<unsigned>(litLen >= 15 ? 15 : litLen) << 4;
+        if (litLen >= 15) op = putLength(op, litLen - 15);
+        memcpy(op, lit, litLen);
+        op += litLen;
+        if (matchLen) {
+            *op++ = static_cast<char>(offset & 0xff);
+            *op++ = static_cast<char>(offset >> 8);
+            size_t ml = matchLen - MIN_MATCH;
+            t |= ml >= 15 ? 15 : static_cast<unsigned>(ml);
+            if (ml >= 15) op = putLength(op, ml - 15);
+        }
+        *token = static_cast<char>(t);
+        return true;
+    };
+
+    if (n > MATCH_LIMIT) {
+        uint32_t table[1u << HASH_BITS] = {};                   // hash -> position
+        const char* limit = end - MATCH_LIMIT;
+        const char* matchEnd = end - LAST_LITERALS;
+        const char* ip = src + 1;
+        unsigned misses = 0;
+        while (ip < limit) {
+            uint32_t v = load32(ip);
+            unsigned h = hash4(v);
+            const char* ref = src + table[h];
+            table[h] = static_cast<uint32_t>(ip - src);
+            if (ref >= ip || static_cast<size_t>(ip - ref) > MAX_OFFSET || load32(ref) != v) {
+                ip += 1 + (misses++ >> 5);                     // skip faster through incompressible data
+                continue;
+            }
+            misses = 0;
+            while (ip > anchor && ref > src && ip[-1] == ref[-1]) { --ip; --ref; }
+            size_t len = MIN_MATCH + commonBytes(ip + MIN_MATCH, ref + MIN_MATCH, matchEnd);
+            if (!emit(anchor, ip - anchor, len, ip - ref)) return 0;
+            ip = anchor = ip + len;
+            if (ip < limit) table[hash4(load32(ip - 2))] = static_cast<uint32_t>(ip - 2 - src);
+        }
+    }
+    if (!emit(anchor, end - anchor, 0, 0)) return 0;
+    return op - dst;
+}
+
+size_t lzDecompress(const char* src, size_t n, char* dst, size_t cap) {
+    const unsigned char* ip = reinterpret_cast<const unsigned char*>(src);
+    const unsigned char* iend = ip + n;
+    char* op = dst;
+    char* oend = dst + cap;
+    auto length = [&](size_t& len) {
+        if (len != 15) return true;
+        for (unsigned char b = 255; b == 255; len += b) {
+            if (ip >= iend) return false;
+            b = *ip++;
+        }
+        return true;
+    };
+
+    while (ip < iend) {
+        unsigned token = *ip++;
+        size_t lit = token >> 4;
+        if (!length(lit) || lit > static_cast<size_t>(iend - ip) || lit > static_cast<size_t>(oend - op))
+            return SIZE_MAX;
+        memcpy(op, ip, lit);
+        ip += lit;
+        op += lit;
+        if (ip == iend) break;                                 // the last sequence
+        if (iend - ip < 2) return SIZE_MAX;
+        size_t offset = ip[0] | (size_t(ip[1]) << 8);
+        ip += 2;
+        size_t len = token & 15;
+        if (!length(len)) return SIZE_MAX;
+        len += MIN_MATCH;
+        if (!offset || offset > static_cast<size_t>(op - dst) || len > static_cast<size_t>(oend - op))
+            return SIZE_MAX;
+        // An overlapping match repeats the last `offset` bytes: copy in
+        // steps of at most `offset`, which never overlap
+        const char* from = op - offset;
+        for (size_t done = 0; done < len;) {
+            size_t step = len - done < offset ? len - done : offset;
+            memcpy(op + done, from + done, step);
+            done += step;
+        }
+        op += len;
+    }
+    return op - dst;
+}
+
+/*─────────────────  FileSystem: compression tier  ──────────────*/
+namespace {
+    double mbPerSec(uint64_t bytes, chrono::steady_clock::duration t) {
+        double s = chrono::duration<double>(t).count();
+        return s > 0 ? bytes / 1e6 / s : 0.0;
+    }
+}
+
+// After a write: files of compressAbove bytes and more stay compressed.
+// An append leaves a partial last chunk raw, the next append goes there.
+void FileSystem::compressIfLarge(File* f, bool appended) {
+    if (compressAbove && f->content.size() >= compressAbove) f->content.compress(!appended);
+}
+
+// Compresses every file in `scope` of at least minSize bytes that has not
+// been modified for coldSeconds (0: any)
+bool FileSystem::compressFiles(Directory* scope, uint64_t minSize, uint64_t coldSeconds) {
+    vector<File*> files = filesUnder(scope ? scope : root);
+    Timestamp cutoff = coarseClock() - static_cast<Timestamp>(coldSeconds) * 1000000000;
+    size_t count = 0, shared = 0;
+    uint64_t raw = 0, before = 0, after = 0;
+    auto t0 = chrono::steady_clock::now();
+    for (File* f : files) {
+        uint64_t size = f->content.size();
+        if (!size || size < minSize || (coldSeconds && f->modifiedAt > cutoff)) continue;
+        if (f->content.shared()) { ++shared; continue; }      // copies share one buffer
+        versions.preserve(f);                                  // a pinned view keeps the raw chunks
+        before += f->content.storedSize();
+        f->content.compress(true, true);
+        after += f->content.storedSize();
+        raw += size;
+        count += f->content.compressed();
+    }
+    auto elapsed = chrono::steady_clock::now() - t0;
+    FormatGuard format(cout);
+    cout << fixed << setprecision(2) << "COMPRESSED " << count << " FILE(S): "
+         << before / 1e6 << " MB -> " << after / 1e6 << " MB (" << raw / 1e6 << " MB RAW), "
+         << setprecision(0) << mbPerSec(raw, elapsed) << " MB/S";
+    if (shared) cout << ", " << shared << " SHARED FILE(S) LEFT AS THEY ARE";
+    cout << endl;
+    return true;
+}
+
+// Compression ratio of `scope`, and how fast its compressed files decode
+bool FileSystem::compressStats(Directory* scope) {
+    vector<File*> files = filesUnder(scope ? scope : root);
+    size_t packedFiles = 0;
+    uint64_t raw = 0, stored = 0, packedRaw = 0, packedStored = 0;
+    volatile unsigned char sink = 0;                           // keeps the decode from being optimized out
+    auto t0 = chrono::steady_clock::now();
+    for (File* f : files) {
+        uint64_t size = f->content.size(), held = f->content.storedSize();
+        raw += size;
+        stored += held;
+        if (!f->content.compressed()) continue;
+        ++packedFiles;
+        packedRaw += size;
+        packedStored += held;
+        f->content.forEachPiece([&](const char* p, size_t n) { sink = p[n - 1]; });
+    }
+    auto elapsed = chrono::steady_clock::now() - t0;
+    FormatGuard format(cout);
+    cout << fixed << setprecision(2)
+         << "FILES: " << files.size() << ", " << raw / 1e6 << " MB HELD IN " << stored / 1e6
+         << " MB (RATIO " << (stored ? double(raw) / stored : 1.0) << ")\n"
+         << "COMPRESSED: " << packedFiles << " FILE(S), " << packedRaw / 1e6 << " MB IN "
+         << packedStored / 1e6 << " MB (RATIO " << (packedStored ? double(packedRaw) / packedStored : 1.0) << ")\n"
+         << "DECODE: " << setprecision(0) << mbPerSec(packedRaw, elapsed) << " MB/S\n"
+         << "AUTO: ";
+    if (compressAbove) cout << "FILES OF " << compressAbove << " BYTES AND MORE" << endl;
+    else cout << "OFF" << endl;
+    return true;
+}
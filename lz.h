@@ -0,0 +1,25 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Byte-oriented LZ77 block codec in the LZ4 block format.
+//
+// A block is a run of sequences: a token byte (literal count in the high
+// nibble, match length - 4 in the low one, 15 meaning "more length bytes
+// follow"), the literals, and a 2-byte little-endian offset back into the
+// output.  The last sequence has literals only.  Matches are found through
+// a hash of the next 4 bytes with no chain search, so compression runs at
+// several hundred MB/s and decompression is little more than memcpy.
+//
+// Blocks describe at most 64 KB of input (one content chunk).
+
+// Worst-case compressed size of n input bytes
+constexpr size_t lzBound(size_t n) { return n + n / 255 + 16; }
+
+// Compresses src[0, n) into dst; returns the compressed size, or 0 if it
+// would not fit in `cap` bytes
+size_t lzCompress(const char* src, size_t n, char* dst, size_t cap);
+
+// Decompresses a whole block into dst; returns the bytes produced, or
+// SIZE_MAX if the block is corrupt or does not fit in `cap` bytes
+size_t lzDecompress(const char* src, size_t n, char* dst, size_t cap);
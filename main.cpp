@@ -1,6 +1,41 @@
 #include "filesystem.h"
-int main() {
-    FileSystem fs;
-    fs.start();
-    return 0;
-}
\ No newline at end of file
+#include <csignal>
+#include <cstring>
+#include <fstream>
+
+// Usage: filesystem [--data FILE] [--script FILE|-] [--metrics FILE] [-v]
+//   no --script  -> interactive menus
+//   --script -   -> read commands from stdin
+//   --metrics    -> write operation metrics on exit (*.json: JSON, else Prometheus)
+int main(int argc, char* argv[]) {
+    std::string dataFile = "fs_data.bin";
+    std::string script, metrics;
+    bool verbose = false;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--data") && i + 1 < argc) dataFile = argv[++i];
+        else if (!strcmp(argv[i], "--script") && i + 1 < argc) script = argv[++i];
+        else if (!strcmp(argv[i], "--metrics") && i + 1 < argc) metrics = argv[++i];
+        else if (!strcmp(argv[i], "-v")) verbose = true;
+        else {
+            std::cerr << "usage: " << argv[0] << " [--data FILE] [--script FILE|-] [--metrics FILE] [-v]\n";
+            return 2;
+        }
+    }
+
+#ifndef _WIN32
+    signal(SIGXFSZ, SIG_IGN);          // past a file size limit, writes fail instead
+#endif
+    FileSystem fs(dataFile);
+    if (!metrics.empty()) fs.dumpMetricsOnExit(metrics);
+    if (script.empty()) {
+        fs.start();
+        return 0;
+    }
+    if (script == "-") return fs.runScript(std::cin, verbose) ? 1 : 0;
+    std::ifstream in(script);
+    if (!in) {
+        std::cerr << "CANNOT OPEN SCRIPT: " << script << "\n";
+        return 2;
+    }
+    return fs.runScript(in, verbose) ? 1 : 0;
+}
@@ -0,0 +1,274 @@
+#include "filesystem.h"
+#include "metrics.h"
+#include "fmtguard.h"
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+using namespace std;
+
+/*─────────────────────────  Histograms  ────────────────────────*/
+namespace {
+    const char* const OP_NAMES[OP_COUNT] = {
+        "mkdir", "rmdir", "rename_dir", "move_dir", "copy_dir",
+        "create", "remove", "rename_file", "move_file", "copy_file",
+        "write", "read", "truncate", "list", "navigate", "find", "grep",
+        "save", "load", "load_dir", "checkpoint", "checkpoint_write",
+        "journal_flush", "journal_replay", "export", "import",
+        "host_import", "host_export", "tree",
+    };
+
+    inline unsigned topBit(uint64_t v) {                       // v > 0
+#if defined(__GNUC__)
+        return 63 - __builtin_clzll(v);
+#else
+        unsigned b = 0;
+        while (v >>= 1) ++b;
+        return b;
+#endif
+    }
+}
+
+const char* opName(Op op) { return OP_NAMES[static_cast<size_t>(op)]; }
+
+// Values below 2^SUB_BITS have a bucket each; above, every power of two
+// is split into 2^SUB_BITS buckets by the bits after the leading one
+size_t Histogram::bucketOf(uint64_t ns) {
+    constexpr uint64_t SUB = uint64_t(1) << SUB_BITS;
+    if (ns < SUB) return static_cast<size_t>(ns);
+    ns = min(ns, (uint64_t(1) << MAX_BITS) - 1);
+    unsigned e = topBit(ns);
+    return static_cast<size_t>(((e - SUB_BITS + 1) << SUB_BITS) + ((ns >> (e - SUB_BITS)) & (SUB - 1)));
+}
+
+uint64_t Histogram::upperBound(size_t bucket) {
+    constexpr uint64_t SUB = uint64_t(1) << SUB_BITS;
+    if (bucket < SUB) return bucket;
+    unsigned e = static_cast<unsigned>(bucket >> SUB_BITS) - 1 + SUB_BITS;
+    uint64_t step = uint64_t(1) << (e - SUB_BITS);
+    return (SUB + (bucket & (SUB - 1))) * step + step - 1;
+}
+
+uint64_t Histogram::percentile(double q) const {
+    if (!count) return 0;
+    uint64_t rank = static_cast<uint64_t>(q * (count - 1)) + 1, seen = 0;
+    for (size_t b = 0; b < BUCKETS; ++b) {
+        seen += buckets[b];
+        if (seen >= rank) return min(upperBound(b), max);
+    }
+    return max;
+}
+
+/*──────────────────────────  Registry  ─────────────────────────*/
+namespace {
+    // Written by its owning thread only: plain load + store, no RMW
+    struct Shard {
+        atomic<uint64_t> counts[OP_COUNT][Histogram::BUCKETS];
+        atomic<uint64_t> sum[OP_COUNT];
+        atomic<uint64_t> max[OP_COUNT];
+        atomic<int64_t> gauges[GAUGE_COUNT];
+        atomic<bool> owned{false};
+    };
+
+    template <class T>
+    inline void bump(atomic<T>& a, T delta) {
+        a.store(a.load(memory_order_relaxed) + delta, memory_order_relaxed);
+    }
+
+    struct Registry {
+        mutex mtx;
+        vector<unique_ptr<Shard>> shards;
+        unique_ptr<MetricsReport> baseline{new MetricsReport()};
+    };
+
+    // Never destroyed: threads may still record while statics go away
+    Registry& registry() {
+        static Registry* r = new Registry();
+        return *r;
+    }
+
+    Shard* claimShard() {
+        Registry& r = registry();
+        lock_guard<mutex> lock(r.mtx);
+        for (auto& s : r.shards) {
+            bool free = false;
+            if (s->owned.compare_exchange_strong(free, true)) return s.get();
+        }
+        r.shards.emplace_back(new Shard());                    // zero-initialized
+        r.shards.back()->owned.store(true);
+        return r.shards.back().get();
+    }
+
+    // Gives the shard back when the thread exits; its counts stay
+    struct ShardOwner {
+        Shard* shard = nullptr;
+        ~ShardOwner() { if (shard) shard->owned.store(false); }
+    };
+    thread_local ShardOwner owner;
+
+    inline Shard& shard() {
+        if (!owner.shard) owner.shard = claimShard();
+        return *owner.shard;
+    }
+
+    // Totals over every shard; the caller holds the registry lock
+    void sumShards(Registry& r, MetricsReport& out) {
+        out = MetricsReport();
+        for (auto& s : r.shards) {
+            for (size_t op = 0; op < OP_COUNT; ++op) {
+                Histogram& h = out.ops[op];
+                for (size_t b = 0; b < Histogram::BUCKETS; ++b) {
+                    uint64_t n = s->counts[op][b].load(memory_order_relaxed);
+                    h.buckets[b] += n;
+                    h.count += n;
+                }
+                h.sum += s->sum[op].load(memory_order_relaxed);
+                h.max = max(h.max, s->max[op].load(memory_order_relaxed));
+            }
+            for (size_t g = 0; g < GAUGE_COUNT; ++g)
+                out.gauges[g] += s->gauges[g].load(memory_order_relaxed);
+        }
+    }
+}
+
+void recordLatency(Op op, uint64_t ns) {
+    Shard& s = shard();
+    size_t i = static_cast<size_t>(op);
+    bump(s.counts[i][Histogram::bucketOf(ns)], uint64_t(1));
+    bump(s.sum[i], ns);
+    if (ns > s.max[i].load(memory_order_relaxed)) s.max[i].store(ns, memory_order_relaxed);
+}
+
+void addGauge(Gauge g, int64_t delta) {
+    bump(shard().gauges[static_cast<size_t>(g)], delta);
+}
+
+void collectMetrics(MetricsReport& out) {
+    Registry& r = registry();
+    lock_guard<mutex> lock(r.mtx);
+    sumShards(r, out);
+    const MetricsReport& base = *r.baseline;
+    for (size_t op = 0; op < OP_COUNT; ++op) {
+        Histogram& h = out.ops[op];
+        const Histogram& b = base.ops[op];
+        h.count -= b.count;
+        h.sum -= b.sum;
+        size_t top = 0;
+        for (size_t i = 0; i < Histogram::BUCKETS; ++i) {
+            h.buckets[i] -= b.buckets[i];
+            if (h.buckets[i]) top = i;
+        }
+        // The maximum is not reset; the highest bucket since then bounds it
+        h.max = h.count ? min(h.max, Histogram::upperBound(top)) : 0;
+    }
+}
+
+void resetMetrics() {
+    Registry& r = registry();
+    lock_guard<mutex> lock(r.mtx);
+    sumShards(r, *r.baseline);
+}
+
+/*──────────────────────  FileSystem: stats  ────────────────────*/
+namespace {
+    struct MemoryUse {
+        size_t dirs, files;
+        uint64_t nodes, entryTables, extentTables, chunks, mapped;
+        uint64_t metadata() const { return nodes + entryTables + extentTables; }
+    };
+
+    void writeJson(ostream& out, const MetricsReport& m, const MemoryUse& mem) {
+        out << "{\"operations\":{";
+        bool first = true;
+        for (size_t op = 0; op < OP_COUNT; ++op) {
+            const Histogram& h = m.ops[op];
+            if (!h.count) continue;
+            out << (first ? "" : ",") << '"' << opName(static_cast<Op>(op)) << "\":{"
+                << "\"count\":" << h.count << ",\"sum_ns\":" << h.sum
+                << ",\"p50_ns\":" << h.percentile(0.5) << ",\"p90_ns\":" << h.percentile(0.9)
+                << ",\"p99_ns\":" << h.percentile(0.99) << ",\"p999_ns\":" << h.percentile(0.999)
+                << ",\"max_ns\":" << h.max << '}';
+            first = false;
+        }
+        out << "},\"memory\":{"
+            << "\"directories\":" << mem.dirs << ",\"files\":" << mem.files
+            << ",\"node_bytes\":" << mem.nodes << ",\"entry_table_bytes\":" << mem.entryTables
+            << ",\"extent_table_bytes\":" << mem.extentTables << ",\"chunk_bytes\":" << mem.chunks
+            << ",\"mapped_bytes\":" << mem.mapped << "}}\n";
+    }
+
+    void writePrometheus(ostream& out, const MetricsReport& m, const MemoryUse& mem) {
+        out << "# HELP fs_op_duration_seconds Latency of file system operations.\n"
+            << "# TYPE fs_op_duration_seconds summary\n";
+        for (size_t op = 0; op < OP_COUNT; ++op) {
+            const Histogram& h = m.ops[op];
+            if (!h.count) continue;
+            string label = string("op=\"") + opName(static_cast<Op>(op)) + '"';
+            for (double q : {0.5, 0.9, 0.99, 0.999})
+                out << "fs_op_duration_seconds{" << label << ",quantile=\"" << q << "\"} "
+                    << h.percentile(q) / 1e9 << '\n';
+            out << "fs_op_duration_seconds_sum{" << label << "} " << h.sum / 1e9 << '\n'
+                << "fs_op_duration_seconds_count{" << label << "} " << h.count << '\n';
+        }
+        out << "# HELP fs_nodes Live tree nodes.\n"
+            << "# TYPE fs_nodes gauge\n"
+            << "fs_nodes{kind=\"directory\"} " << mem.dirs << '\n'
+            << "fs_nodes{kind=\"file\"} " << mem.files << '\n'
+            << "# HELP fs_memory_bytes Memory held by the tree.\n"
+            << "# TYPE fs_memory_bytes gauge\n"
+            << "fs_memory_bytes{kind=\"nodes\"} " << mem.nodes << '\n'
+            << "fs_memory_bytes{kind=\"entry_tables\"} " << mem.entryTables << '\n'
+            << "fs_memory_bytes{kind=\"extent_tables\"} " << mem.extentTables << '\n'
+            << "fs_memory_bytes{kind=\"chunks\"} " << mem.chunks << '\n'
+            << "fs_memory_bytes{kind=\"mapped\"} " << mem.mapped << '\n';
+    }
+
+    MemoryUse memoryUse(const MetricsReport& m, const NodePool<Directory>& dirs, const NodePool<File>& files) {
+        auto gauge = [&](Gauge g) { return static_cast<uint64_t>(max<int64_t>(0, m.gauges[static_cast<size_t>(g)])); };
+        return {dirs.live(), files.live(), dirs.bytes() + files.bytes(), gauge(Gauge::EntryTableBytes),
+                gauge(Gauge::ExtentTableBytes), gauge(Gauge::ChunkBytes), gauge(Gauge::MappedBytes)};
+    }
+}
+
+bool FileSystem::writeMetrics(const string& filename, bool json) {
+    unique_ptr<MetricsReport> m(new MetricsReport());          // too big for the stack
+    collectMetrics(*m);
+    MemoryUse mem = memoryUse(*m, dirPool, filePool);
+    ofstream out(filename);
+    if (!out) return false;
+    if (json) writeJson(out, *m, mem);
+    else writePrometheus(out, *m, mem);
+    return static_cast<bool>(out);
+}
+
+bool FileSystem::statsCommand(const vector<string>& args) {
+    if (args.size() > 1) {
+        if (args[1] == "reset") { resetMetrics(); return true; }
+        if (args.size() < 3 || (args[1] != "json" && args[1] != "prom")) return false;
+        return writeMetrics(args[2], args[1] == "json");
+    }
+
+    unique_ptr<MetricsReport> m(new MetricsReport());
+    collectMetrics(*m);
+    MemoryUse mem = memoryUse(*m, dirPool, filePool);
+    FormatGuard format(cout);
+    cout << left << setw(18) << "OPERATION" << right << setw(10) << "COUNT" << setw(11) << "MEAN US"
+         << setw(11) << "P50 US" << setw(11) << "P90 US" << setw(11) << "P99 US" << setw(12) << "MAX US" << '\n'
+         << fixed << setprecision(1);
+    for (size_t op = 0; op < OP_COUNT; ++op) {
+        const Histogram& h = m->ops[op];
+        if (!h.count) continue;
+        cout << left << setw(18) << opName(static_cast<Op>(op)) << right << setw(10) << h.count
+             << setw(11) << h.sum / 1e3 / h.count << setw(11) << h.percentile(0.5) / 1e3
+             << setw(11) << h.percentile(0.9) / 1e3 << setw(11) << h.percentile(0.99) / 1e3
+             << setw(12) << h.max / 1e3 << '\n';
+    }
+    cout << setprecision(2)
+         << "NODES: " << mem.dirs << " DIRECTORIES, " << mem.files << " FILES\n"
+         << "CONTENT: " << mem.chunks / 1e6 << " MB IN CHUNKS, " << mem.mapped / 1e6 << " MB MAPPED FROM THE SNAPSHOT\n"
+         << "METADATA: " << mem.metadata() / 1e6 << " MB (NODES " << mem.nodes / 1e6 << ", ENTRY TABLES "
+         << mem.entryTables / 1e6 << ", EXTENT TABLES " << mem.extentTables / 1e6 << ")" << endl;
+    return true;
+}
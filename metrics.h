@@ -0,0 +1,84 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Operation latencies and memory gauges behind the `stats` command.
+//
+// Every thread records into a shard of its own, claimed on first use and
+// handed to the next new thread when it exits, so the hot path is a
+// thread-local lookup and a few relaxed loads and stores: no locks, no
+// shared cache lines.  Readers sum the shards; a reset stores the sums as
+// a baseline instead of clearing counters that other threads own.
+//
+// Latencies go into HDR-style log-linear histograms: 16 buckets per power
+// of two (at most 6.25% error) from 1 ns to about 18 minutes, beyond
+// which values are clamped.  Gauges are sums of signed per-thread deltas,
+// so memory freed on another thread than it was allocated on still adds up.
+
+enum class Op : uint8_t {
+    MakeDir, RemoveDir, RenameDir, MoveDir, CopyDir,
+    CreateFile, RemoveFile, RenameFile, MoveFile, CopyFile,
+    Write, Read, Truncate, List, Navigate, Find, Grep,
+    Save, Load, LoadDirectory, Checkpoint, CheckpointWrite,
+    JournalFlush, JournalReplay, ExportText, ImportText,
+    HostImport, HostExport, RenderTree,
+    COUNT
+};
+
+enum class Gauge : uint8_t {
+    ChunkBytes,              // content chunks on the heap (raw or compressed)
+    MappedBytes,             // content read in place from a snapshot mapping
+    ExtentTableBytes,        // chunk tables of multi-chunk content
+    EntryTableBytes,         // directory entry tables
+    COUNT
+};
+
+constexpr size_t OP_COUNT = static_cast<size_t>(Op::COUNT);
+constexpr size_t GAUGE_COUNT = static_cast<size_t>(Gauge::COUNT);
+
+const char* opName(Op op);              // "mkdir", "copy_dir", ...
+
+class Histogram {
+public:
+    static constexpr unsigned SUB_BITS = 4;
+    static constexpr unsigned MAX_BITS = 40;
+    static constexpr size_t BUCKETS = (MAX_BITS - SUB_BITS + 1) << SUB_BITS;
+
+    static size_t bucketOf(uint64_t ns);
+    static uint64_t upperBound(size_t bucket);      // largest value in it
+
+    uint64_t count = 0, sum = 0, max = 0;           // ns
+    uint64_t buckets[BUCKETS] = {};
+
+    uint64_t percentile(double q) const;            // q in [0, 1]
+};
+
+struct MetricsReport {
+    Histogram ops[OP_COUNT];
+    int64_t gauges[GAUGE_COUNT] = {};
+};
+
+void recordLatency(Op op, uint64_t ns);
+void addGauge(Gauge g, int64_t delta);
+// Histograms since the last reset, gauges as they are now
+void collectMetrics(MetricsReport& out);
+void resetMetrics();
+
+// Records the time from construction to destruction
+class OpTimer {
+public:
+    explicit OpTimer(Op op) : op(op), start(std::chrono::steady_clock::now()) {}
+    ~OpTimer() {
+        auto t = std::chrono::steady_clock::now() - start;
+        recordLatency(op, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(t).count()));
+    }
+    OpTimer(const OpTimer&) = delete;
+    OpTimer& operator=(const OpTimer&) = delete;
+
+    void relabel(Op other) { op = other; }      // once it is known which it was
+
+private:
+    Op op;
+    std::chrono::steady_clock::time_point start;
+};
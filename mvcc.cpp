@@ -0,0 +1,331 @@
+#include "filesystem.h"
+#include "mvcc.h"
+#include "snapshot.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <iostream>
+using namespace std;
+
+/*────────────────────────  VersionStore  ───────────────────────*/
+TreeView VersionStore::pin(Directory* root) {
+    lock_guard<mutex> lock(pinMtx);
+    uint64_t at = epoch.load(memory_order_relaxed);
+    epoch.store(at + 1, memory_order_release);                 // later changes save first
+    live.insert(at);
+    pins.fetch_add(1, memory_order_release);
+    return TreeView(this, at, root);
+}
+
+void VersionStore::unpin(uint64_t at) {
+    vector<Parked> ready;
+    {
+        lock_guard<mutex> lock(pinMtx);
+        live.erase(live.find(at));
+        pins.fetch_sub(1, memory_order_release);
+        uint64_t oldest = live.empty() ? UINT64_MAX : *live.begin();
+
+        // A version tagged below the oldest view can no longer be read
+        for (Stripe& s : stripes) {
+            lock_guard<mutex> g(s.mtx);
+            auto prune = [&](auto& map) {
+                for (auto it = map.begin(); it != map.end();) {
+                    auto& chain = it->second;
+                    size_t keep = 0;
+                    while (keep < chain.size() && chain[keep].upTo < oldest) ++keep;
+                    chain.erase(chain.begin(), chain.begin() + keep);
+                    it = chain.empty() ? map.erase(it) : next(it);
+                }
+            };
+            prune(s.dirs);
+            prune(s.files);
+        }
+        auto split = partition(parked.begin(), parked.end(),
+                               [&](const Parked& p) { return p.epoch > oldest; });
+        move(split, parked.end(), back_inserter(ready));
+        parked.erase(split, parked.end());
+    }
+    for (Parked& p : ready) {
+        if (!p.dirs.empty() || !p.files.empty()) reclaimer.reclaim(move(p.dirs), move(p.files));
+        if (p.tree) reclaimer.reclaimTree(p.tree);
+    }
+}
+
+bool VersionStore::defer(vector<Directory*>& dirs, vector<File*>& files, Directory* tree) {
+    if (!active()) return false;
+    lock_guard<mutex> lock(pinMtx);
+    if (live.empty()) return false;                            // released meanwhile
+    parked.push_back({epoch.load(memory_order_relaxed), move(dirs), move(files), tree});
+    return true;
+}
+
+void VersionStore::readLive(const Directory* dir, Listing& out) {
+    out.dirs.clear();
+    out.files.clear();
+    dir->entries.forEach([&](Directory* d) { out.dirs.push_back({d->name, d}); },
+                         [&](File* f) { out.files.emplace_back(f->name, f); });
+    sort(out.dirs.begin(), out.dirs.end(),
+         [](const ViewDir& a, const ViewDir& b) { return a.name < b.name; });
+    sort(out.files.begin(), out.files.end());
+}
+
+void VersionStore::saveDir(Directory* dir) {
+    uint64_t now = epoch.load(memory_order_acquire);
+    if (dir->mvccEpoch >= now) return;                         // saved (or born) since the last pin
+    dir->entries.load();                                       // a fault takes nodeMtx
+    Stripe& s = stripeOf(dir);
+    lock_guard<mutex> lock(s.mtx);
+    DirVersion v{now - 1, {}};
+    readLive(dir, v.entries);
+    s.dirs[dir].push_back(move(v));
+    dir->mvccEpoch = now;
+}
+
+void VersionStore::saveFile(File* file) {
+    uint64_t now = epoch.load(memory_order_acquire);
+    if (file->mvccEpoch >= now) return;
+    Stripe& s = stripeOf(file);
+    lock_guard<mutex> lock(s.mtx);
+    s.files[file].push_back({now - 1, file->content, file->createdAt, file->modifiedAt});
+    file->mvccEpoch = now;
+}
+
+void VersionStore::listing(uint64_t at, const Directory* dir, Listing& out) const {
+    dir->entries.load();
+    Stripe& s = stripeOf(dir);
+    lock_guard<mutex> lock(s.mtx);
+    auto it = s.dirs.find(dir);
+    if (it != s.dirs.end()) {
+        for (const DirVersion& v : it->second) {
+            if (v.upTo >= at) { out = v.entries; return; }
+        }
+    }
+    readLive(dir, out);
+}
+
+void VersionStore::fileState(uint64_t at, const File* file, ViewFile& out) const {
+    Stripe& s = stripeOf(file);
+    lock_guard<mutex> lock(s.mtx);
+    auto it = s.files.find(file);
+    if (it != s.files.end()) {
+        for (const FileVersion& v : it->second) {
+            if (v.upTo < at) continue;
+            out.shared = v.content.shared();
+            out.content = v.content;
+            out.createdAt = v.createdAt;
+            out.modifiedAt = v.modifiedAt;
+            return;
+        }
+    }
+    out.shared = file->content.shared();                       // before our own reference
+    out.content = file->content;
+    out.createdAt = file->createdAt;
+    out.modifiedAt = file->modifiedAt;
+}
+
+VersionStore::Stats VersionStore::stats() const {
+    Stats st;
+    {
+        lock_guard<mutex> lock(pinMtx);
+        st.pinned = live.size();
+        for (const Parked& p : parked) st.deferredNodes += p.dirs.size() + p.files.size() + (p.tree ? 1 : 0);
+    }
+    for (Stripe& s : stripes) {
+        lock_guard<mutex> lock(s.mtx);
+        for (const auto& c : s.dirs) st.dirVersions += c.second.size();
+        for (const auto& c : s.files) st.fileVersions += c.second.size();
+    }
+    return st;
+}
+
+/*──────────────────────────  TreeView  ─────────────────────────*/
+TreeView::TreeView(TreeView&& other) noexcept : store(other.store), at(other.at), top(other.top) {
+    other.store = nullptr;
+}
+
+TreeView& TreeView::operator=(TreeView&& other) noexcept {
+    if (this != &other) {
+        release();
+        store = other.store;
+        at = other.at;
+        top = other.top;
+        other.store = nullptr;
+    }
+    return *this;
+}
+
+void TreeView::release() {
+    if (store) store->unpin(at);
+    store = nullptr;
+}
+
+void TreeView::listDirs(const Directory* dir, vector<ViewDir>& out) const {
+    out.clear();
+    if (!store) {
+        for (Directory* d : dir->entries.sortedDirs()) out.push_back({d->name, d});
+        return;
+    }
+    VersionStore::Listing l;
+    store->listing(at, dir, l);
+    out = move(l.dirs);
+}
+
+void TreeView::listFiles(const Directory* dir, vector<ViewFile>& out) const {
+    out.clear();
+    if (!store) {
+        for (File* f : dir->entries.sortedFiles()) {
+            bool shared = f->content.shared();                 // before our own reference
+            out.push_back({f->name, f->content, f->createdAt, f->modifiedAt, shared});
+        }
+        return;
+    }
+    VersionStore::Listing l;
+    store->listing(at, dir, l);
+    out.resize(l.files.size());
+    for (size_t i = 0; i < l.files.size(); ++i) {
+        out[i].name = move(l.files[i].first);
+        store->fileState(at, l.files[i].second, out[i]);
+    }
+}
+
+size_t TreeView::fileCount(const Directory* dir) const {
+    if (!store) return dir->entries.fileCount();
+    VersionStore::Listing l;
+    store->listing(at, dir, l);
+    return l.files.size();
+}
+
+Directory* TreeView::findDir(const string& path) const {
+    Directory* dir = top;
+    vector<ViewDir> subs;
+    for (size_t pos = 0; dir && pos < path.size();) {
+        size_t end = path.find('/', pos);
+        if (end == string::npos) end = path.size();
+        string seg = path.substr(pos, end - pos);
+        pos = end + 1;
+        if (seg.empty()) continue;
+        if (!store) { dir = dir->entries.findDir(seg); continue; }
+        listDirs(dir, subs);
+        auto it = lower_bound(subs.begin(), subs.end(), seg,
+                              [](const ViewDir& d, const string& n) { return d.name < n; });
+        dir = (it != subs.end() && it->name == seg) ? it->node : nullptr;
+    }
+    return dir;
+}
+
+bool TreeView::findFile(const string& path, ViewFile& out) const {
+    size_t slash = path.find_last_of('/');
+    string base = slash == string::npos ? path : path.substr(slash + 1);
+    Directory* dir = findDir(slash == string::npos ? string() : path.substr(0, slash));
+    if (!dir || base.empty()) return false;
+    if (!store) {
+        File* f = dir->entries.findFile(base);
+        if (!f) return false;
+        bool shared = f->content.shared();
+        out = {f->name, f->content, f->createdAt, f->modifiedAt, shared};
+        return true;
+    }
+    VersionStore::Listing l;
+    store->listing(at, dir, l);
+    auto it = lower_bound(l.files.begin(), l.files.end(), make_pair(base, static_cast<File*>(nullptr)));
+    if (it == l.files.end() || it->first != base) return false;
+    out.name = base;
+    store->fileState(at, it->second, out);
+    return true;
+}
+
+/*─────────────────  FileSystem: point-in-time views  ───────────*/
+TreeView FileSystem::pinTree() {
+    return versions.pin(root);
+}
+
+// Name search by walking a view (the name index only knows the live tree)
+void FileSystem::searchView(const TreeView& view, const string& pattern, NameMatch mode, size_t limit) {
+    cout << "SEARCH RESULTS:" << endl;
+    vector<string> paths;
+    vector<pair<Directory*, string>> stack{{view.root(), ""}};
+    vector<ViewDir> subs;
+    vector<ViewFile> files;
+    while (!stack.empty() && (!limit || paths.size() < limit)) {
+        Directory* dir = stack.back().first;
+        string path = move(stack.back().second);
+        stack.pop_back();
+        view.listFiles(dir, files);
+        for (const ViewFile& f : files) {
+            if (nameMatches(f.name, pattern, mode) && (!limit || paths.size() < limit))
+                paths.push_back(path + "/" + f.name);
+        }
+        view.listDirs(dir, subs);
+        for (ViewDir& d : subs) stack.push_back({d.node, path + "/" + d.name});
+    }
+    sort(paths.begin(), paths.end());
+    for (const string& p : paths) cout << "  " << p << endl;
+    if (paths.empty()) cout << "  (NO MATCHING FILES)" << endl;
+}
+
+// snapshot                      pin the tree, print the view's id
+// snapshot list | drop ID | tree ID | cat ID PATH | find ID PATTERN | save ID FILE
+bool FileSystem::snapshotCommand(const vector<string>& args) {
+    if (args.size() == 1) {
+        TreeView view = pinTree();
+        uint64_t id = view.epoch();
+        views.emplace(id, move(view));
+        cout << "SNAPSHOT " << id << " PINNED." << endl;
+        return true;
+    }
+    const string& sub = args[1];
+    if (sub == "list") {
+        VersionStore::Stats st = versions.stats();
+        for (const auto& v : views) cout << "  SNAPSHOT " << v.first << endl;
+        cout << st.pinned << " VIEW(S) PINNED, " << st.dirVersions << " DIRECTORY AND "
+             << st.fileVersions << " FILE VERSION(S) KEPT, " << st.deferredNodes
+             << " DELETED NODE(S) WAITING" << endl;
+        return true;
+    }
+    if (args.size() < 3) return false;
+    const string& idText = args[2];
+    if (idText.empty() || !isdigit(static_cast<unsigned char>(idText[0]))) return false;
+    char* end = nullptr;
+    errno = 0;
+    uint64_t id = strtoull(idText.c_str(), &end, 10);
+    if (*end || errno == ERANGE) return false;
+    auto it = views.find(id);
+    if (it == views.end()) {
+        cout << "NO SUCH SNAPSHOT." << endl;
+        return false;
+    }
+    const TreeView& view = it->second;
+    if (sub == "drop") {
+        views.erase(it);
+        releaseSnapshots();                                    // if the view held the last of one
+        return true;
+    }
+    if (sub == "tree") {
+        printTree(view);
+        return true;
+    }
+    if (args.size() < 4) return false;
+    if (sub == "cat") {
+        ViewFile f;
+        if (!view.findFile(args[3], f)) {
+            cout << "FILE NOT FOUND." << endl;
+            return false;
+        }
+        cout << "\n----- FILE CONTENT -----\n" << f.content
+             << "\n------------------------" << endl;
+        return true;
+    }
+    if (sub == "find") {
+        searchView(view, args[3], NameMatch::Substring, 0);
+        return true;
+    }
+    if (sub == "save") {
+        if (isDataFile(args[3])) {                             // it goes with the journal
+            cerr << "NOT SAVING " << args[3] << ": IT IS THE DATA FILE" << endl;
+            return false;
+        }
+        return encodeSnapshot(view, 0).writeTo(args[3]);       // a backup stands alone
+    }
+    return false;
+}
@@ -0,0 +1,169 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "content.h"
+#include "timestamp.h"
+
+struct File;
+class Directory;
+class Reclaimer;
+class VersionStore;
+
+// A directory or file as seen by a TreeView
+struct ViewDir {
+    std::string name;
+    Directory* node;
+};
+
+struct ViewFile {
+    std::string name;
+    Content content;
+    Timestamp createdAt = 0;
+    Timestamp modifiedAt = 0;
+    bool shared = false;                        // content is shared within the tree
+};
+
+// Read-only view of the tree: either the live tree, or a pinned,
+// point-in-time version of it.
+//
+// A pinned view is taken in O(1) and stays the same while the tree keeps
+// changing; it is released when the view is destroyed.  Listings are
+// sorted by name.  The live view reads the nodes directly and is only
+// safe on the thread that owns the tree.
+class TreeView {
+public:
+    TreeView() = default;
+    explicit TreeView(Directory* liveRoot) : top(liveRoot) {}
+    TreeView(TreeView&& other) noexcept;
+    TreeView& operator=(TreeView&& other) noexcept;
+    TreeView(const TreeView&) = delete;
+    TreeView& operator=(const TreeView&) = delete;
+    ~TreeView() { release(); }
+
+    bool pinned() const { return store != nullptr; }
+    uint64_t epoch() const { return at; }
+    Directory* root() const { return top; }
+
+    void listDirs(const Directory* dir, std::vector<ViewDir>& out) const;
+    void listFiles(const Directory* dir, std::vector<ViewFile>& out) const;
+    size_t fileCount(const Directory* dir) const;
+
+    // Absolute path lookups ("." and ".." are not special)
+    Directory* findDir(const std::string& path) const;
+    bool findFile(const std::string& path, ViewFile& out) const;
+
+    void release();
+
+private:
+    friend class VersionStore;
+    TreeView(VersionStore* s, uint64_t e, Directory* r) : store(s), at(e), top(r) {}
+
+    VersionStore* store = nullptr;
+    uint64_t at = 0;
+    Directory* top = nullptr;
+};
+
+// Multi-version bookkeeping behind pinned TreeViews.
+//
+// Nodes are changed in place; versions are kept on the side, and only
+// while a view is pinned.  Pinning bumps a global epoch.  The first time a
+// directory's entries or a file's content / stamps change after a pin,
+// preserve() saves the old state, tagged with the last epoch it was valid
+// for.  Each node remembers the epoch it was created or last saved in
+// (`mvccEpoch`), so later changes in the same epoch, and changes to nodes
+// no view can reach, cost one comparison.  A view of epoch E reads the
+// oldest saved version tagged >= E, and the node itself if there is none;
+// the node cannot change under that read, because changing it would
+// first save a version covering E.  Reads and saves of one node serialize
+// on one of a few dozen striped mutexes, so readers never wait for the
+// tree's writers, only for the copy of a single node.
+//
+// Deleted nodes stay allocated while an older view could still reach
+// them (epoch-based reclamation): defer() parks them with the current
+// epoch and they go to the reclaimer once every view at or below it is
+// released.  Versions nobody can read any more are dropped then as well.
+//
+// The caller must keep pin() from running in the middle of an operation
+// that changes several nodes, so that a view never sees half of one.
+class VersionStore {
+public:
+    struct Stats {
+        size_t pinned = 0;                      // views alive
+        size_t dirVersions = 0, fileVersions = 0;
+        size_t deferredNodes = 0;               // waiting for old views to go
+    };
+
+    explicit VersionStore(Reclaimer& r) : reclaimer(r) {}
+    VersionStore(const VersionStore&) = delete;
+    VersionStore& operator=(const VersionStore&) = delete;
+
+    TreeView pin(Directory* root);
+    bool active() const { return pins.load(std::memory_order_acquire) != 0; }
+    uint64_t current() const { return epoch.load(std::memory_order_acquire); }
+
+    // Call before changing the node (a directory: its entries or the name
+    // of one of them; a file: its content or stamps)
+    void preserve(Directory* dir) { if (active()) saveDir(dir); }
+    void preserve(File* file) { if (active()) saveFile(file); }
+
+    // Takes unlinked nodes (or a whole detached tree) if a view may still
+    // reach them; false means nothing is pinned and the caller frees them
+    bool defer(std::vector<Directory*>& dirs, std::vector<File*>& files, Directory* tree = nullptr);
+
+    Stats stats() const;
+
+private:
+    friend class TreeView;
+    struct Listing {
+        std::vector<ViewDir> dirs;
+        std::vector<std::pair<std::string, File*>> files;
+    };
+    struct DirVersion {
+        uint64_t upTo;                          // last epoch this state was current
+        Listing entries;
+    };
+    struct FileVersion {
+        uint64_t upTo;
+        Content content;
+        Timestamp createdAt, modifiedAt;
+    };
+    struct Stripe {
+        std::mutex mtx;
+        std::unordered_map<const Directory*, std::vector<DirVersion>> dirs;
+        std::unordered_map<const File*, std::vector<FileVersion>> files;
+    };
+    struct Parked {
+        uint64_t epoch;                         // deleted while this epoch was current
+        std::vector<Directory*> dirs;
+        std::vector<File*> files;
+        Directory* tree;
+    };
+    static constexpr size_t STRIPES = 64;
+
+    Stripe& stripeOf(const void* node) const {
+        return stripes[(reinterpret_cast<uintptr_t>(node) >> 6) % STRIPES];
+    }
+    static void readLive(const Directory* dir, Listing& out);
+    void saveDir(Directory* dir);
+    void saveFile(File* file);
+    void listing(uint64_t at, const Directory* dir, Listing& out) const;
+    void fileState(uint64_t at, const File* file, ViewFile& out) const;
+    void unpin(uint64_t at);
+
+    Reclaimer& reclaimer;
+    std::atomic<uint64_t> epoch{1};
+    std::atomic<size_t> pins{0};
+    mutable std::array<Stripe, STRIPES> stripes;
+
+    mutable std::mutex pinMtx;                  // guards live and parked
+    std::multiset<uint64_t> live;               // epochs of the pinned views
+    std::vector<Parked> parked;
+};
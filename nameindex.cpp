@@ -0,0 +1,116 @@
+#include "filesystem.h"
+#include "nameindex.h"
+#include <algorithm>
+using namespace std;
+
+bool nameMatches(const string& name, const string& pattern, NameMatch mode) {
+    if (mode == NameMatch::Exact) return name == pattern;
+    if (mode == NameMatch::Prefix) return name.compare(0, pattern.size(), pattern) == 0;
+    return name.find(pattern) != string::npos;
+}
+
+/*──────────────────────────  NameIndex  ────────────────────────*/
+void NameIndex::addGrams(const string& name, uint32_t id) {
+    if (name.size() < 3) return;                           // found by scanning
+    vector<uint32_t> seen;
+    seen.reserve(name.size() - 2);
+    for (size_t i = 0; i + 3 <= name.size(); ++i) seen.push_back(gram(&name[i]));
+    sort(seen.begin(), seen.end());
+    seen.erase(unique(seen.begin(), seen.end()), seen.end());
+    for (uint32_t g : seen) grams[g].push_back(id);
+}
+
+void NameIndex::add(File* f) {
+    auto it = byName.find(f->name);
+    if (it == byName.end()) {
+        uint32_t id = static_cast<uint32_t>(names.size());
+        it = byName.emplace(f->name, id).first;
+        names.emplace_back();
+        names.back().key = it;
+        names.back().live = true;
+        addGrams(it->first, id);
+    }
+    Name& n = names[it->second];
+    f->indexId = it->second;
+    f->namePrev = nullptr;
+    f->nameNext = n.head;
+    if (n.head) n.head->namePrev = f;
+    n.head = f;
+    ++files;
+}
+
+void NameIndex::remove(File* f) {
+    if (f->indexId == NONE) return;
+    Name& n = names[f->indexId];
+    if (f->namePrev) f->namePrev->nameNext = f->nameNext;
+    else n.head = f->nameNext;
+    if (f->nameNext) f->nameNext->namePrev = f->namePrev;
+    f->nameNext = f->namePrev = nullptr;
+    f->indexId = NONE;
+    --files;
+    if (!n.head) {
+        byName.erase(n.key);
+        n.live = false;
+        if (++dead > 4096 && dead > byName.size()) compact();
+    }
+}
+
+void NameIndex::clear() {
+    byName.clear();
+    names.clear();
+    grams.clear();
+    files = dead = 0;
+}
+
+// Renumbers the live names and rebuilds the postings without the dead ones
+void NameIndex::compact() {
+    vector<Name> live;
+    live.reserve(byName.size());
+    grams.clear();
+    for (auto it = byName.begin(); it != byName.end(); ++it) {
+        uint32_t id = static_cast<uint32_t>(live.size());
+        Name& old = names[it->second];
+        for (File* f = old.head; f; f = f->nameNext) f->indexId = id;
+        live.push_back(move(old));
+        it->second = id;
+        addGrams(it->first, id);
+    }
+    names.swap(live);
+    dead = 0;
+}
+
+bool NameIndex::visitName(const Name& n, const function<bool(File*)>& visit) const {
+    for (File* f = n.head; f; f = f->nameNext)
+        if (!visit(f)) return false;
+    return true;
+}
+
+void NameIndex::search(const string& pattern, NameMatch mode,
+                       const function<bool(File*)>& visit) const {
+    if (mode == NameMatch::Exact) {
+        auto it = byName.find(pattern);
+        if (it != byName.end()) visitName(names[it->second], visit);
+        return;
+    }
+    if (mode == NameMatch::Prefix) {
+        for (auto it = byName.lower_bound(pattern);
+             it != byName.end() && it->first.compare(0, pattern.size(), pattern) == 0; ++it)
+            if (!visitName(names[it->second], visit)) return;
+        return;
+    }
+    if (pattern.size() < 3) {                              // too short for trigrams
+        for (const auto& kv : byName)
+            if (kv.first.find(pattern) != string::npos && !visitName(names[kv.second], visit)) return;
+        return;
+    }
+    const vector<uint32_t>* rarest = nullptr;
+    for (size_t i = 0; i + 3 <= pattern.size(); ++i) {
+        auto g = grams.find(gram(&pattern[i]));
+        if (g == grams.end()) return;                      // some trigram never occurs
+        if (!rarest || g->second.size() < rarest->size()) rarest = &g->second;
+    }
+    for (uint32_t id : *rarest) {
+        const Name& n = names[id];
+        if (n.live && n.key->first.find(pattern) != string::npos && !visitName(n, visit)) return;
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct File;
+
+enum class NameMatch { Exact, Prefix, Substring };
+
+// Whether `name` matches `pattern` the way NameIndex::search finds it
+bool nameMatches(const std::string& name, const std::string& pattern, NameMatch mode);
+
+// Tree-wide index of file names.
+//
+// Every distinct name is stored once together with the files carrying it.
+// Exact and prefix queries walk the ordered name map; substring queries
+// look up the pattern's trigrams and only verify the names listed under
+// the rarest one.  Paths are not stored: a result is turned into a path
+// through the parent pointers, so renaming or moving a directory needs no
+// index update at all.  The files sharing a name are chained through the
+// File nodes themselves (no per-name arrays to grow), so adding and
+// removing are O(1).  Postings of names that died are skipped on lookup
+// and dropped in bulk once they outnumber the live ones.
+class NameIndex {
+public:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    void add(File* f);
+    void remove(File* f);
+    void clear();
+
+    // Calls visit(file) for every match until it returns false
+    void search(const std::string& pattern, NameMatch mode,
+                const std::function<bool(File*)>& visit) const;
+
+    size_t fileCount() const { return files; }
+    size_t nameCount() const { return byName.size(); }
+
+private:
+    using NameMap = std::map<std::string, uint32_t>;
+    struct Name {
+        NameMap::iterator key;
+        bool live = false;
+        File* head = nullptr;                   // chained through File::nameNext
+    };
+
+    static uint32_t gram(const char* p) {
+        return (uint32_t(uint8_t(p[0])) << 16) | (uint32_t(uint8_t(p[1])) << 8) | uint8_t(p[2]);
+    }
+    void addGrams(const std::string& name, uint32_t id);
+    void compact();
+    bool visitName(const Name& n, const std::function<bool(File*)>& visit) const;
+
+    NameMap byName;                             // name -> id
+    std::vector<Name> names;                    // by id
+    std::unordered_map<uint32_t, std::vector<uint32_t>> grams;
+    size_t files = 0;
+    size_t dead = 0;
+};
@@ -0,0 +1,12 @@
+#pragma once
+#include <cstdlib>
+#include <string>
+
+// "1000", "1e6", "2.5e5": a non-negative count or size written without
+// all the zeros.  The whole string must parse and stay below `limit`.
+inline bool parseNumber(const std::string& s, double& v, double limit) {
+    if (s.empty()) return false;
+    char* end = nullptr;
+    v = std::strtod(s.c_str(), &end);
+    return *end == '\0' && v >= 0 && v < limit;
+}
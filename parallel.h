@@ -0,0 +1,58 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Worker count when the caller asked for none: one per core.
+inline unsigned defaultThreads() {
+    unsigned n = std::thread::hardware_concurrency();
+    return n ? n : 1;
+}
+
+// Ordered fan-out shared by grep, query and the host import/export.
+//
+// work(u) runs for every unit u < units on up to `threads` workers, which
+// claim units in increasing order.  ready(u) runs on the calling thread
+// for each unit in order as soon as that unit (and every one before it)
+// is done, so results stream out in the same order a serial loop would
+// give.  ready returning false stops the run: no further units are
+// started and the call returns once the running ones finish.
+inline void runOrdered(size_t units, unsigned threads, const std::function<void(size_t)>& work,
+                       const std::function<bool(size_t)>& ready) {
+    if (!units) return;
+    threads = std::max(1u, std::min<unsigned>(threads, static_cast<unsigned>(std::min<size_t>(units, 1u << 16))));
+    std::unique_ptr<std::atomic<bool>[]> done(new std::atomic<bool>[units]);
+    for (size_t u = 0; u < units; ++u) done[u].store(false, std::memory_order_relaxed);
+    std::atomic<size_t> next{0};
+    std::atomic<bool> stop{false};
+    std::mutex m;
+    std::condition_variable cv;
+
+    auto worker = [&] {
+        for (size_t u; !stop.load(std::memory_order_relaxed) && (u = next.fetch_add(1)) < units;) {
+            work(u);
+            done[u].store(true, std::memory_order_release);
+            std::lock_guard<std::mutex> lock(m);
+            cv.notify_one();
+        }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned i = 0; i < threads; ++i) pool.emplace_back(worker);
+    for (size_t u = 0; u < units; ++u) {
+        if (!done[u].load(std::memory_order_acquire)) {
+            std::unique_lock<std::mutex> lock(m);
+            cv.wait(lock, [&] { return done[u].load(std::memory_order_acquire); });
+        }
+        if (!ready(u)) {
+            stop.store(true, std::memory_order_relaxed);
+            break;
+        }
+    }
+    for (std::thread& t : pool) t.join();
+}
@@ -0,0 +1,153 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <utility>
+#include <vector>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+// Slab allocator for tree nodes.
+//
+// Objects live in fixed-size slots carved out of large chunks.  Slots are
+// handed out by bumping through the newest chunk, so nodes created
+// together (a loaded or copied subtree) end up next to each other; freed
+// slots go on an intrusive free list and are reused first.  releaseAll()
+// destroys every live object with one linear sweep over the chunks and
+// keeps the chunks for the next load, and trim() unmaps them in a handful
+// of calls instead of one free per node.  Chunks come straight from mmap
+// so they never mix with (or force consolidation of) the malloc heap.
+//
+// Everything except retire() belongs to the owning thread.  retire() lets
+// a background thread destroy nodes: their slots are queued on a lock-free
+// list that create() takes over in one exchange once the free list is dry.
+template <class T>
+class NodePool {
+public:
+    explicit NodePool(size_t slotsPerChunk = 4096) : chunkSlots(slotsPerChunk) {}
+    ~NodePool() { trim(); }
+    NodePool(const NodePool&) = delete;
+    NodePool& operator=(const NodePool&) = delete;
+
+    template <class... Args>
+    T* create(Args&&... args) {
+        Slot* s = freeList;
+        if (!s && retired.load(std::memory_order_relaxed))
+            s = retired.exchange(nullptr, std::memory_order_acquire);
+        if (s) {
+            freeList = s->nextFree;
+        } else {
+            if (chunks.empty() || bump == chunkSlots) {
+                if (!chunks.empty()) ++current;
+                if (current == chunks.size()) chunks.push_back(allocChunk());
+                bump = 0;
+            }
+            s = &chunks[current][bump++];
+        }
+        T* obj = new (s->storage) T(std::forward<Args>(args)...);
+        s->live = true;
+        ++liveCount;
+        return obj;
+    }
+
+    void destroy(T* obj) {
+        if (!obj) return;
+        obj->~T();
+        Slot* s = reinterpret_cast<Slot*>(obj);                // storage is first
+        s->live = false;
+        s->nextFree = freeList;
+        freeList = s;
+        --liveCount;
+    }
+
+    // Destroys `n` objects from any thread and queues their slots as one
+    // chain, so a background thread pays for the destructors
+    void retire(T* const* objs, size_t n) {
+        if (!n) return;
+        Slot* head = nullptr;
+        Slot* tail = nullptr;
+        for (size_t i = 0; i < n; ++i) {
+            objs[i]->~T();
+            Slot* s = reinterpret_cast<Slot*>(objs[i]);
+            s->live = false;
+            s->nextFree = head;
+            head = s;
+            if (!tail) tail = s;
+        }
+        tail->nextFree = retired.load(std::memory_order_relaxed);
+        while (!retired.compare_exchange_weak(tail->nextFree, head,
+                                              std::memory_order_release, std::memory_order_relaxed)) {}
+        retiredCount.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    // Destroys every live object; the chunks stay around for reuse.
+    // No retire() may be running.
+    void releaseAll() {
+        for (size_t c = 0; c < chunks.size(); ++c) {
+            size_t n = (c == current) ? bump : (c < current ? chunkSlots : 0);
+            Slot* slots = chunks[c];
+            for (size_t i = 0; i < n; ++i) {
+                if (slots[i].live) {
+                    reinterpret_cast<T*>(slots[i].storage)->~T();
+                    slots[i].live = false;
+                }
+            }
+        }
+        freeList = nullptr;
+        retired.store(nullptr, std::memory_order_relaxed);
+        retiredCount.store(0, std::memory_order_relaxed);
+        current = 0;
+        bump = 0;
+        liveCount = 0;
+    }
+
+    // releaseAll() and hand the chunk memory back to the allocator
+    void trim() {
+        releaseAll();
+        for (Slot* c : chunks) freeChunk(c);
+        chunks.clear();
+    }
+
+    size_t live() const { return liveCount - retiredCount.load(std::memory_order_relaxed); }
+    size_t capacity() const { return chunks.size() * chunkSlots; }
+    size_t bytes() const { return capacity() * sizeof(Slot); }
+
+private:
+    struct Slot {
+        alignas(T) unsigned char storage[sizeof(T)];
+        Slot* nextFree;
+        bool live;
+    };
+
+    // Zero-filled memory is a valid array of free slots (live == false)
+    Slot* allocChunk() {
+#ifndef _WIN32
+        void* p = mmap(nullptr, chunkSlots * sizeof(Slot), PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) throw std::bad_alloc();
+#else
+        void* p = std::calloc(chunkSlots, sizeof(Slot));
+        if (!p) throw std::bad_alloc();
+#endif
+        return static_cast<Slot*>(p);
+    }
+
+    void freeChunk(Slot* c) {
+#ifndef _WIN32
+        munmap(c, chunkSlots * sizeof(Slot));
+#else
+        std::free(c);
+#endif
+    }
+
+    std::vector<Slot*> chunks;
+    Slot* freeList = nullptr;
+    size_t chunkSlots;
+    size_t current = 0;                                        // chunk being bumped through
+    size_t bump = 0;                                           // next slot in that chunk
+    size_t liveCount = 0;
+    std::atomic<Slot*> retired{nullptr};                       // slots freed by retire()
+    std::atomic<size_t> retiredCount{0};
+};
@@ -0,0 +1,439 @@
+#include "filesystem.h"
+#include "query.h"
+#include "metrics.h"
+#include "numparse.h"
+#include "parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdlib>
+#include <functional>
+using namespace std;
+
+/*─────────────────────────  Segment globs  ─────────────────────*/
+SegmentGlob::SegmentGlob(const string& pattern) {
+    bool plain = true;
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        char c = pattern[i];
+        if (c == '\\' && i + 1 < pattern.size()) {
+            tokens.push_back({Token::Char, pattern[++i], 0});
+        } else if (c == '*') {
+            plain = false;
+            if (tokens.empty() || tokens.back().type != Token::Star) tokens.push_back({Token::Star, 0, 0});
+        } else if (c == '?') {
+            plain = false;
+            tokens.push_back({Token::One, 0, 0});
+        } else if (c == '[' && pattern.find(']', i + 2) != string::npos) {
+            size_t j = i + 1;
+            bool negate = pattern[j] == '!' || pattern[j] == '^';
+            if (negate) ++j;
+            bitset<256> set;
+            for (bool first = true; j < pattern.size() && (first || pattern[j] != ']'); first = false, ++j) {
+                unsigned char lo = static_cast<unsigned char>(pattern[j]);
+                if (j + 2 < pattern.size() && pattern[j + 1] == '-' && pattern[j + 2] != ']') {
+                    unsigned char hi = static_cast<unsigned char>(pattern[j + 2]);
+                    for (unsigned ch = lo; ch <= hi; ++ch) set.set(ch);
+                    j += 2;
+                } else {
+                    set.set(lo);
+                }
+            }
+            if (j >= pattern.size()) {                         // "[!]" and the like: a plain '['
+                tokens.push_back({Token::Char, c, 0});
+                continue;
+            }
+            plain = false;
+            if (negate) set.flip();
+            tokens.push_back({Token::Class, 0, static_cast<uint16_t>(classes.size())});
+            classes.push_back(set);
+            i = j;
+        } else {
+            tokens.push_back({Token::Char, c, 0});
+        }
+    }
+
+    // Shapes that need no token matching
+    auto chars = [&](size_t from, size_t to) {
+        string s;
+        for (size_t t = from; t < to; ++t) {
+            if (tokens[t].type != Token::Char) return false;
+            s += tokens[t].c;
+        }
+        fixed = s;
+        return true;
+    };
+    size_t n = tokens.size();
+    if (plain && chars(0, n)) kind = Literal;
+    else if (n == 1 && tokens[0].type == Token::Star) kind = Any;
+    else if (n > 1 && tokens[0].type == Token::Star && chars(1, n)) kind = Suffix;
+    else if (n > 1 && tokens[n - 1].type == Token::Star && chars(0, n - 1)) kind = Prefix;
+    else kind = General;
+}
+
+bool SegmentGlob::match(const string& s) const {
+    switch (kind) {
+    case Literal: return s == fixed;
+    case Any:     return true;
+    case Prefix:  return s.compare(0, fixed.size(), fixed) == 0;
+    case Suffix:  return s.size() >= fixed.size() && s.compare(s.size() - fixed.size(), fixed.size(), fixed) == 0;
+    default:      return matchTokens(s);
+    }
+}
+
+// Backtracks to the last '*' only, so a match costs O(|s| * |tokens|)
+bool SegmentGlob::matchTokens(const string& s) const {
+    size_t t = 0, i = 0, starT = string::npos, starI = 0, n = tokens.size();
+    auto one = [&](const Token& tok, char c) {
+        switch (tok.type) {
+        case Token::Char:  return tok.c == c;
+        case Token::One:   return true;
+        case Token::Class: return classes[tok.cls].test(static_cast<unsigned char>(c));
+        default:           return false;
+        }
+    };
+    while (i < s.size()) {
+        if (t < n && tokens[t].type == Token::Star) {
+            starT = t++;
+            starI = i;
+        } else if (t < n && one(tokens[t], s[i])) {
+            ++t;
+            ++i;
+        } else if (starT != string::npos) {
+            t = starT + 1;
+            i = ++starI;
+        } else {
+            return false;
+        }
+    }
+    while (t < n && tokens[t].type == Token::Star) ++t;
+    return t == n;
+}
+
+/*──────────────────────────  Path globs  ───────────────────────*/
+bool PathGlob::compile(const string& pattern) {
+    segs.clear();
+    size_t begin = 0;
+    while (begin <= pattern.size()) {
+        size_t end = pattern.find('/', begin);
+        if (end == string::npos) end = pattern.size();
+        string seg = pattern.substr(begin, end - begin);
+        begin = end + 1;
+        if (seg.empty() || seg == ".") continue;
+        bool deep = seg == "**";
+        if (deep && !segs.empty() && segs.back().deep) continue;
+        segs.push_back({deep, SegmentGlob(deep ? "*" : seg)});
+    }
+    return !segs.empty() && segs.size() < UINT16_MAX;
+}
+
+void PathGlob::close(States& s) const {
+    for (size_t k = 0; k < s.size(); ++k)
+        if (s[k] < segs.size() && segs[s[k]].deep && find(s.begin(), s.end(), s[k] + 1) == s.end())
+            s.push_back(static_cast<uint16_t>(s[k] + 1));
+    sort(s.begin(), s.end());
+}
+
+PathGlob::States PathGlob::start() const {
+    States s{0};
+    close(s);
+    return s;
+}
+
+PathGlob::States PathGlob::step(const States& in, const string& name) const {
+    States out;
+    for (uint16_t i : in) {
+        if (i >= segs.size()) continue;
+        if (segs[i].deep) out.push_back(i);                    // "**" takes the name and stays
+        else if (segs[i].glob.match(name)) out.push_back(static_cast<uint16_t>(i + 1));
+    }
+    out.erase(unique(out.begin(), out.end()), out.end());
+    close(out);
+    return out;
+}
+
+bool PathGlob::alive(const States& s) const {
+    return !s.empty() && s.front() < segs.size();
+}
+
+bool PathGlob::matches(const States& s, const string& name) const {
+    for (uint16_t i : s)
+        if (i + 1u == segs.size() && (segs[i].deep || segs[i].glob.match(name))) return true;
+    return false;
+}
+
+bool PathGlob::literalChildren(const States& s, vector<string>& names) const {
+    names.clear();
+    for (uint16_t i : s) {
+        if (i >= segs.size()) continue;
+        if (segs[i].deep || !segs[i].glob.literal()) return false;
+        names.push_back(segs[i].glob.text());
+    }
+    sort(names.begin(), names.end());
+    names.erase(unique(names.begin(), names.end()), names.end());
+    return true;
+}
+
+/*──────────────────────────  Query spec  ───────────────────────*/
+namespace {
+    constexpr double MAX_NUMBER = 1e18;                        // sizes and times fit in 64 bits
+
+    // "+N" more than, "-N" less than, "N" exactly
+    bool splitSign(const string& value, char& sign, string& rest) {
+        sign = value.empty() ? 0 : value[0];
+        if (sign != '+' && sign != '-') sign = 0;
+        rest = sign ? value.substr(1) : value;
+        return !rest.empty();
+    }
+
+    // Literal text every match of `re` starts with ("" if unknown)
+    string literalPrefix(const string& re) {
+        if (re.find('|') != string::npos) return "";           // alternatives: no common start
+        string out;
+        size_t i = re.size() && re[0] == '^' ? 1 : 0;
+        for (; i < re.size(); ++i) {
+            char c = re[i];
+            if (c == '\\' && i + 1 < re.size() && !isalnum(static_cast<unsigned char>(re[i + 1]))) {
+                out += re[++i];
+                continue;
+            }
+            if (string("\\.[]()*+?{}|^$").find(c) != string::npos) {
+                if ((c == '*' || c == '?' || c == '{') && !out.empty()) out.pop_back();   // optional
+                break;
+            }
+            out += c;
+        }
+        return out;
+    }
+}
+
+bool QuerySpec::set(const string& option, const string& value) {
+    double d;
+    char sign;
+    string rest;
+    if (option == "path") {                                    // relative: the scope is a separate argument
+        path = value;
+        return !value.empty() && value[0] != '/';
+    }
+    if (option == "name")  { name = value; return !value.empty(); }
+    if (option == "regex") { regex = value; return !value.empty(); }
+    if (option == "type") {
+        if (value != "f" && value != "d") return false;
+        files = value == "f";
+        dirs = !files;
+        return true;
+    }
+    if (option == "size") {
+        if (!splitSign(value, sign, rest)) return false;
+        double unit = 1;
+        switch (rest.back()) {
+        case 'K': case 'k': unit = 1024.0; break;
+        case 'M': case 'm': unit = 1024.0 * 1024; break;
+        case 'G': case 'g': unit = 1024.0 * 1024 * 1024; break;
+        }
+        if (unit > 1) rest.pop_back();
+        if (!parseNumber(rest, d, MAX_NUMBER)) return false;
+        // 2^64 itself is a double: below it the cast is defined, and the
+        // largest double under it leaves room for the +1
+        double bytes = d * unit;
+        if (bytes >= static_cast<double>(UINT64_MAX)) return false;
+        uint64_t n = static_cast<uint64_t>(bytes);
+        if (sign == '+') minSize = n + 1;
+        else if (sign == '-') {
+            if (!n) return false;
+            maxSize = n - 1;
+        } else minSize = maxSize = n;
+        return true;
+    }
+    if (option == "mtime") {                                   // days: +D before, -D within
+        if (!splitSign(value, sign, rest) || !sign || !parseNumber(rest, d, MAX_NUMBER)) return false;
+        Timestamp at = wallClock() - static_cast<Timestamp>(d * 86400e9);
+        if (sign == '+') olderThan = at;
+        else newerThan = at;
+        return true;
+    }
+    if (option == "newer" || option == "older") {
+        Timestamp t;
+        if (!parseTimestamp(value, t)) return false;
+        (option == "newer" ? newerThan : olderThan) = t;
+        return true;
+    }
+    if (option == "n" || option == "j") {
+        if (!parseNumber(value, d, MAX_NUMBER)) return false;
+        if (option == "n") limit = static_cast<uint64_t>(d);
+        else threads = static_cast<unsigned>(min(d, 1024.0));
+        return true;
+    }
+    return false;
+}
+
+bool Query::compile(const QuerySpec& s) {
+    spec = s;
+    if (!path.compile(s.path)) return false;
+    name.reset(s.name.empty() ? nullptr : new SegmentGlob(s.name));
+    regex.reset();
+    regexPrefix.clear();
+    if (!s.regex.empty()) {
+        try {
+            regex.reset(new std::regex(s.regex, std::regex::ECMAScript | std::regex::optimize));
+        } catch (const regex_error&) {
+            return false;
+        }
+        regexPrefix = literalPrefix(s.regex);
+    }
+    return true;
+}
+
+bool Query::regexReaches(const string& dirPath) const {
+    string p = dirPath == "/" ? dirPath : dirPath + "/";
+    size_t n = min(p.size(), regexPrefix.size());
+    return p.compare(0, n, regexPrefix, 0, n) == 0;
+}
+
+/*───────────────────────  FileSystem: query  ───────────────────*/
+// The calling thread cuts the scope into units: a directory whose subtree
+// holds at most GRAIN entries (its recursive totals tell) is one unit,
+// a larger one contributes its own files as a unit and is split further.
+// Workers walk the units; the calling thread prints each unit's matches
+// in order as soon as it is done, so results appear while the walk goes
+// on, in the same order for any number of threads.
+namespace {
+    constexpr uint64_t GRAIN = 4096;
+
+    struct QueryUnit {
+        Directory* dir;
+        string path;                                           // absolute
+        PathGlob::States states;
+        bool whole;                                            // subtree, or dir and its files only
+        bool self;                                             // dir itself matches
+        vector<string> hits;
+    };
+
+    string below(const string& path, const string& name) {
+        return path == "/" ? "/" + name : path + "/" + name;
+    }
+
+    class QueryWalk {
+    public:
+        QueryWalk(const Query& q, const atomic<bool>& stop) : q(q), stop(stop) {}
+
+        // fn(child, path, states, matches) for every subdirectory of `d`
+        // that matches or can hold a match, in name order
+        template <class Fn>
+        void children(Directory* d, const string& path, const PathGlob::States& st, Fn fn) const {
+            auto consider = [&](Directory* c) {
+                string cpath = below(path, c->name);
+                PathGlob::States cst = q.path.step(st, c->name);
+                bool self = dirMatches(c, cpath, st);
+                if (self || (q.path.alive(cst) && reachable(c, cpath))) fn(c, cpath, cst, self);
+            };
+            vector<string> names;
+            if (q.path.literalChildren(st, names)) {
+                for (const string& n : names)
+                    if (Directory* c = d->entries.findDir(n)) consider(c);
+            } else {
+                for (Directory* c : d->entries.sortedDirs()) consider(c);
+            }
+        }
+
+        // `d` itself (if it matches) and its files; with `whole`, its subtree
+        void walk(Directory* d, const string& path, const PathGlob::States& st, bool whole, bool self,
+                  vector<string>& hits) const {
+            if (stop.load(memory_order_relaxed) || full(hits)) return;
+            if (self) hits.push_back(path + "/");
+            if (!q.path.alive(st)) return;
+            if (q.spec.files) {
+                vector<string> names;
+                auto consider = [&](const File* f) {
+                    if (full(hits)) return;
+                    string p = below(path, f->name);
+                    if (fileMatches(f, p, st)) hits.push_back(move(p));
+                };
+                if (q.path.literalChildren(st, names)) {
+                    for (const string& n : names)
+                        if (const File* f = d->entries.findFile(n)) consider(f);
+                } else {
+                    for (const File* f : d->entries.sortedFiles()) consider(f);
+                }
+            }
+            if (!whole) return;
+            children(d, path, st, [&](Directory* c, const string& cpath, const PathGlob::States& cst, bool hit) {
+                walk(c, cpath, cst, true, hit, hits);
+            });
+        }
+
+    private:
+        const Query& q;
+        const atomic<bool>& stop;
+
+        bool full(const vector<string>& hits) const { return q.spec.limit && hits.size() >= q.spec.limit; }
+
+        bool timeOk(Timestamp t) const { return t > q.spec.newerThan && t < q.spec.olderThan; }
+        bool sizeOk(uint64_t n) const { return n >= q.spec.minSize && n <= q.spec.maxSize; }
+        bool nameOk(const string& name, const string& path, const PathGlob::States& parent) const {
+            return (!q.name || q.name->match(name)) && q.path.matches(parent, name)
+                && (!q.regex || regex_match(path, *q.regex));
+        }
+
+        bool fileMatches(const File* f, const string& path, const PathGlob::States& parent) const {
+            return sizeOk(f->content.size()) && timeOk(f->modifiedAt) && nameOk(f->name, path, parent);
+        }
+        bool dirMatches(const Directory* d, const string& path, const PathGlob::States& parent) const {
+            if (!q.spec.dirs) return false;
+            Usage u = d->usage.get();
+            return sizeOk(u.bytes) && timeOk(u.newest) && nameOk(d->name, path, parent);
+        }
+
+        // Whether anything below `d` can pass the size, time and regex
+        // tests; totals only shrink and age going down
+        bool reachable(const Directory* d, const string& path) const {
+            Usage u = d->usage.get();
+            if (!q.spec.dirs && !u.files) return false;
+            if (u.bytes < q.spec.minSize || u.newest <= q.spec.newerThan) return false;
+            return !q.regex || q.regexReaches(path);
+        }
+    };
+}
+
+bool FileSystem::runQuery(const QuerySpec& spec, Directory* scope) {
+    OpTimer timer(Op::Find);
+    Query q;
+    if (!q.compile(spec)) return false;
+    atomic<bool> stop{false};
+    QueryWalk walk(q, stop);
+
+    // ── Units, in walk order ──
+    vector<QueryUnit> units;
+    function<void(Directory*, const string&, const PathGlob::States&, bool)> plan =
+        [&](Directory* d, const string& path, const PathGlob::States& st, bool self) {
+            Usage u = d->usage.get();
+            bool whole = u.files + u.dirs < GRAIN;
+            units.push_back({d, path, st, whole, self, {}});
+            if (whole || !q.path.alive(st)) return;
+            walk.children(d, path, st, [&](Directory* c, const string& cpath, const PathGlob::States& cst, bool hit) {
+                plan(c, cpath, cst, hit);
+            });
+        };
+    plan(scope, pathOf(scope), q.path.start(), false);
+
+    // ── Walked by the workers, printed here in order ──
+    cout << "SEARCH RESULTS:" << endl;
+    uint64_t printed = 0;
+    runOrdered(units.size(), spec.threads ? spec.threads : defaultThreads(), [&](size_t u) {
+        QueryUnit& unit = units[u];
+        walk.walk(unit.dir, unit.path, unit.states, unit.whole, unit.self, unit.hits);
+    }, [&](size_t u) {
+        for (const string& p : units[u].hits) {
+            cout << "  " << p << '\n';
+            if (spec.limit && ++printed >= spec.limit) {
+                stop.store(true, memory_order_relaxed);
+                break;
+            }
+        }
+        if (!spec.limit) printed += units[u].hits.size();
+        units[u].hits = vector<string>();
+        cout.flush();
+        return !stop.load(memory_order_relaxed);
+    });
+    if (!printed) cout << "  (NO MATCHING FILES)" << endl;
+    return true;
+}
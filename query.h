@@ -0,0 +1,99 @@
+#pragma once
+#include <bitset>
+#include <cstdint>
+#include <memory>
+#include <regex>
+#include <string>
+#include <vector>
+#include "timestamp.h"
+
+// `find`-style queries over a subtree (`query` in script mode).
+//
+// A query is compiled once.  Path globs are split at '/' into segment
+// matchers, and the walk carries the set of segments each directory can
+// still continue with (an NFA over the segments, `**` matching any number
+// of directories).  A directory whose set is empty is never entered, and
+// where every remaining segment is a plain name the children are looked
+// up by name instead of listed.  A regex is matched against the whole
+// absolute path; the literal text it starts with prunes every directory
+// outside that prefix.  Size and time predicates prune with the
+// directories' recursive totals (usage.h): a subtree without a large
+// enough or recent enough file is skipped in O(1).
+
+// One path segment: '*', '?', [a-z] / [!a-z] classes and '\' escapes.
+// Plain names, "prefix*" and "*suffix" are compared directly.
+class SegmentGlob {
+public:
+    explicit SegmentGlob(const std::string& pattern = "*");
+    bool match(const std::string& s) const;
+    bool literal() const { return kind == Literal; }
+    const std::string& text() const { return fixed; }     // the name, for literal()
+
+private:
+    enum Kind : uint8_t { Literal, Prefix, Suffix, Any, General };
+    struct Token {
+        enum Type : uint8_t { Char, One, Star, Class } type;
+        char c;
+        uint16_t cls;                                     // into classes
+    };
+    bool matchTokens(const std::string& s) const;
+
+    Kind kind = Any;
+    std::string fixed;                                    // Literal / Prefix / Suffix text
+    std::vector<Token> tokens;
+    std::vector<std::bitset<256>> classes;
+};
+
+// A relative path pattern such as "**/*.csv" or "logs/2024-*/*.txt"
+class PathGlob {
+public:
+    using States = std::vector<uint16_t>;                 // segments still to match, sorted
+
+    bool compile(const std::string& pattern);             // false if empty or too long
+    States start() const;
+    // States below a directory called `name`
+    States step(const States& in, const std::string& name) const;
+    // Whether some entry below can still match
+    bool alive(const States& s) const;
+    // Whether an entry called `name` in a directory with states `s` matches
+    bool matches(const States& s, const std::string& name) const;
+    // The child names a directory's walk can continue with; false if any
+    // name can
+    bool literalChildren(const States& s, std::vector<std::string>& names) const;
+
+private:
+    struct Segment {
+        bool deep;                                        // "**"
+        SegmentGlob glob;
+    };
+    void close(States& s) const;                          // add what "**" skips to
+    std::vector<Segment> segs;
+};
+
+struct QuerySpec {
+    std::string path = "**";                              // glob, relative to the scope
+    std::string name;                                     // glob on the last segment
+    std::string regex;                                    // on the absolute path
+    bool files = true, dirs = false;                      // -type f / d
+    uint64_t minSize = 0, maxSize = UINT64_MAX;           // a directory's size is its total
+    Timestamp newerThan = INT64_MIN, olderThan = INT64_MAX;
+    uint64_t limit = 0;                                   // 0: all
+    unsigned threads = 0;                                 // 0: one per core
+
+    // Sets one option by name ("name", "size", "mtime", ...); false if
+    // the name or the value is invalid
+    bool set(const std::string& option, const std::string& value);
+};
+
+// The compiled form of a QuerySpec
+struct Query {
+    QuerySpec spec;
+    PathGlob path;
+    std::unique_ptr<SegmentGlob> name;
+    std::unique_ptr<std::regex> regex;
+    std::string regexPrefix;                              // every match starts with it
+
+    bool compile(const QuerySpec& s);
+    // Whether a directory at absolute `dirPath` can hold a match of the regex
+    bool regexReaches(const std::string& dirPath) const;
+};
@@ -0,0 +1,92 @@
+#include "filesystem.h"
+#include "reclaim.h"
+#include <utility>
+using namespace std;
+
+namespace {
+    constexpr size_t RETIRE_BATCH = 4096;          // nodes per retire() call
+}
+
+/*──────────────────────────  Reclaimer  ────────────────────────*/
+Reclaimer::~Reclaimer() {
+    {
+        lock_guard<mutex> lock(mtx);
+        stopping = true;
+    }
+    cv.notify_all();
+    if (worker.joinable()) worker.join();
+}
+
+void Reclaimer::reclaim(vector<Directory*> dirs, vector<File*> files) {
+    Batch b;
+    b.dirs = move(dirs);
+    b.files = move(files);
+    post(move(b));
+}
+
+void Reclaimer::reclaimTree(Directory* top) {
+    Batch b;
+    b.tree = top;
+    post(move(b));
+}
+
+void Reclaimer::post(Batch batch) {
+    {
+        lock_guard<mutex> lock(mtx);
+        queue.push_back(move(batch));
+        if (!worker.joinable()) worker = thread(&Reclaimer::workerLoop, this);
+    }
+    cv.notify_all();
+}
+
+void Reclaimer::drain() {
+    unique_lock<mutex> lock(mtx);
+    cv.wait(lock, [&] { return queue.empty() && !busy; });
+}
+
+void Reclaimer::workerLoop() {
+    unique_lock<mutex> lock(mtx);
+    while (true) {
+        cv.wait(lock, [&] { return stopping || !queue.empty(); });
+        if (queue.empty()) return;                             // stopping, nothing left
+        Batch b = move(queue.front());
+        queue.pop_front();
+        busy = true;
+        lock.unlock();
+        release(b);
+        lock.lock();
+        busy = false;
+        cv.notify_all();
+    }
+}
+
+// Runs on the worker.  A tree is walked with an explicit stack and its
+// nodes retired in slices, so neither depth nor size matters.
+void Reclaimer::release(Batch& b) {
+    for (size_t i = 0; i < b.files.size(); i += RETIRE_BATCH)
+        filePool.retire(b.files.data() + i, min(RETIRE_BATCH, b.files.size() - i));
+    for (size_t i = 0; i < b.dirs.size(); i += RETIRE_BATCH)
+        dirPool.retire(b.dirs.data() + i, min(RETIRE_BATCH, b.dirs.size() - i));
+    if (!b.tree) return;
+
+    vector<Directory*> stack{b.tree}, dirs;
+    vector<File*> files;
+    while (!stack.empty()) {
+        Directory* d = stack.back();
+        stack.pop_back();
+        if (d->entries.resident())                             // an unread one has no children yet
+            d->entries.forEach([&](Directory* sub) { stack.push_back(sub); },
+                               [&](File* f) { files.push_back(f); });
+        dirs.push_back(d);
+        if (files.size() >= RETIRE_BATCH) {
+            filePool.retire(files.data(), files.size());
+            files.clear();
+        }
+        if (dirs.size() >= RETIRE_BATCH) {                     // children already queued
+            dirPool.retire(dirs.data(), dirs.size());
+            dirs.clear();
+        }
+    }
+    filePool.retire(files.data(), files.size());
+    dirPool.retire(dirs.data(), dirs.size());
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "pool.h"
+
+struct File;
+class Directory;
+
+// Frees detached subtrees on a background thread.
+//
+// A delete unlinks the subtree and hands its nodes over; the destructors
+// (names, entry tables, content references) and the return of the slots
+// to their pools run here, so the caller gets control back right away.
+// Slots come back through NodePool::retire(), which never races with the
+// owning thread allocating.  The worker starts on first use.
+class Reclaimer {
+public:
+    Reclaimer(NodePool<Directory>& dirs, NodePool<File>& files) : dirPool(dirs), filePool(files) {}
+    ~Reclaimer();
+    Reclaimer(const Reclaimer&) = delete;
+    Reclaimer& operator=(const Reclaimer&) = delete;
+
+    // Nodes already gathered (and unlinked from everything else) by the caller
+    void reclaim(std::vector<Directory*> dirs, std::vector<File*> files);
+    // A whole detached tree; the worker walks it itself
+    void reclaimTree(Directory* top);
+    void drain();                                   // wait until the queue is empty
+
+private:
+    struct Batch {
+        std::vector<Directory*> dirs;
+        std::vector<File*> files;
+        Directory* tree = nullptr;
+    };
+    void post(Batch batch);
+    void workerLoop();
+    void release(Batch& batch);
+
+    NodePool<Directory>& dirPool;
+    NodePool<File>& filePool;
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::deque<Batch> queue;
+    bool busy = false;
+    bool stopping = false;
+    std::thread worker;
+};
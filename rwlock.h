@@ -0,0 +1,62 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Reader/writer spin lock, small enough to live in every Directory.
+//
+// One word: bit 0 is set while a writer holds the lock, bit 1 while a
+// writer is waiting for it, and the rest counts readers.  A waiting
+// writer keeps new readers out, so a directory under steady read traffic
+// (the root, for every path walk) still gets its writes in.  Waiters spin
+// for a short while and then yield the CPU.  Not recursive: a thread
+// must not take the same lock twice.
+class RwLock {
+public:
+    RwLock() = default;
+    RwLock(const RwLock&) = delete;
+    RwLock& operator=(const RwLock&) = delete;
+
+    void lock() {
+        for (unsigned spins = 0;; backoff(spins)) {
+            uint32_t s = state.load(std::memory_order_relaxed);
+            if ((s & ~WAITING) == 0) {
+                if (state.compare_exchange_weak(s, WRITER, std::memory_order_acquire,
+                                                std::memory_order_relaxed)) return;
+            } else if (!(s & WAITING)) {
+                state.fetch_or(WAITING, std::memory_order_relaxed);
+            }
+        }
+    }
+    void unlock() { state.fetch_and(~WRITER, std::memory_order_release); }
+
+    void lock_shared() {
+        for (unsigned spins = 0;; backoff(spins)) {
+            uint32_t s = state.load(std::memory_order_relaxed);
+            if (!(s & (WRITER | WAITING))
+                && state.compare_exchange_weak(s, s + READER, std::memory_order_acquire,
+                                               std::memory_order_relaxed)) return;
+        }
+    }
+    void unlock_shared() { state.fetch_sub(READER, std::memory_order_release); }
+
+private:
+    static constexpr uint32_t WRITER = 1;
+    static constexpr uint32_t WAITING = 2;
+    static constexpr uint32_t READER = 4;
+
+    static void backoff(unsigned& spins) {
+        if (++spins < 64) {
+#if defined(__x86_64__) || defined(__i386__)
+            _mm_pause();
+#endif
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+    std::atomic<uint32_t> state{0};
+};
@@ -0,0 +1,444 @@
+#include "filesystem.h"
+#include "journal.h"
+#include "snapshot.h"
+#include "treegen.h"
+#include "hostio.h"
+#include "query.h"
+#include "fmtguard.h"
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+using namespace std;
+
+/*───────────────────────  Script helpers  ──────────────────────*/
+namespace {
+    // Split a command line on whitespace; "double quotes" keep spaces
+    vector<string> tokenize(const string& line) {
+        vector<string> out;
+        string tok;
+        bool inQuote = false, have = false;
+        for (char c : line) {
+            if (c == '"') { inQuote = !inQuote; have = true; }
+            else if (!inQuote && (c == ' ' || c == '\t' || c == '\r')) {
+                if (have) out.push_back(tok);
+                tok.clear(); have = false;
+            } else { tok += c; have = true; }
+        }
+        if (have) out.push_back(tok);
+        return out;
+    }
+
+    constexpr uint64_t MAX_THREADS = 1024;                    // for -j, as for query threads
+
+    bool parseCount(const string& s, uint64_t& v, uint64_t max = UINT64_MAX) {
+        if (s.empty() || !isdigit(static_cast<unsigned char>(s[0]))) return false;
+        char* end = nullptr;
+        errno = 0;
+        uint64_t n = strtoull(s.c_str(), &end, 10);
+        if (*end != '\0' || errno == ERANGE || n > max) return false;
+        v = n;
+        return true;
+    }
+
+    struct CmdStats {
+        size_t count = 0;
+        size_t failed = 0;
+        chrono::nanoseconds total{0};
+    };
+
+    // Commands whose whole point is to print something
+    bool printsOutput(const string& cmd) {
+        return cmd == "cat" || cmd == "read" || cmd == "ls" || cmd == "tree" || cmd == "find"
+            || cmd == "grep" || cmd == "grepbench" || cmd == "stat" || cmd == "pwd" || cmd == "help" || cmd == "dcache"
+            || cmd == "stress" || cmd == "snapshot" || cmd == "compress" || cmd == "dedup" || cmd == "stats"
+            || cmd == "gentree" || cmd == "du" || cmd == "hostimport" || cmd == "hostexport"
+            || cmd == "query" || cmd == "page" || cmd == "treebench";
+    }
+
+    void scriptHelp() {
+        cout << "SCRIPT COMMANDS (paths starting with '/' are absolute):\n"
+             << "  mkdir [-p] PATH        touch PATH\n"
+             << "  write PATH [TEXT]      append PATH [TEXT]   (no TEXT: lines until EOF)\n"
+             << "  cat PATH               stat PATH\n"
+             << "  read PATH OFFSET LEN   pwrite PATH OFFSET [TEXT]   truncate PATH SIZE\n"
+             << "  rm PATH                rmdir PATH\n"
+             << "  mv PATH DIR            cp PATH DIR\n"
+             << "  rename PATH NEWNAME    find [-prefix|-exact] [-n LIMIT] PATTERN [DIR]\n"
+             << "  query [-name GLOB] [-regex RE] [-type f|d] [-size [+|-]N[K|M|G]] [-mtime [+|-]DAYS]\n"
+             << "        [-newer TIME] [-older TIME] [-n LIMIT] [-j THREADS] [PATTERN [DIR] | /DIR]\n"
+             << "        (PATTERN is relative to DIR: **/*.csv)\n"
+             << "  grep [-n LIMIT] [-j THREADS] TEXT [DIR]   grepbench TEXT [DIR]\n"
+             << "  cd PATH   pwd   ls [-l] [PATH]   reset\n"
+             << "  tree [-depth N] [-format text|jsonl] [-out FILE] [DIR]   treebench [DIR]\n"
+             << "  du [PATH]              du -check [DIR]   (recursive sizes; -check recounts them)\n"
+             << "  page [-n SIZE] [-sort name|mtime|size] [PATH]   page next   (listing in pages)\n"
+             << "  dcache [reset]         (path cache hit/miss counters)\n"
+             << "  stats [reset]          stats json|prom FILE   (operation latencies, memory use)\n"
+             << "  compress [-min BYTES] [-cold SECONDS] [DIR]   compress -auto BYTES   compress -stats [DIR]\n"
+             << "  dedup [DIR]            dedup -stats [DIR]   (share equal blocks across files; offline:\n"
+             << "                         new writes and imports are shared on the next run)\n"
+             << "  stress [-j THREADS] [-n OPS]   (multi-threaded mixed workload)\n"
+             << "  gentree [-n ENTRIES] [-fanout N] [-depth N] [-files N] [-name LEN]\n"
+             << "          [-size fixed:N|uniform:MIN-MAX|lognormal:MEDIAN,SIGMA] [-age DAYS] [-seed S] [DIR]\n"
+             << "  snapshot               (pin a point-in-time view, prints its ID)\n"
+             << "  snapshot list | drop ID | tree ID | cat ID PATH | find ID TEXT | save ID FILE\n"
+             << "  save [FILE]            load FILE            (binary snapshot; *.txt saves text)\n"
+             << "  sync                   (commit the journal; save without FILE checkpoints)\n"
+             << "  export FILE            import FILE          (text format)\n"
+             << "  hostimport [-j THREADS] HOSTDIR [DIR]   hostexport [-j THREADS] HOSTDIR [DIR]\n"
+             << "                         (copy a real directory tree in / out)\n";
+    }
+}
+
+/*────────────────────────  Script mode  ────────────────────────*/
+// Runs one already tokenized command against the tree.  Every command
+// maps onto the same member functions the menus use: the target's parent
+// directory temporarily becomes `curr` for the duration of the call.
+bool FileSystem::runCommand(const vector<string>& args, istream& in) {
+    const string& cmd = args[0];
+    Directory* saved = curr;
+    struct Restore {
+        Directory*& cur; Directory* old;
+        ~Restore() { cur = old; }
+    };
+
+    // Inline TEXT starts at args[first]; `newline` ends it with one
+    auto readBlock = [&](size_t first = 2, bool newline = true) {
+        if (args.size() > first) {
+            string text;
+            for (size_t i = first; i < args.size(); ++i) {
+                if (i > first) text += ' ';
+                text += args[i];
+            }
+            return newline ? text + "\n" : text;
+        }
+        string content, line;
+        while (getline(in, line)) {
+            if (line == "EOF") break;
+            content += line + "\n";
+        }
+        return content;
+    };
+
+    if (cmd == "help") { scriptHelp(); return true; }
+    if (cmd == "pwd") { printPath(); return true; }
+    if (cmd == "tree") return treeCommand(args);
+    if (cmd == "treebench") {
+        Directory* scope = args.size() > 1 ? resolveDir(args[1]) : root;
+        return scope && args.size() <= 2 && treeBench(scope);
+    }
+    if (cmd == "save") {
+        // The data file is only written by a checkpoint, stamped with the
+        // last journal record it holds
+        if (args.size() > 1 && !isDataFile(args[1])) return saveToDisk(args[1]);
+        return checkpoint() && waitForCheckpoint();            // report this one's write too
+    }
+    if (cmd == "sync") return sync();
+    if (cmd == "export") return args.size() > 1 && exportText(args[1]);
+    if (cmd == "import") {
+        if (args.size() < 2 || !importText(args[1])) return false;
+        checkpoint();                                          // not journaled
+        return true;
+    }
+    if (cmd == "load") {
+        if (args.size() < 2 || !isSnapshotFile(args[1])) return false;
+        if (!replaceWithSnapshot(args[1])) return false;       // keeps the tree and the data file
+        checkpoint();
+        return true;
+    }
+    if (cmd == "reset") { clearAll(); return true; }
+    if (cmd == "dcache") {
+        if (args.size() > 1 && args[1] == "reset") { dcache.resetStats(); return true; }
+        const DentryCache::Stats& s = dcache.stats();
+        uint64_t lookups = s.hits + s.misses;
+        cout << "PATH CACHE: " << dcache.size() << '/' << dcache.limit() << " ENTRIES, "
+             << s.hits << " HITS, " << s.misses << " MISSES (" << s.stale << " STALE), "
+             << s.evictions << " EVICTIONS, HIT RATE "
+             << (lookups ? 100 * s.hits / lookups : 0) << "%" << endl;
+        return true;
+    }
+
+    if (cmd == "cd") {
+        Directory* d = resolveDir(args.size() > 1 ? args[1] : "/");
+        if (!d) return false;
+        curr = d;
+        return true;
+    }
+    if (cmd == "ls") {
+        bool detailed = args.size() > 1 && args[1] == "-l";
+        size_t i = detailed ? 2 : 1;
+        Directory* d = resolveDir(i < args.size() ? args[i] : "");
+        if (!d || i + 1 < args.size()) return false;
+        if (detailed) {
+            listLong(d);
+            return true;
+        }
+        Restore r{curr, saved};
+        curr = d;
+        listContents(true);
+        return true;
+    }
+    if (cmd == "find") {
+        NameMatch mode = NameMatch::Substring;
+        uint64_t limit = 0;
+        size_t i = 1;
+        for (; i < args.size() && args[i].size() > 1 && args[i][0] == '-'; ++i) {
+            if (args[i] == "-exact") mode = NameMatch::Exact;
+            else if (args[i] == "-prefix") mode = NameMatch::Prefix;
+            else if (args[i] == "-n" && i + 1 < args.size() && parseCount(args[i + 1], limit)) ++i;
+            else return false;
+        }
+        if (i >= args.size()) return false;
+        Directory* scope = resolveDir(i + 1 < args.size() ? args[i + 1] : "/");
+        if (!scope) return false;
+        searchFiles(args[i], mode, static_cast<size_t>(limit), scope);
+        return true;
+    }
+    if (cmd == "query") {
+        QuerySpec spec;
+        size_t i = 1;
+        for (; i + 1 < args.size() && args[i].size() > 1 && args[i][0] == '-'; i += 2)
+            if (!spec.set(args[i].substr(1), args[i + 1])) return false;
+        // A lone absolute path is the directory to search, with every path matching
+        bool lone = i + 1 == args.size() && args[i][0] == '/';
+        if (i < args.size() && !lone && !spec.set("path", args[i++])) return false;
+        Directory* scope = resolveDir(i < args.size() ? args[i] : "/");
+        if (!scope || i + 1 < args.size()) return false;
+        return runQuery(spec, scope);
+    }
+    if (cmd == "grep" || cmd == "grepbench") {
+        uint64_t limit = 0, threads = 0;
+        size_t i = 1;
+        for (; cmd == "grep" && i + 1 < args.size() && (args[i] == "-n" || args[i] == "-j"); i += 2) {
+            bool jobs = args[i] == "-j";
+            if (!parseCount(args[i + 1], jobs ? threads : limit, jobs ? MAX_THREADS : UINT64_MAX)) return false;
+        }
+        if (i >= args.size()) return false;
+        Directory* scope = resolveDir(i + 1 < args.size() ? args[i + 1] : "/");
+        if (!scope) return false;
+        if (cmd == "grepbench") return grepBench(args[i], scope);
+        return grepContent(args[i], scope, static_cast<size_t>(limit), static_cast<unsigned>(threads));
+    }
+
+    if (cmd == "compress") {
+        uint64_t minSize = 0, cold = 0;
+        size_t i = 1;
+        if (i < args.size() && args[i] == "-auto") {
+            if (i + 1 >= args.size() || !parseCount(args[i + 1], compressAbove)) return false;
+            return !compressAbove || compressFiles(root, compressAbove, 0);
+        }
+        bool stats = i < args.size() && args[i] == "-stats";
+        if (stats) ++i;
+        for (; !stats && i + 1 < args.size() && (args[i] == "-min" || args[i] == "-cold"); i += 2)
+            if (!parseCount(args[i + 1], args[i] == "-min" ? minSize : cold)) return false;
+        Directory* scope = resolveDir(i < args.size() ? args[i] : "/");
+        if (!scope || i + 1 < args.size()) return false;
+        return stats ? compressStats(scope) : compressFiles(scope, minSize, cold);
+    }
+    if (cmd == "dedup") {
+        size_t i = 1;
+        bool stats = i < args.size() && args[i] == "-stats";
+        if (stats) ++i;
+        Directory* scope = resolveDir(i < args.size() ? args[i] : "/");
+        if (!scope || i + 1 < args.size()) return false;
+        return stats ? dedupStats(scope) : dedupFiles(scope);
+    }
+    if (cmd == "snapshot") return snapshotCommand(args);
+    if (cmd == "stats") return statsCommand(args);
+    if (cmd == "du") return duCommand(args);
+    if (cmd == "page") return pageCommand(args);
+    if (cmd == "stress") {
+        uint64_t threads = 0, ops = 100000;
+        for (size_t i = 1; i < args.size(); i += 2) {
+            bool jobs = args[i] == "-j";
+            if (i + 1 >= args.size() || (!jobs && args[i] != "-n")
+                || !parseCount(args[i + 1], jobs ? threads : ops, jobs ? MAX_THREADS : UINT64_MAX)) return false;
+        }
+        return stressBench(static_cast<unsigned>(threads), ops);
+    }
+    if (cmd == "gentree") {
+        TreeSpec spec;
+        size_t i = 1;
+        for (; i + 1 < args.size() && args[i].size() > 1 && args[i][0] == '-'; i += 2)
+            if (!spec.set(args[i].substr(1), args[i + 1])) return false;
+        Directory* at = i < args.size() ? resolveDir(args[i]) : curr;
+        if (!at || i + 1 < args.size()) return false;
+        auto t0 = chrono::steady_clock::now();
+        TreeStats made = generateTree(at, spec);
+        double sec = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+        {
+            FormatGuard format(cout);
+            cout << "GENERATED " << made.dirs << " DIRECTORIES AND " << made.files << " FILES ("
+                 << fixed << setprecision(1) << made.bytes / 1e6 << " MB) IN " << setprecision(2) << sec << " s" << endl;
+        }
+        checkpoint();                                          // not journaled
+        return true;
+    }
+
+    if (cmd == "hostimport" || cmd == "hostexport") {
+        uint64_t threads = 0;
+        size_t i = 1;
+        if (i + 1 < args.size() && args[i] == "-j") {
+            if (!parseCount(args[i + 1], threads, MAX_THREADS)) return false;
+            i += 2;
+        }
+        if (i >= args.size() || i + 2 < args.size()) return false;
+        Directory* dir = i + 1 < args.size() ? resolveDir(args[i + 1]) : curr;
+        if (!dir) return false;
+        HostTransfer stats;
+        bool importing = cmd == "hostimport";
+        bool ok = importing ? importHost(args[i], dir, static_cast<unsigned>(threads), stats)
+                            : exportHost(dir, args[i], static_cast<unsigned>(threads), stats);
+        if (!ok) return false;
+        cout << stats.report(importing ? "IMPORTED" : "EXPORTED") << endl;
+        if (importing) checkpoint();                           // not journaled
+        return !stats.failed;
+    }
+
+    if (args.size() < 2) return false;
+    string base;
+
+    if (cmd == "mkdir" && args[1] == "-p") {
+        if (args.size() < 3) return false;
+        Directory* d = (args[2][0] == '/') ? root : curr;
+        stringstream ss(args[2]);
+        string seg;
+        while (getline(ss, seg, '/')) {
+            if (seg.empty() || seg == ".") continue;
+            if (seg == "..") { if (d->parent) d = d->parent; continue; }
+            Directory* next = d->entries.findDir(seg);
+            if (!next) {
+                Restore r{curr, saved};
+                curr = d;
+                if (!makeDirectory(seg)) return false;
+                next = d->entries.findDir(seg);
+            }
+            d = next;
+        }
+        return true;
+    }
+
+    Directory* parent = resolveParent(args[1], base);
+    if (!parent || base.empty()) {
+        if (cmd == "write" || cmd == "append") readBlock();     // keep stream in sync
+        if (cmd == "pwrite") readBlock(3);
+        return false;
+    }
+    Restore r{curr, saved};
+    curr = parent;
+
+    if (cmd == "mkdir")  return makeDirectory(base);
+    if (cmd == "touch")  return createFile(base);
+    if (cmd == "write")  { string c = readBlock(); return writeFile(base, c, false); }
+    if (cmd == "append") { string c = readBlock(); return writeFile(base, c, true); }
+    if (cmd == "cat")    return readFile(base);
+    if (cmd == "read" || cmd == "truncate") {
+        uint64_t a = 0, b = 0;
+        if (!parseCount(args.size() > 2 ? args[2] : "", a)) return false;
+        if (cmd == "truncate") return truncateFile(base, a);
+        if (!parseCount(args.size() > 3 ? args[3] : "", b)) return false;
+        return readFileRange(base, a, b);
+    }
+    if (cmd == "pwrite") {
+        uint64_t off = 0;
+        bool ok = parseCount(args.size() > 2 ? args[2] : "", off);
+        string c = readBlock(3, false);
+        return ok && writeFileAt(base, off, c);
+    }
+    if (cmd == "stat")   return fileMetadata(base);
+    if (cmd == "rm")     return deleteFileByName(base);
+    if (cmd == "rmdir") {
+        Directory* victim = parent->entries.findDir(base);
+        if (!victim) return false;
+        for (Directory* t = saved; t; t = t->parent)            // cwd inside victim?
+            if (t == victim) { r.old = parent; break; }
+        return deleteDirectoryByName(base);
+    }
+    if (cmd == "rename") {
+        if (args.size() < 3) return false;
+        if (parent->entries.findDir(base)) return renameDirectory(base, args[2]);
+        return renameFile(base, args[2]);
+    }
+    if (cmd == "mv" || cmd == "cp") {
+        if (args.size() < 3) return false;
+        curr = saved;
+        Directory* target = resolveDir(args[2]);
+        curr = parent;
+        if (!target) return false;
+        bool isDir = parent->entries.findDir(base) != nullptr;
+        if (cmd == "mv") return isDir ? moveDirectory(base, target) : moveFile(base, target);
+        return isDir ? copyDirectory(base, target) : copyFile(base, target);
+    }
+
+    cerr << "UNKNOWN COMMAND: " << cmd << endl;
+    return false;
+}
+
+// Executes commands from `in` (one per line, '#' starts a comment) without
+// any prompts and finishes with a per-command throughput summary.
+// Returns the number of failed commands.
+int FileSystem::runScript(istream& in, bool verbose) {
+    map<string, CmdStats> stats;
+    size_t lineNo = 0, failures = 0;
+    string line;
+    auto scriptStart = chrono::steady_clock::now();
+
+    while (getline(in, line)) {
+        ++lineNo;
+        size_t first = line.find_first_not_of(" \t");
+        if (first == string::npos || line[first] == '#') continue;
+        vector<string> args = tokenize(line);
+        if (args.empty()) continue;
+
+        bool ok;
+        auto t0 = chrono::steady_clock::now();
+        {
+            MuteCout mute(!verbose && !printsOutput(args[0]));
+            ok = runCommand(args, in);
+        }
+        if (journal && !journal->healthy()) ok = false;            // nothing since is durable
+        auto t1 = chrono::steady_clock::now();
+
+        CmdStats& st = stats[args[0]];
+        st.count++;
+        st.total += chrono::duration_cast<chrono::nanoseconds>(t1 - t0);
+        if (!ok) {
+            st.failed++;
+            failures++;
+            cerr << "LINE " << lineNo << ": FAILED: " << line << endl;
+        }
+    }
+
+    if (journal && !journal->commit()) {
+        failures++;
+        cerr << "JOURNAL NOT WRITTEN: THE SCRIPT'S CHANGES ARE NOT DURABLE" << endl;
+    }
+
+    double wall = chrono::duration<double>(chrono::steady_clock::now() - scriptStart).count();
+    size_t total = 0;
+    FormatGuard format(cout);
+    cout << "\n========== SCRIPT SUMMARY ==========\n"
+         << left << setw(10) << "COMMAND" << right << setw(10) << "COUNT"
+         << setw(8) << "FAILED" << setw(12) << "TOTAL MS" << setw(14) << "OPS/SEC" << '\n';
+    for (const auto& s : stats) {
+        double ms = s.second.total.count() / 1e6;
+        double rate = ms > 0 ? s.second.count / (ms / 1000.0) : 0.0;
+        cout << left << setw(10) << s.first << right << setw(10) << s.second.count
+             << setw(8) << s.second.failed << setw(12) << fixed << setprecision(2) << ms
+             << setw(14) << setprecision(0) << rate << '\n';
+        total += s.second.count;
+    }
+    cout << "TOTAL: " << total << " COMMANDS IN " << setprecision(3) << wall << " s ("
+         << setprecision(0) << (wall > 0 ? total / wall : 0.0) << " OPS/SEC), "
+         << failures << " FAILED\n"
+         << "====================================" << endl;
+    return (int)failures;
+}
@@ -0,0 +1,762 @@
+#include "filesystem.h"
+#include "snapshot.h"
+#include "metrics.h"
+#include "journal.h"
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+using namespace std;
+
+/*──────────────────────────  MappedFile  ───────────────────────*/
+MappedFile::MappedFile(const string& path) {
+#ifndef _WIN32
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            data_ = static_cast<const char*>(p);
+            size_ = st.st_size;
+            mapped_ = true;
+        }
+    }
+    close(fd);
+#else
+    ifstream in(path, ios::binary | ios::ate);
+    if (!in) return;
+    size_t len = static_cast<size_t>(in.tellg());
+    if (!len) return;
+    char* buf = new char[len];
+    in.seekg(0);
+    if (!in.read(buf, static_cast<streamsize>(len))) { delete[] buf; return; }
+    data_ = buf;
+    size_ = len;
+#endif
+}
+
+MappedFile::~MappedFile() {
+    if (!data_) return;
+#ifndef _WIN32
+    if (mapped_) munmap(const_cast<char*>(data_), size_);
+#else
+    delete[] data_;
+#endif
+}
+
+bool isSnapshotFile(const string& path) {
+    ifstream in(path, ios::binary);
+    char magic[8];
+    return in.read(magic, sizeof(magic)) && memcmp(magic, SNAP_MAGIC, sizeof(magic)) == 0;
+}
+
+bool syncParentDir(const string& path) {
+#ifndef _WIN32
+    size_t slash = path.find_last_of('/');
+    string dir = slash == string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) return false;
+    bool ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+#else
+    (void)path;
+    return true;
+#endif
+}
+
+/*───────────────────────  Snapshot writer  ─────────────────────*/
+// The directory table is built in one BFS pass.  The files are then cut
+// into parts of whole directories (the cut depends only on the tree, so
+// the output is the same for any number of threads), and each part is
+// encoded on a worker into its own buffers with part-relative offsets.
+// A short sequential pass decides which part stores each shared content
+// and where every part lands; the workers then rebase their records.
+namespace {
+    constexpr size_t PART_FILES = 32 * 1024;                  // files per part
+    constexpr uint64_t PACK_LIMIT = 16 * 1024;                 // smaller content is copied
+
+    template <class T>
+    void putRecord(string& buf, const T& rec) {
+        buf.append(reinterpret_cast<const char*>(&rec), sizeof(rec));
+    }
+
+    uint64_t addString(string& strings, const string& s) {
+        uint64_t off = strings.size();
+        strings += s;
+        return off;
+    }
+
+    // A stretch of the content region: packed bytes or one pinned content
+    struct DataRun {
+        uint64_t localOff, len;
+        size_t packedOff;
+        Content pinned;                                        // empty: packed
+        const void* identity;                                  // shared content, or nullptr
+        uint64_t globalOff;                                    // where the run starts in the output
+        bool skip;                                             // stored by an earlier part ...
+        uint64_t storedAt;                                     // ... at this offset
+    };
+
+    // A chunk some block list refers to; a chunk is told apart by its
+    // identity and length, since a truncated copy may share a longer one
+    using BlockKey = pair<const void*, uint32_t>;
+    struct BlockKeyHash {
+        size_t operator()(const BlockKey& k) const { return hash<const void*>()(k.first) ^ k.second; }
+    };
+    struct PartBlock {
+        BlockKey key;
+        const char* bytes;
+        uint64_t stored;
+        uint64_t globalOff;                                    // where it is, in this part or before
+        bool write;                                            // first stored by this part
+    };
+
+    struct EncodedPart {
+        size_t firstDir, endDir, fileCount = 0;
+        string strings, files, packed;
+        vector<SnapUsage> own;                                 // files directly in each directory
+        vector<DataRun> runs;
+        vector<PartBlock> blocks;
+        vector<size_t> blockRefs;                              // BlockRefs in `packed`, off = index into blocks
+        vector<Content> lists;                                 // keeps the blocks alive
+        uint64_t dataSize = 0;
+        uint64_t strBase = 0, dataBase = 0;
+    };
+
+    void putBlockList(EncodedPart& part, unordered_map<BlockKey, size_t, BlockKeyHash>& index, const Content& c) {
+        c.forEachBlock([&](const void* id, const char* bytes, uint32_t packed, uint32_t len) {
+            auto ins = index.emplace(BlockKey(id, len), part.blocks.size());
+            if (ins.second) part.blocks.push_back({ins.first->first, bytes, packed ? packed : len, 0, false});
+            part.blockRefs.push_back(part.packed.size());
+            putRecord(part.packed, SnapBlock{ins.first->second, packed, len});
+        });
+        part.lists.push_back(c);
+    }
+
+    // A directory to encode: a node, or one still unread in a snapshot,
+    // which is listed straight from that file instead of being read in
+    struct EncodeDir {
+        Directory* node;
+        const LazySnapshot* snap;
+        uint64_t index;
+    };
+
+    EncodeDir encodeDir(Directory* node) {
+        uint64_t index = 0;
+        EntrySource* src = node->entries.unreadSource(index);
+        return {node, static_cast<const LazySnapshot*>(src), index};
+    }
+
+    void encodePart(EncodedPart& part, const vector<EncodeDir>& order, const TreeView& view) {
+        unordered_map<const void*, uint64_t> sharedAt;         // identity -> local offset
+        unordered_map<BlockKey, size_t, BlockKeyHash> blockIndex;
+        part.files.reserve(part.fileCount * sizeof(SnapFile));
+        part.own.assign(part.endDir - part.firstDir, SnapUsage{});
+        vector<ViewFile> listing;
+        for (size_t i = part.firstDir; i < part.endDir; ++i) {
+            if (order[i].snap) order[i].snap->readFiles(order[i].index, listing);
+            else view.listFiles(order[i].node, listing);
+            SnapUsage& own = part.own[i - part.firstDir];
+            for (const ViewFile& f : listing) {
+                const Content& c = f.content;
+                own.bytes += c.size();
+                own.files++;
+                own.newest = max(own.newest, f.modifiedAt);
+                SnapFile rec{};
+                rec.parent     = static_cast<uint32_t>(i);
+                rec.nameLen    = static_cast<uint32_t>(f.name.size());
+                rec.nameOff    = addString(part.strings, f.name);
+                rec.createdAt  = f.createdAt;
+                rec.modifiedAt = f.modifiedAt;
+                rec.dataLen    = c.size();
+                rec.dataOff    = part.dataSize;
+                if (rec.dataLen) {
+                    bool blocks = c.savedAsBlocks();
+                    if (blocks) {
+                        uint64_t count = 0;
+                        c.forEachBlock([&](const void*, const char*, uint32_t, uint32_t) { ++count; });
+                        rec.packedLen = count * sizeof(SnapBlock);
+                    }
+                    uint64_t stored = blocks ? rec.packedLen : rec.dataLen;
+                    bool shared = f.shared;
+                    auto ins = shared ? sharedAt.emplace(c.identity(), rec.dataOff)
+                                      : make_pair(sharedAt.end(), true);
+                    if (!ins.second) {
+                        rec.dataOff = ins.first->second;       // store shared bytes once
+                    } else if (!blocks && (shared || stored >= PACK_LIMIT)) {
+                        part.runs.push_back({rec.dataOff, stored, 0, c,
+                                             shared ? c.identity() : nullptr, 0, false, 0});
+                        part.dataSize += stored;
+                    } else {
+                        // Copied: small content, or the block list
+                        if (shared || part.runs.empty() || !part.runs.back().pinned.empty() || part.runs.back().identity)
+                            part.runs.push_back({rec.dataOff, 0, part.packed.size(), Content(),
+                                                 shared ? c.identity() : nullptr, 0, false, 0});
+                        part.runs.back().len += stored;
+                        if (blocks) putBlockList(part, blockIndex, c);
+                        else c.forEachPiece([&](const char* p, size_t n) { part.packed.append(p, n); });
+                        part.dataSize += stored;
+                    }
+                }
+                putRecord(part.files, rec);
+            }
+        }
+        part.fileCount = part.files.size() / sizeof(SnapFile);
+    }
+
+    // Rebases the part's records onto the final string and content
+    // regions, and its block lists onto the blocks' offsets
+    void rebasePart(EncodedPart& part) {
+        for (size_t at : part.blockRefs) {
+            SnapBlock ref;
+            memcpy(&ref, &part.packed[at], sizeof(ref));
+            ref.off = part.blocks[ref.off].globalOff;
+            memcpy(&part.packed[at], &ref, sizeof(ref));
+        }
+        SnapFile* recs = reinterpret_cast<SnapFile*>(&part.files[0]);
+        size_t count = part.files.size() / sizeof(SnapFile);
+        for (size_t i = 0; i < count; ++i) {
+            SnapFile& rec = recs[i];
+            rec.nameOff += part.strBase;
+            auto it = upper_bound(part.runs.begin(), part.runs.end(), rec.dataOff,
+                                  [](uint64_t off, const DataRun& r) { return off < r.localOff; });
+            if (it == part.runs.begin()) rec.dataOff = part.dataBase;
+            else {
+                const DataRun& r = *--it;
+                if (r.skip) rec.dataOff = rec.dataLen ? r.storedAt : r.globalOff;
+                else rec.dataOff = r.globalOff + (rec.dataOff - r.localOff);
+            }
+        }
+    }
+
+    template <class Fn>
+    void forEachParallel(size_t count, Fn fn) {
+        unsigned threads = max(1u, min<unsigned>(thread::hardware_concurrency(), static_cast<unsigned>(count)));
+        atomic<size_t> next{0};
+        auto worker = [&] {
+            for (size_t i; (i = next.fetch_add(1)) < count;) fn(i);
+        };
+        vector<thread> pool;
+        for (unsigned t = 1; t < threads; ++t) pool.emplace_back(worker);
+        worker();
+        for (thread& t : pool) t.join();
+    }
+}
+
+// Reads the tree only through `view`, so a pinned view can be encoded on
+// a background thread while the tree keeps changing.  A directory that is
+// still unread is never read in (that would change the tree under the
+// foreground): it and everything below it come from its snapshot, which
+// holds them as they were when the view was taken.
+SnapshotImage FileSystem::encodeSnapshot(const TreeView& view, uint64_t journalSeq) {
+    SnapshotImage img;
+    string dirStrings, dirs;
+    vector<EncodeDir> order{encodeDir(view.root())};           // BFS order
+    vector<uint32_t> parents{0};
+
+    SnapDir rootRec{0, 0, 0};
+    putRecord(dirs, rootRec);
+    vector<EncodedPart> parts;
+    vector<ViewDir> subs;
+    vector<pair<string, uint64_t>> unreadSubs;
+    for (size_t i = 0; i < order.size(); ++i) {
+        auto add = [&](const string& name, EncodeDir dir) {
+            SnapDir rec{};
+            rec.parent  = static_cast<uint32_t>(i);
+            rec.nameLen = static_cast<uint32_t>(name.size());
+            rec.nameOff = addString(dirStrings, name);
+            putRecord(dirs, rec);
+            order.push_back(dir);
+            parents.push_back(rec.parent);
+        };
+        EncodeDir dir = order[i];
+        if (dir.snap) {
+            dir.snap->readDirs(dir.index, unreadSubs);
+            for (const auto& d : unreadSubs) add(d.first, {nullptr, dir.snap, d.second});
+        } else {
+            view.listDirs(dir.node, subs);
+            for (const ViewDir& d : subs) add(d.name, encodeDir(d.node));
+        }
+        if (parts.empty() || parts.back().fileCount >= PART_FILES) {
+            parts.emplace_back();
+            parts.back().firstDir = i;
+        }
+        parts.back().endDir = i + 1;
+        parts.back().fileCount += dir.snap ? dir.snap->fileRecords(dir.index) : view.fileCount(dir.node);
+    }
+
+    forEachParallel(parts.size(), [&](size_t p) { encodePart(parts[p], order, view); });
+
+    // Directory totals: own files, then children into parents bottom-up
+    vector<SnapUsage> totals(order.size());
+    for (const EncodedPart& part : parts)
+        copy(part.own.begin(), part.own.end(), totals.begin() + part.firstDir);
+    for (size_t i = order.size(); i-- > 1;) {
+        SnapUsage& p = totals[parents[i]];
+        p.bytes += totals[i].bytes;
+        p.files += totals[i].files;
+        p.dirs += totals[i].dirs + 1;
+        p.newest = max(p.newest, totals[i].newest);
+    }
+
+    uint64_t strBase = dirStrings.size(), dataBase = 0, fileCount = 0;
+    unordered_map<const void*, uint64_t> sharedAt;             // identity -> global offset
+    for (EncodedPart& part : parts) {
+        part.strBase = strBase;
+        part.dataBase = dataBase;
+        strBase += part.strings.size();
+        for (DataRun& r : part.runs) {
+            r.globalOff = dataBase;
+            if (r.identity) {
+                auto ins = sharedAt.emplace(r.identity, dataBase);
+                if (!ins.second) { r.skip = true; r.storedAt = ins.first->second; continue; }
+            }
+            dataBase += r.len;
+        }
+        fileCount += part.fileCount;
+    }
+    // Every chunk a block list refers to is stored once, after all parts
+    unordered_map<BlockKey, uint64_t, BlockKeyHash> blockAt;
+    for (EncodedPart& part : parts) {
+        for (PartBlock& b : part.blocks) {
+            auto ins = blockAt.emplace(b.key, dataBase);
+            b.globalOff = ins.first->second;
+            b.write = ins.second;
+            if (b.write) dataBase += b.stored;
+        }
+    }
+    forEachParallel(parts.size(), [&](size_t p) { rebasePart(parts[p]); });
+
+    // Output order: strings (dirs, then each part), directory table,
+    // usage table, file tables, content
+    auto blob = [&](string&& s) {
+        uint64_t len = s.size();
+        if (len) {
+            img.layout.push_back({false, static_cast<uint32_t>(img.blobs.size()), 0, len});
+            img.blobs.push_back(move(s));
+        }
+        return len;
+    };
+    uint64_t strSize = blob(move(dirStrings));
+    for (EncodedPart& part : parts) strSize += blob(move(part.strings));
+    strSize += blob(string((8 - strSize % 8) % 8, '\0'));
+    uint64_t dirSize = blob(move(dirs));
+    dirSize += blob(string(reinterpret_cast<const char*>(totals.data()), totals.size() * sizeof(SnapUsage)));
+    for (EncodedPart& part : parts) blob(move(part.files));
+    for (EncodedPart& part : parts) {
+        uint32_t packed = static_cast<uint32_t>(img.blobs.size());
+        img.blobs.push_back(move(part.packed));
+        for (DataRun& r : part.runs) {
+            if (r.skip) continue;
+            if (r.pinned.empty()) {
+                img.layout.push_back({false, packed, r.packedOff, r.len});
+            } else {
+                img.layout.push_back({true, static_cast<uint32_t>(img.pinned.size()), 0, r.len});
+                img.pinned.push_back(move(r.pinned));
+            }
+        }
+    }
+    for (EncodedPart& part : parts) {
+        for (const PartBlock& b : part.blocks)
+            if (b.write) img.layout.push_back({false, 0, 0, b.stored, b.bytes});
+        for (Content& c : part.lists) img.pinned.push_back(move(c));
+    }
+
+    SnapHeader& h = img.header;
+    memcpy(h.magic, SNAP_MAGIC, sizeof(h.magic));
+    h.version   = SNAP_VERSION;
+    h.byteOrder = SNAP_BYTEORDER;
+    h.dirCount  = order.size();
+    h.fileCount = fileCount;
+    h.strOff    = sizeof(SnapHeader);
+    h.strSize   = strSize;
+    h.dirOff    = h.strOff + strSize;
+    h.fileOff   = h.dirOff + dirSize;
+    h.dataOff   = h.fileOff + fileCount * sizeof(SnapFile);
+    h.dataSize  = dataBase;
+    h.journalSeq = journalSeq;
+    return img;
+}
+
+// Only the data file goes with the journal; any other file stands alone,
+// so nothing is ever replayed on top of it
+bool FileSystem::saveSnapshot(const string& filename) {
+    OpTimer timer(Op::Save);
+    uint64_t seq = isDataFile(filename) ? snapshotSeq : 0;
+    return encodeSnapshot(TreeView(root), seq).writeTo(filename);
+}
+
+namespace {
+#ifndef _WIN32
+    // writev() the whole batch, resuming after short writes
+    bool writeBatch(int fd, vector<iovec>& iov) {
+        size_t i = 0;
+        while (i < iov.size()) {
+            int cnt = static_cast<int>(min<size_t>(iov.size() - i, IOV_MAX));
+            ssize_t n = writev(fd, &iov[i], cnt);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            size_t done = static_cast<size_t>(n);
+            for (; i < iov.size() && done >= iov[i].iov_len; ++i) done -= iov[i].iov_len;
+            if (done) {
+                iov[i].iov_base = static_cast<char*>(iov[i].iov_base) + done;
+                iov[i].iov_len -= done;
+            }
+        }
+        iov.clear();
+        return true;
+    }
+#endif
+}
+
+bool SnapshotImage::writeTo(const string& filename) const {
+    // Write next to the target, fsync and rename, so a crash leaves either
+    // the old or the new snapshot but never a torn one
+    string tmp = filename + ".tmp";
+    bool ok = true;
+#ifndef _WIN32
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    vector<iovec> iov;
+    auto put = [&](const char* p, size_t n) {
+        if (!ok || !n) return;
+        iov.push_back({const_cast<char*>(p), n});
+        if (iov.size() >= 4 * IOV_MAX) ok = writeBatch(fd, iov);
+    };
+#else
+    FILE* out = fopen(tmp.c_str(), "wb");
+    if (!out) return false;
+    auto put = [&](const char* p, size_t n) {
+        ok = ok && fwrite(p, 1, n, out) == n;
+    };
+#endif
+    put(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const Segment& s : layout) {
+        if (s.bytes) put(s.bytes, static_cast<size_t>(s.len));
+        else if (s.pinned) pinned[s.index].forEachPiece(s.off, s.len, put);
+        else put(blobs[s.index].data() + s.off, static_cast<size_t>(s.len));
+    }
+#ifndef _WIN32
+    ok = ok && writeBatch(fd, iov);
+    ok = ok && fsync(fd) == 0;
+    ok = (close(fd) == 0) && ok;
+#else
+    ok = ok && fflush(out) == 0;
+    ok = ok && _commit(_fileno(out)) == 0;
+    ok = (fclose(out) == 0) && ok;
+#endif
+    if (!ok) return false;
+#ifdef _WIN32
+    remove(filename.c_str());
+#endif
+    // The rename itself is only durable once the directory is synced;
+    // until then the caller must keep whatever the old file stood for
+    return rename(tmp.c_str(), filename.c_str()) == 0 && syncParentDir(filename);
+}
+
+/*───────────────────────  Snapshot loader  ─────────────────────*/
+bool FileSystem::loadSnapshot(const string& filename) {
+    OpTimer timer(Op::Load);
+    auto lazy = make_shared<LazySnapshot>(*this, filename);
+    if (!lazy->open(root)) return false;
+    snapshotSeq = lazy->header().journalSeq;
+    curr = root;
+    lazySnapshots.push_back(move(lazy));
+    return true;
+}
+
+// `load FILE`: the snapshot's tree replaces the current one only once it
+// has loaded; a file that does not load leaves the current tree as it was
+bool FileSystem::replaceWithSnapshot(const string& filename) {
+    Directory* kept = root;
+    Directory* keptCurr = curr;
+    NameIndex keptIndex = move(nameIndex);
+    nameIndex.clear();
+    dcache.clear();
+    root = newDirectory("root", nullptr);
+    curr = root;
+    bool ok = loadSnapshot(filename);
+    Directory* dropped = ok ? kept : root;
+    if (!ok) {
+        nameIndex = move(keptIndex);
+        dcache.clear();
+        root = kept;
+        curr = keptCurr;
+    }
+    vector<Directory*> dirs;
+    vector<File*> files;
+    if (!versions.defer(dirs, files, dropped)) reclaimer.reclaimTree(dropped);
+    if (ok) logOp(J_CLEAR, {});
+    releaseSnapshots();                                        // the old tree's, once it is freed
+    return ok;
+}
+
+// Called where no other thread can be reading a snapshot of its own
+// accord; one that is still being freed (or pinned by a view) stays
+// until a later call
+void FileSystem::releaseSnapshots() {
+    lazySnapshots.erase(remove_if(lazySnapshots.begin(), lazySnapshots.end(),
+                                  [](const shared_ptr<LazySnapshot>& snap) { return snap->idle(); }),
+                        lazySnapshots.end());
+}
+
+void FileSystem::loadAll() {
+    bool complete = true;
+    for (const auto& snap : lazySnapshots) complete = complete && snap->complete();
+    if (complete) return;
+    vector<Directory*> stack{root};
+    while (!stack.empty()) {
+        Directory* d = stack.back();
+        stack.pop_back();
+        d->entries.forEach([&](Directory* sub) { stack.push_back(sub); }, [](File*) {});
+    }
+}
+
+// `find` below `scope` in the directories not read yet: each snapshot's
+// file table is searched once for all of its unread directories there
+void FileSystem::searchUnread(const string& pattern, NameMatch mode, size_t limit, Directory* scope,
+                              vector<string>& paths) {
+    bool complete = true;
+    for (const auto& snap : lazySnapshots) complete = complete && snap->complete();
+    if (complete) return;
+    unordered_map<const LazySnapshot*, unordered_map<uint64_t, Directory*>> tops;
+    vector<Directory*> stack{scope};
+    while (!stack.empty()) {
+        Directory* d = stack.back();
+        stack.pop_back();
+        uint64_t index = 0;
+        if (EntrySource* src = d->entries.unreadSource(index)) {
+            tops[static_cast<const LazySnapshot*>(src)][index] = d;
+            continue;
+        }
+        d->entries.forEach([&](Directory* sub) { stack.push_back(sub); }, [](File*) {});
+    }
+    for (const auto& t : tops) {
+        bool more = t.first->findFiles(t.second, pattern, mode, [&](Directory* top, const string& rel) {
+            paths.push_back(childPath(top, rel));
+            return !limit || paths.size() < limit;
+        });
+        if (!more) return;
+    }
+}
+
+namespace {
+    // Whether `count` records of `size` bytes at `off` end within `limit`;
+    // cannot overflow, whatever the header says
+    bool fits(uint64_t off, uint64_t count, uint64_t size, uint64_t limit) {
+        return off <= limit && count <= (limit - off) / size;
+    }
+
+    // The string, directory, file and data tables follow the header in
+    // that order, without overlapping, and end within the file
+    bool tablesFit(const SnapHeader& h, uint64_t dirRec, uint64_t fileRec, uint64_t fileSize) {
+        return h.strOff >= sizeof(SnapHeader) && fits(h.strOff, h.strSize, 1, fileSize)
+            && h.dirOff >= h.strOff + h.strSize && fits(h.dirOff, h.dirCount, dirRec, fileSize)
+            && h.fileOff >= h.dirOff + h.dirCount * dirRec && fits(h.fileOff, h.fileCount, fileRec, fileSize)
+            && h.dataOff >= h.fileOff + h.fileCount * fileRec && fits(h.dataOff, h.dataSize, 1, fileSize);
+    }
+}
+
+LazySnapshot::LazySnapshot(FileSystem& fs, const string& path) : fs(fs), path(path), map(path) {}
+
+bool LazySnapshot::open(Directory* root) {
+    if (!map.ok() || map.size() < sizeof(SnapHeader)) return false;
+    memcpy(&h, map.data(), sizeof(h));
+    if (memcmp(h.magic, SNAP_MAGIC, sizeof(h.magic)) != 0 || h.version != SNAP_VERSION ||
+        h.byteOrder != SNAP_BYTEORDER || h.dirCount == 0)
+        return false;
+    uint64_t dirRec = sizeof(SnapDir) + sizeof(SnapUsage);     // usage after the dirs
+    if (!tablesFit(h, dirRec, sizeof(SnapFile), map.size())) {
+        cerr << "CORRUPT SNAPSHOT: " << path << endl;
+        return false;
+    }
+    region = make_unique<Content::Region>(map.data() + h.dataOff, h.dataSize, h.fileCount);
+    unread.store(1, memory_order_release);
+    root->usage.set(usageRecord(0));
+    root->entries.setSource(this, root, 0);
+    return true;
+}
+
+SnapDir LazySnapshot::dirRecord(uint64_t i) const {
+    SnapDir rec;
+    memcpy(&rec, map.data() + h.dirOff + i * sizeof(SnapDir), sizeof(rec));
+    return rec;
+}
+
+SnapFile LazySnapshot::fileRecord(uint64_t i) const {
+    SnapFile rec;
+    memcpy(&rec, map.data() + h.fileOff + i * sizeof(SnapFile), sizeof(rec));
+    return rec;
+}
+
+Usage LazySnapshot::usageRecord(uint64_t i) const {
+    SnapUsage rec;
+    memcpy(&rec, map.data() + h.dirOff + h.dirCount * sizeof(SnapDir) + i * sizeof(SnapUsage), sizeof(rec));
+    return {rec.bytes, rec.files, rec.dirs, rec.newest};
+}
+
+string LazySnapshot::name(uint64_t off, uint32_t len) const {
+    return fits(off, len, 1, h.strSize) ? string(map.data() + h.strOff + off, len) : string();
+}
+
+void LazySnapshot::corrupt() const {
+    if (!reported.exchange(true)) cerr << "CORRUPT SNAPSHOT: " << path << endl;
+}
+
+// Parents never decrease in either table
+uint64_t LazySnapshot::firstDir(uint64_t parent) const {
+    uint64_t lo = 1, hi = h.dirCount;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (dirRecord(mid).parent < parent) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+uint64_t LazySnapshot::firstFile(uint64_t parent) const {
+    uint64_t lo = 0, hi = h.fileCount;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (fileRecord(mid).parent < parent) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// onDir(name, index), onFile(name, record) for the entries of directory
+// `index` that are well formed, in table order
+template <class OnDir, class OnFile>
+void LazySnapshot::forEachEntry(uint64_t index, OnDir onDir, OnFile onFile) const {
+    for (uint64_t i = firstDir(index); i < h.dirCount; ++i) {
+        SnapDir rec = dirRecord(i);
+        if (rec.parent != index) break;
+        if (i <= index) { corrupt(); continue; }              // must come after its parent
+        string n = name(rec.nameOff, rec.nameLen);
+        if (!validName(n)) { corrupt(); continue; }
+        onDir(move(n), i);
+    }
+    for (uint64_t j = firstFile(index); j < h.fileCount; ++j) {
+        SnapFile rec = fileRecord(j);
+        if (rec.parent != index) break;
+        string n = name(rec.nameOff, rec.nameLen);
+        if (!validName(n)) { corrupt(); continue; }
+        onFile(move(n), rec);
+    }
+}
+
+bool LazySnapshot::loadContent(const SnapFile& rec, Content& out) const {
+    if (!rec.dataLen) return true;
+    if (rec.packedLen) {
+        return rec.packedLen % sizeof(SnapBlock) == 0 && rec.dataOff <= h.dataSize &&
+               rec.packedLen <= h.dataSize - rec.dataOff &&
+               out.loadBlocks(map.data() + h.dataOff + rec.dataOff,
+                              rec.packedLen / sizeof(SnapBlock), rec.dataLen, *region);
+    }
+    return fits(rec.dataOff, rec.dataLen, 1, h.dataSize) && out.loadMapped(rec.dataOff, rec.dataLen, *region);
+}
+
+namespace {
+    // Sorted by name; of two entries with one name the first is kept, as
+    // loadEntries does
+    template <class T, class Name>
+    void sortListing(vector<T>& v, Name name) {
+        stable_sort(v.begin(), v.end(), [&](const T& a, const T& b) { return name(a) < name(b); });
+        v.erase(unique(v.begin(), v.end(), [&](const T& a, const T& b) { return name(a) == name(b); }), v.end());
+    }
+}
+
+void LazySnapshot::readDirs(uint64_t index, vector<pair<string, uint64_t>>& out) const {
+    out.clear();
+    forEachEntry(index, [&](string n, uint64_t i) { out.emplace_back(move(n), i); },
+                 [](string, const SnapFile&) {});
+    sortListing(out, [](const pair<string, uint64_t>& d) -> const string& { return d.first; });
+}
+
+// The content is never marked shared: it is not kept alive past the
+// encoder's use of it, so its identity could come back for other bytes.
+// Bytes several records share are then written once per file.
+void LazySnapshot::readFiles(uint64_t index, vector<ViewFile>& out) const {
+    out.clear();
+    forEachEntry(index, [](string, uint64_t) {}, [&](string n, const SnapFile& rec) {
+        out.push_back({move(n), Content(), rec.createdAt, rec.modifiedAt, false});
+        if (!loadContent(rec, out.back().content)) corrupt();
+    });
+    sortListing(out, [](const ViewFile& f) -> const string& { return f.name; });
+}
+
+uint64_t LazySnapshot::fileRecords(uint64_t index) const {
+    return firstFile(index + 1) - firstFile(index);
+}
+
+// One pass over the file table; a match is placed by walking its parents
+// up to one of `tops`, and is skipped if it gets to the root first
+bool LazySnapshot::findFiles(const unordered_map<uint64_t, Directory*>& tops, const string& pattern,
+                             NameMatch mode, const function<bool(Directory*, const string&)>& visit) const {
+    vector<string> parts;
+    for (uint64_t j = 0; j < h.fileCount; ++j) {
+        SnapFile rec = fileRecord(j);
+        string n = name(rec.nameOff, rec.nameLen);
+        if (!nameMatches(n, pattern, mode) || !validName(n)) continue;
+        parts.assign(1, move(n));
+        uint64_t d = rec.parent;
+        auto top = tops.find(d);
+        while (top == tops.end() && d > 0 && d < h.dirCount) {
+            SnapDir dir = dirRecord(d);
+            string dn = name(dir.nameOff, dir.nameLen);
+            if (dir.parent >= d || !validName(dn)) break;
+            parts.push_back(move(dn));
+            d = dir.parent;
+            top = tops.find(d);
+        }
+        if (top == tops.end()) continue;
+        string rel;
+        for (size_t k = parts.size(); k-- > 0;) rel += parts[k] + (k ? "/" : "");
+        if (!visit(top->second, rel)) return false;
+    }
+    return true;
+}
+
+// Runs under nodeMtx, like every other use of the pools and the name index
+void LazySnapshot::loadEntries(Directory* dir, uint64_t index) {
+    OpTimer timer(Op::LoadDirectory);
+    lock_guard<recursive_mutex> lock(fs.nodeMtx);
+    EntryTable& table = dir->entries;
+    if (table.resident()) return;                              // another thread was first
+
+    forEachEntry(index, [&](const string& n, uint64_t i) {
+        Directory* d = fs.dirPool.create(n, dir);
+        if (!table.insertLoaded(d)) { fs.dirPool.destroy(d); corrupt(); return; }
+        unread.fetch_add(1, memory_order_relaxed);
+        d->usage.set(usageRecord(i));
+        d->entries.setSource(this, d, i);
+    }, [&](const string& n, const SnapFile& rec) {
+        File* f = fs.filePool.create(n, rec.createdAt, rec.modifiedAt);
+        if (!table.insertLoaded(f)) { fs.filePool.destroy(f); corrupt(); return; }
+        f->parent = dir;
+        fs.nameIndex.add(f);
+        if (!loadContent(rec, f->content)) corrupt();
+    });
+    table.markResident();
+    unread.fetch_sub(1, memory_order_acq_rel);
+}
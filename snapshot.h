@@ -0,0 +1,187 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "content.h"
+#include "dirtable.h"
+#include "mvcc.h"
+#include "nameindex.h"
+#include "usage.h"
+
+class FileSystem;
+
+// ── Binary snapshot layout ───────────────────────────────────────
+//
+//   SnapHeader
+//   string table      names, referenced by (offset, length)
+//   directory table   SnapDir[dirCount], breadth-first, index 0 = root
+//   usage table       SnapUsage[dirCount], the directories' recursive totals
+//   file table        SnapFile[fileCount], grouped by parent directory
+//   content region    file bytes, or a block list: Content::BlockRef
+//                     records pointing at chunks stored once each, after
+//                     all the files' own ranges.  Files sharing a buffer
+//                     share a range.
+//
+// Every directory's parent has a smaller index than the directory itself,
+// so the whole tree is rebuilt in one forward pass without any path
+// parsing.  All sections start on an 8-byte boundary.
+
+constexpr char     SNAP_MAGIC[8]  = {'F', 'S', 'S', 'N', 'A', 'P', '\0', '\0'};
+constexpr uint32_t SNAP_VERSION   = 6;     // the only version read
+constexpr uint32_t SNAP_BYTEORDER = 0x01020304;
+
+struct SnapHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t dirCount;
+    uint64_t fileCount;
+    uint64_t strOff,  strSize;
+    uint64_t dirOff;
+    uint64_t fileOff;
+    uint64_t dataOff, dataSize;
+    uint64_t journalSeq;        // last journal record contained in the snapshot
+};
+
+struct SnapDir {
+    uint32_t parent;            // index into the directory table
+    uint32_t nameLen;
+    uint64_t nameOff;           // into the string table
+};
+
+// What Directory::usage holds, so a lazily read directory knows its
+// totals without reading what is below it
+struct SnapUsage {
+    uint64_t bytes;
+    uint64_t files;
+    uint64_t dirs;
+    int64_t  newest;            // ns since the epoch, 0: no files
+};
+
+struct SnapFile {
+    uint32_t parent;            // index into the directory table
+    uint32_t nameLen;
+    uint64_t nameOff;
+    int64_t  createdAt;         // ns since the epoch
+    int64_t  modifiedAt;
+    uint64_t dataOff;           // into the content region
+    uint64_t dataLen;
+    uint64_t packedLen;         // block list in the region, 0: raw bytes
+};
+
+using SnapBlock = Content::BlockRef;
+static_assert(sizeof(SnapBlock) == 16, "block list records are 16 bytes");
+
+// A fully encoded snapshot, ready to be written out (possibly from a
+// background thread while the tree keeps changing).
+//
+// The tables are encoded into a handful of buffers, and small file
+// contents are packed into buffers as well.  Larger contents are not
+// copied at all: the image keeps a reference to them (copy-on-write keeps
+// the bytes unchanged) and they are written straight from their extents.
+// Chunks in block lists are written from where they are, too, while
+// `pinned` holds the files they belong to.  `layout` lists the pieces in
+// file order; writeTo hands them to the OS in large vectored writes.
+struct SnapshotImage {
+    struct Segment {
+        bool pinned;                // pinned[index], else blobs[index]
+        uint32_t index;
+        uint64_t off, len;
+        const char* bytes = nullptr;   // else a chunk's stored bytes
+    };
+    SnapHeader header{};
+    std::vector<std::string> blobs;
+    std::vector<Content> pinned;
+    std::vector<Segment> layout;
+
+    bool writeTo(const std::string& filename) const;
+};
+
+// Read-only view of a whole file: mmap where available, a plain read
+// into memory otherwise.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool ok() const { return data_ != nullptr; }
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    bool mapped_ = false;
+};
+
+bool isSnapshotFile(const std::string& path);
+
+// fsyncs the directory holding `path`, so a rename into it survives a
+// crash; a no-op where directories cannot be synced
+bool syncParentDir(const std::string& path);
+
+// ── Lazy loading ─────────────────────────────────────────────────
+//
+// A snapshot the tree is read from on demand.  Opening it only checks
+// the header; the root starts out unread, and a directory's entries are
+// read from the tables the first time anything looks at them (EntryTable
+// faults them in).  Directories are stored breadth-first and files grouped
+// by ascending parent, so the children of directory i are two binary
+// searches away.  File content is not copied: its chunks point into the
+// mapping, which the OS pages in as they are read, until a write copies
+// the chunks it touches.
+//
+// An unread directory can also be read without building it: the snapshot
+// encoder lists it straight from the tables (from any thread, since no
+// node is made), and `find` matches the names in the file table.
+class LazySnapshot : public EntrySource {
+public:
+    LazySnapshot(FileSystem& fs, const std::string& path);
+    bool open(Directory* root);                 // false: not a current snapshot
+    const SnapHeader& header() const { return h; }
+    bool complete() const { return unread.load(std::memory_order_acquire) == 0; }
+    // Nothing points into the file any more: every directory was read or
+    // dropped and no content is left in the mapping
+    bool idle() const { return complete() && region->unused(); }
+
+    void loadEntries(Directory* dir, uint64_t index) override;
+    void dropped() override { unread.fetch_sub(1, std::memory_order_acq_rel); }
+
+    // Directory `index` as it is in the file: subdirectories with their
+    // indexes, files with their content left in the mapping
+    void readDirs(uint64_t index, std::vector<std::pair<std::string, uint64_t>>& out) const;
+    void readFiles(uint64_t index, std::vector<ViewFile>& out) const;
+    uint64_t fileRecords(uint64_t index) const;  // file table entries, valid or not
+    // Calls visit(top, path below top) for the files whose name matches,
+    // below the directories in `tops` (index -> node), until it returns false
+    bool findFiles(const std::unordered_map<uint64_t, Directory*>& tops, const std::string& pattern,
+                   NameMatch mode, const std::function<bool(Directory*, const std::string&)>& visit) const;
+
+private:
+    SnapDir dirRecord(uint64_t i) const;
+    SnapFile fileRecord(uint64_t i) const;
+    Usage usageRecord(uint64_t i) const;
+    std::string name(uint64_t off, uint32_t len) const;
+    uint64_t firstDir(uint64_t parent) const;   // both tables are sorted by parent
+    uint64_t firstFile(uint64_t parent) const;
+    template <class OnDir, class OnFile>
+    void forEachEntry(uint64_t index, OnDir onDir, OnFile onFile) const;
+    bool loadContent(const SnapFile& rec, Content& out) const;
+    void corrupt() const;
+
+    FileSystem& fs;
+    std::string path;
+    MappedFile map;
+    SnapHeader h{};
+    std::unique_ptr<Content::Region> region;
+    std::atomic<uint64_t> unread{0};            // directories not read yet
+    mutable std::atomic<bool> reported{false};
+};
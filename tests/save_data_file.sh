@@ -0,0 +1,39 @@
+#!/bin/sh
+# Regression test: `save FILE` and the journal.
+#
+# Saving to the data file must leave nothing in the journal that the
+# snapshot already holds, and a snapshot saved anywhere else must load
+# on its own without any journal replayed on top of it.
+#
+# Usage: tests/save_data_file.sh [path/to/filesystem]
+FS=$(cd "$(dirname "${1:-./filesystem}")" && pwd)/$(basename "${1:-./filesystem}")
+WORK=$(mktemp -d) || exit 1
+trap 'rm -rf "$WORK"' EXIT
+cd "$WORK" || exit 1
+failed=0
+
+check() {                       # check NAME EXPECTED ACTUAL
+    if [ "$2" = "$3" ]; then
+        echo "ok   $1"
+    else
+        echo "FAIL $1: expected $2, got $3"
+        failed=1
+    fi
+}
+
+ones() {                        # lines reading "one" in the output of `cat /a`
+    printf 'cat /a\n' | "$FS" "$@" --script - 2>/dev/null | grep -c '^one$'
+}
+
+printf 'touch /a\nappend /a one\nsave d.bin\n' | "$FS" --data d.bin --script - >/dev/null 2>&1
+check "save to the data file, then restart" 1 "$(ones --data d.bin)"
+check "... and restart again" 1 "$(ones --data d.bin)"
+
+printf 'touch /a\nappend /a one\nsave ./e.bin\n' | "$FS" --data e.bin --script - >/dev/null 2>&1
+check "save to the data file by another path" 1 "$(ones --data e.bin)"
+
+printf 'touch /a\nappend /a one\nsave copy.bin\n' | "$FS" --data f.bin --script - >/dev/null 2>&1
+check "save to another file, then restart" 1 "$(ones --data f.bin)"
+check "the other file loads on its own" 1 "$(ones --data copy.bin)"
+
+exit $failed
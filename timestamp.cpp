@@ -0,0 +1,66 @@
+#include "timestamp.h"
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+using namespace std;
+
+namespace {
+    constexpr Timestamp NS_PER_SEC = 1000000000;
+}
+
+/*─────────────────────────  Clocks  ───────────────────────────*/
+Timestamp wallClock() {
+    return chrono::duration_cast<chrono::nanoseconds>(
+        chrono::system_clock::now().time_since_epoch()).count();
+}
+
+Timestamp coarseClock() {
+#ifdef CLOCK_REALTIME_COARSE
+    struct timespec ts;
+    if (clock_gettime(CLOCK_REALTIME_COARSE, &ts) == 0)
+        return static_cast<Timestamp>(ts.tv_sec) * NS_PER_SEC + ts.tv_nsec;
+#endif
+    return wallClock();
+}
+
+/*──────────────────────  Text conversion  ─────────────────────*/
+// Both directions remember the last second they converted: exports and
+// imports see long runs of files sharing one stamp.
+string formatTimestamp(Timestamp t) {
+    thread_local time_t lastSec = -1;
+    thread_local string lastText;
+    time_t sec = static_cast<time_t>(t / NS_PER_SEC);
+    if (sec != lastSec) {
+        struct tm tmv{};
+#ifdef _WIN32
+        localtime_s(&tmv, &sec);
+#else
+        localtime_r(&sec, &tmv);
+#endif
+        char buf[32]{};
+        strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tmv);
+        lastText = buf;
+        lastSec = sec;
+    }
+    return lastText;
+}
+
+bool parseTimestamp(const string& text, Timestamp& t) {
+    thread_local string lastText;
+    thread_local Timestamp lastValue = 0;
+    if (!lastText.empty() && text == lastText) { t = lastValue; return true; }
+
+    struct tm tmv{};
+    if (sscanf(text.c_str(), "%d-%d-%d %d:%d:%d", &tmv.tm_year, &tmv.tm_mon, &tmv.tm_mday,
+               &tmv.tm_hour, &tmv.tm_min, &tmv.tm_sec) != 6)
+        return false;
+    tmv.tm_year -= 1900;
+    tmv.tm_mon -= 1;
+    tmv.tm_isdst = -1;
+    time_t sec = mktime(&tmv);
+    if (sec == static_cast<time_t>(-1)) return false;
+    lastText = text;
+    lastValue = static_cast<Timestamp>(sec) * NS_PER_SEC;
+    t = lastValue;
+    return true;
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// File times are nanoseconds since the Unix epoch.  They are turned into
+// local "YYYY-MM-DD HH:MM:SS" text only for display and for the text
+// export format, never on the create / copy path.
+using Timestamp = int64_t;
+
+Timestamp wallClock();                          // precise
+Timestamp coarseClock();                        // cheap, a few ms resolution
+std::string formatTimestamp(Timestamp t);
+bool parseTimestamp(const std::string& text, Timestamp& t);
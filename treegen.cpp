@@ -0,0 +1,203 @@
+#include "filesystem.h"
+#include "treegen.h"
+#include "numparse.h"
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+using namespace std;
+
+/*─────────────────────────  Tree spec  ─────────────────────────*/
+namespace {
+    constexpr double MAX_NUMBER = 1e15;                        // exact in a double
+
+    bool parseUnsigned(const string& s, unsigned& v) {
+        double d;
+        if (!parseNumber(s, d, MAX_NUMBER) || d > 1e9) return false;
+        v = static_cast<unsigned>(d);
+        return true;
+    }
+}
+
+bool SizeDist::parse(const string& text) {
+    size_t colon = text.find(':');
+    if (colon == string::npos) return false;
+    string kindName = text.substr(0, colon), rest = text.substr(colon + 1);
+    SizeDist d;
+    if (kindName == "fixed") {
+        d.kind = Fixed;
+        if (!parseNumber(rest, d.a, MAX_NUMBER)) return false;
+        d.b = d.a;
+    } else if (kindName == "uniform" || kindName == "lognormal") {
+        size_t sep = rest.find(kindName == "uniform" ? '-' : ',');
+        if (sep == string::npos || !parseNumber(rest.substr(0, sep), d.a, MAX_NUMBER)
+            || !parseNumber(rest.substr(sep + 1), d.b, MAX_NUMBER)) return false;
+        d.kind = kindName == "uniform" ? Uniform : LogNormal;
+        if (d.kind == Uniform && d.b < d.a) return false;
+    } else {
+        return false;
+    }
+    *this = d;
+    return true;
+}
+
+string SizeDist::describe() const {
+    ostringstream out;
+    if (kind == Fixed) out << "fixed:" << a;
+    else if (kind == Uniform) out << "uniform:" << a << '-' << b;
+    else out << "lognormal:" << a << ',' << b;
+    return out.str();
+}
+
+bool TreeSpec::set(const string& name, const string& value) {
+    double d;
+    if (name == "entries" || name == "n") {
+        if (!parseNumber(value, d, MAX_NUMBER) || d < 1) return false;
+        entries = static_cast<uint64_t>(d);
+        return true;
+    }
+    if (name == "seed") {
+        if (!parseNumber(value, d, MAX_NUMBER)) return false;
+        seed = static_cast<uint64_t>(d);
+        return true;
+    }
+    if (name == "size") return sizes.parse(value);
+    if (name == "fanout") return parseUnsigned(value, fanout);
+    if (name == "depth")  return parseUnsigned(value, depth);
+    if (name == "files")  return parseUnsigned(value, files);
+    if (name == "age")    return parseUnsigned(value, ageDays);
+    if (name == "name")   return parseUnsigned(value, nameLength) && nameLength > 0;
+    return false;
+}
+
+string TreeSpec::describe() const {
+    ostringstream out;
+    out << "fanout=" << fanout << " depth=" << depth
+        << " files=" << files << " name=" << nameLength << " size=" << sizes.describe()
+        << " age=" << ageDays << " seed=" << seed;
+    return out.str();
+}
+
+/*───────────────────  FileSystem: generator  ───────────────────*/
+namespace {
+    // splitmix64: small, fast and the same on every platform, unlike
+    // the standard distributions
+    struct Rng {
+        uint64_t s;
+        explicit Rng(uint64_t seed) : s(seed) {}
+        uint64_t next() {
+            uint64_t z = (s += 0x9E3779B97F4A7C15ull);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            return z ^ (z >> 31);
+        }
+        uint64_t below(uint64_t n) { return n ? next() % n : 0; }
+        double unit() { return (next() >> 11) * (1.0 / 9007199254740992.0); }     // [0, 1)
+        double normal() {                                                         // Box-Muller
+            double u = 1.0 - unit(), v = unit();
+            return sqrt(-2.0 * log(u)) * cos(6.283185307179586 * v);
+        }
+    };
+
+    constexpr uint64_t MAX_FILE_SIZE = 1ull << 30;
+    constexpr size_t TEXT_POOL = 1 << 20;      // file bodies are slices of this
+    const char* const EXTENSIONS[] = {".txt", ".csv", ".log", ".json", ".md", ".cpp", ".h", ".bin"};
+
+    uint64_t sampleSize(const SizeDist& d, Rng& rng) {
+        double v;
+        switch (d.kind) {
+        case SizeDist::Fixed:   v = d.a; break;
+        case SizeDist::Uniform: v = d.a + rng.unit() * (d.b - d.a + 1); break;
+        default:                v = d.a * exp(d.b * rng.normal()); break;
+        }
+        return min(static_cast<uint64_t>(max(v, 0.0)), MAX_FILE_SIZE);
+    }
+
+    string randomName(Rng& rng, unsigned meanLength) {
+        static const char ALPHABET[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+        unsigned lo = max(1u, meanLength / 2);
+        unsigned len = lo + static_cast<unsigned>(rng.below(meanLength + 1));
+        string name(len, 'a');
+        for (char& c : name) c = ALPHABET[rng.below(36)];
+        return name;
+    }
+
+    // Word-like lowercase text, so compression and grep see something
+    // closer to real files than random bytes
+    string textPool(Rng& rng) {
+        string text(TEXT_POOL, ' ');
+        for (size_t i = 0; i < text.size();) {
+            size_t word = 2 + rng.below(8);
+            for (size_t j = 0; j < word && i < text.size(); ++j) text[i++] = static_cast<char>('a' + rng.below(26));
+            if (i < text.size()) text[i++] = rng.below(12) ? ' ' : '\n';
+        }
+        return text;
+    }
+}
+
+// Builds the tree described by `spec` under `at`.  Nodes are made
+// directly, like an import, so the caller checkpoints afterwards.
+TreeStats FileSystem::generateTree(Directory* at, const TreeSpec& spec) {
+    Rng rng(spec.seed);
+    string text = textPool(rng);
+    Timestamp stamp = wallClock();
+    const int64_t ageNs = static_cast<int64_t>(spec.ageDays) * 86400 * 1000000000ll;
+    TreeStats stats;
+    uint64_t budget = spec.entries, serial = 0;
+
+    // A random name, and after a few clashes one made unique by a number
+    auto freeName = [&](Directory* dir, const string& suffix) {
+        for (unsigned attempt = 0;; ++attempt) {
+            string name = randomName(rng, spec.nameLength);
+            if (attempt >= 8) name += "_" + to_string(serial++);
+            name += suffix;
+            if (!dir->entries.contains(name)) return name;
+        }
+    };
+    auto addFile = [&](Directory* dir) {
+        string name = freeName(dir, EXTENSIONS[rng.below(sizeof(EXTENSIONS) / sizeof(EXTENSIONS[0]))]);
+        Timestamp modified = stamp - static_cast<int64_t>(rng.below(static_cast<uint64_t>(ageNs) + 1));
+        Timestamp created = modified - static_cast<int64_t>(rng.below(static_cast<uint64_t>(ageNs) / 4 + 1));
+        File* f = newFile(dir, name, created, modified);
+        uint64_t size = sampleSize(spec.sizes, rng);
+        size_t off = static_cast<size_t>(rng.below(TEXT_POOL));
+        size_t first = static_cast<size_t>(min<uint64_t>(size, TEXT_POOL - off));
+        f->content.assign(text.data() + off, first);
+        for (uint64_t done = first; done < size;) {
+            size_t n = static_cast<size_t>(min<uint64_t>(size - done, TEXT_POOL));
+            f->content.append(text.data(), n);
+            done += n;
+        }
+        compressIfLarge(f, false);
+        addUsage(dir, usageOf(f));
+        stats.files++;
+        stats.bytes += size;
+    };
+    auto addDir = [&](Directory* parent) {
+        versions.preserve(parent);
+        Directory* d = newDirectory(freeName(parent, ""), parent);
+        parent->entries.insert(d);
+        addUsage(parent, {0, 0, 1, 0});
+        stats.dirs++;
+        return d;
+    };
+
+    queue<pair<Directory*, unsigned>> pending;
+    vector<Directory*> deepest;
+    pending.push({at, 0});
+    while (budget && !pending.empty()) {
+        Directory* dir = pending.front().first;
+        unsigned level = pending.front().second;
+        pending.pop();
+        for (unsigned i = 0; i < spec.files && budget; ++i, --budget) addFile(dir);
+        if (level >= spec.depth || !spec.fanout) {
+            deepest.push_back(dir);
+            continue;
+        }
+        for (unsigned i = 0; i < spec.fanout && budget; ++i, --budget)
+            pending.push({addDir(dir), level + 1});
+    }
+    // Depth limit reached: the rest goes into the deepest directories
+    for (size_t i = 0; budget && !deepest.empty(); ++i, --budget)
+        addFile(deepest[i % deepest.size()]);
+    return stats;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// Synthetic trees for benchmarks and load tests (`gentree`, fsbench).
+//
+// Directories are filled breadth-first: each gets `files` files and, above
+// `depth`, `fanout` subdirectories, until `entries` nodes exist.  A tree
+// that hits the depth limit first puts the remaining files round-robin into
+// its deepest directories, so any entry count can be reached.  Everything
+// is drawn from `seed`, so the same spec always builds the same tree.
+
+// File sizes in bytes: "fixed:N", "uniform:MIN-MAX" or
+// "lognormal:MEDIAN,SIGMA" (long-tailed, like real file systems)
+struct SizeDist {
+    enum Kind : uint8_t { Fixed, Uniform, LogNormal };
+    Kind kind = LogNormal;
+    double a = 256, b = 1.0;
+    bool parse(const std::string& text);
+    std::string describe() const;
+};
+
+struct TreeSpec {
+    uint64_t entries = 10000;                  // directories + files
+    unsigned fanout = 8;                       // subdirectories per directory
+    unsigned depth = 10;                       // directory levels below the start
+    unsigned files = 48;                       // files per directory
+    unsigned nameLength = 10;                  // mean; each name is 50% - 150% of it
+    SizeDist sizes;
+    unsigned ageDays = 365;                    // modification times spread over this
+    uint64_t seed = 1;
+
+    // Sets one option by name ("entries", "fanout", "size", ...); counts
+    // may be written as 1e6.  False if the name or the value is invalid
+    bool set(const std::string& name, const std::string& value);
+    std::string describe() const;              // the shape; without the entry count
+};
+
+struct TreeStats {
+    uint64_t dirs = 0, files = 0, bytes = 0;
+};
@@ -0,0 +1,270 @@
+#include "filesystem.h"
+#include "treerender.h"
+#include "bufwriter.h"
+#include "metrics.h"
+#include "fmtguard.h"
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+using namespace std;
+
+/*─────────────────────────  Formats  ───────────────────────────*/
+bool parseTreeFormat(const string& text, TreeFormat& format) {
+    if (text == "text") format = TreeFormat::Text;
+    else if (text == "jsonl" || text == "json") format = TreeFormat::JsonLines;
+    else return false;
+    return true;
+}
+
+namespace {
+    constexpr size_t TREE_BUFFER = 1 << 20;
+    thread_local vector<char> treeBuffer;                      // kept between dumps
+
+    void indent(BufferedWriter& out, uint64_t n) {
+        static const char spaces[] = "                                                                ";
+        constexpr uint64_t WIDTH = sizeof(spaces) - 1;
+        for (; n > WIDTH; n -= WIDTH) out.write(spaces, WIDTH);
+        out.write(spaces, n);
+    }
+
+    // `p` escaped for a JSON string; plain runs are copied in one piece
+    void jsonEscaped(BufferedWriter& out, const char* p, size_t n) {
+        size_t run = 0;
+        for (size_t i = 0; i < n; ++i) {
+            unsigned char c = static_cast<unsigned char>(p[i]);
+            if (c >= 0x20 && c != '"' && c != '\\') continue;
+            out.write(p + run, i - run);
+            run = i + 1;
+            if (c == '"' || c == '\\') {
+                out << '\\' << static_cast<char>(c);
+            } else {
+                char esc[8];
+                snprintf(esc, sizeof(esc), "\\u%04x", c);
+                out << static_cast<const char*>(esc);
+            }
+        }
+        out.write(p + run, n - run);
+    }
+
+    // How printTree wrote the tree before the renderer: one insertion
+    // chain per line, each ended with endl.  Kept for treebench
+    uint64_t printTreeLines(const TreeView& view, Directory* top, ostream& out) {
+        out << "\n===== FILE SYSTEM TREE =====" << endl;
+        vector<pair<ViewDir, size_t>> stack{{{top->name, top}, 0}};
+        vector<ViewDir> subs;
+        vector<ViewFile> files;
+        uint64_t nodes = 0;
+        while (!stack.empty()) {
+            ViewDir dir = move(stack.back().first);
+            size_t depth = stack.back().second;
+            stack.pop_back();
+            out << string(2 * depth, ' ') << "+ " << dir.name << "/" << endl;
+            view.listFiles(dir.node, files);
+            for (const ViewFile& f : files) out << string(2 * depth + 2, ' ') << "- " << f.name << endl;
+            view.listDirs(dir.node, subs);
+            for (auto it = subs.rbegin(); it != subs.rend(); ++it) stack.push_back({move(*it), depth + 1});
+            nodes += 1 + files.size();
+        }
+        out << "===========================\n" << endl;
+        return nodes;
+    }
+
+    // Creates a new, empty scratch file in `dir` and returns its name ("" if
+    // none could be made).  The name carries the pid and a counter, and the
+    // "x" mode opens it O_CREAT|O_EXCL, so a file or link already there is
+    // never followed or truncated
+    string createScratchFile(const std::filesystem::path& dir) {
+#ifdef _WIN32
+        int pid = _getpid();
+#else
+        int pid = static_cast<int>(getpid());
+#endif
+        static atomic<unsigned> counter{0};
+        for (int tries = 0; tries < 100; ++tries) {
+            string name = (dir / ("fs_treebench." + to_string(pid) + "." + to_string(counter++) + ".tmp")).string();
+            if (FILE* f = fopen(name.c_str(), "wbx")) {
+                fclose(f);
+                return name;
+            }
+            if (errno != EEXIST) break;
+        }
+        return "";
+    }
+}
+
+/*────────────────────────  Rendering  ──────────────────────────*/
+// Depth-first with an explicit stack, so a deep chain cannot overflow.
+// Works the same on the live tree and on a pinned view.  Returns the
+// number of nodes written.
+uint64_t FileSystem::renderTree(const TreeView& view, Directory* top, const TreeRenderSpec& spec, ostream& os) {
+    OpTimer timer(Op::RenderTree);
+    bool json = spec.format == TreeFormat::JsonLines;
+    bool totals = json && !view.pinned();
+    if (treeBuffer.capacity() < TREE_BUFFER) treeBuffer.reserve(TREE_BUFFER);
+    BufferedWriter out(os, treeBuffer);
+    if (spec.framed && !json) out << "\n===== FILE SYSTEM TREE =====\n";
+
+    // JSON: `path` is the current directory's path with a '/' after it,
+    // and at[d] is where the name of a directory at depth d starts in it
+    string path;
+    vector<size_t> at;
+    if (json) {
+        path = pathOf(top);
+        if (path.back() != '/') path += '/';
+        at.assign(1, 0);
+    }
+    vector<pair<ViewDir, uint64_t>> stack{{{top->name, top}, 0}};
+    vector<ViewDir> subs;
+    vector<ViewFile> files;
+    uint64_t nodes = 0;
+    while (!stack.empty()) {
+        ViewDir dir = move(stack.back().first);
+        uint64_t depth = stack.back().second;
+        stack.pop_back();
+        ++nodes;
+        if (json) {
+            if (depth) {
+                path.resize(at[depth]);
+                path += dir.name;
+                path += '/';
+            }
+            if (at.size() < depth + 2) at.resize(depth + 2);
+            at[depth + 1] = path.size();
+            out << "{\"path\":\"";
+            jsonEscaped(out, path.data(), max<size_t>(1, path.size() - 1));
+            out << "\",\"type\":\"dir\",\"depth\":" << depth;
+            if (totals) {
+                Usage u = dir.node->usage.get();
+                out << ",\"size\":" << u.bytes << ",\"files\":" << u.files << ",\"dirs\":" << u.dirs
+                    << ",\"modified\":" << static_cast<int64_t>(u.newest);
+            }
+            out << "}\n";
+        } else {
+            indent(out, 2 * depth);
+            out << "+ " << dir.name << "/\n";
+        }
+        if (depth >= spec.maxDepth) continue;                  // shown, not listed
+
+        view.listFiles(dir.node, files);
+        for (const ViewFile& f : files) {
+            if (json) {
+                out << "{\"path\":\"";
+                jsonEscaped(out, path.data(), path.size());
+                jsonEscaped(out, f.name.data(), f.name.size());
+                out << "\",\"type\":\"file\",\"depth\":" << depth + 1 << ",\"size\":" << f.content.size()
+                    << ",\"created\":" << static_cast<int64_t>(f.createdAt)
+                    << ",\"modified\":" << static_cast<int64_t>(f.modifiedAt) << "}\n";
+            } else {
+                indent(out, 2 * depth + 2);
+                out << "- " << f.name << '\n';
+            }
+        }
+        nodes += files.size();
+        view.listDirs(dir.node, subs);
+        for (auto it = subs.rbegin(); it != subs.rend(); ++it) stack.push_back({move(*it), depth + 1});
+    }
+    if (spec.framed && !json) out << "===========================\n\n";
+    return nodes;
+}
+
+/*─────────────────────────  Commands  ──────────────────────────*/
+// tree [-depth N] [-format text|jsonl] [-out FILE] [DIR]: the whole tree
+// or DIR's subtree, on the screen or into a host file
+bool FileSystem::treeCommand(const vector<string>& args) {
+    TreeRenderSpec spec;
+    string file;
+    size_t i = 1;
+    for (; i + 1 < args.size() && (args[i] == "-depth" || args[i] == "-format" || args[i] == "-out"); i += 2) {
+        const string& value = args[i + 1];
+        if (args[i] == "-format") {
+            if (!parseTreeFormat(value, spec.format)) return false;
+        } else if (args[i] == "-out") {
+            file = value;
+        } else {
+            if (value.empty() || !isdigit(static_cast<unsigned char>(value[0]))) return false;
+            char* end = nullptr;
+            errno = 0;
+            spec.maxDepth = strtoull(value.c_str(), &end, 10);
+            if (*end || errno == ERANGE) return false;
+        }
+    }
+    if (i + 1 < args.size()) return false;
+    Directory* top = i < args.size() ? resolveDir(args[i]) : root;
+    if (!top) return false;
+    TreeView view(root);
+    if (file.empty()) {
+        renderTree(view, top, spec, cout);
+        return true;
+    }
+    spec.framed = false;
+    ofstream out(file, ios::binary | ios::trunc);
+    if (!out) return false;
+    uint64_t nodes = renderTree(view, top, spec, out);
+    out.close();
+    if (!out) return false;
+    cout << "WROTE " << nodes << " NODE(S) TO " << file << endl;
+    return true;
+}
+
+// Writes the same tree to a scratch file on the host three ways: line by
+// line with endl as printTree used to, and through the renderer as text
+// and as JSON Lines.  Both text dumps must come out the same size.
+bool FileSystem::treeBench(Directory* scope) {
+    Directory* top = scope ? scope : root;
+    error_code ec;
+    std::filesystem::path tmp = std::filesystem::temp_directory_path(ec);
+    if (ec) tmp = ".";
+    string file = createScratchFile(tmp);
+    if (file.empty()) return false;
+    loadAll();                                                 // no faults inside the timings
+    TreeView view(root);
+
+    struct Run { uint64_t nodes; double ms; uint64_t bytes; };
+    auto timed = [&](const function<uint64_t(ostream&)>& write, Run& r) {
+        ofstream out(file, ios::binary | ios::trunc);
+        if (!out) return false;
+        auto t0 = chrono::steady_clock::now();
+        r.nodes = write(out);
+        out.close();
+        r.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+        r.bytes = std::filesystem::file_size(file, ec);
+        return !ec && !out.fail();
+    };
+    Run lines{}, text{}, jsonl{};
+    TreeRenderSpec textSpec, jsonSpec;
+    jsonSpec.format = TreeFormat::JsonLines;
+    bool ok = timed([&](ostream& o) { return printTreeLines(view, top, o); }, lines)
+           && timed([&](ostream& o) { return renderTree(view, top, textSpec, o); }, text)
+           && timed([&](ostream& o) { return renderTree(view, top, jsonSpec, o); }, jsonl);
+    std::filesystem::remove(file, ec);
+    if (!ok) return false;
+
+    FormatGuard format(cout);
+    cout << "TREE BENCHMARK: " << lines.nodes << " NODE(S) UNDER " << pathOf(top) << " TO " << file << '\n'
+         << left << setw(10) << "MODE" << right << setw(12) << "MS" << setw(14) << "NODES/S"
+         << setw(10) << "MB/S" << setw(10) << "SPEEDUP" << '\n';
+    auto row = [&](const char* mode, const Run& r, bool same) {
+        double sec = r.ms / 1000;
+        cout << left << setw(10) << mode << right << fixed
+             << setw(12) << setprecision(2) << r.ms
+             << setw(14) << setprecision(0) << (sec > 0 ? r.nodes / sec : 0.0)
+             << setw(10) << (sec > 0 ? r.bytes / 1e6 / sec : 0.0)
+             << setw(10) << setprecision(2) << (r.ms > 0 ? lines.ms / r.ms : 0.0)
+             << (same ? "" : "  MISMATCH") << '\n';
+    };
+    row("endl", lines, true);
+    row("text", text, text.nodes == lines.nodes && text.bytes == lines.bytes);
+    row("jsonl", jsonl, jsonl.nodes == lines.nodes);
+    return true;
+}
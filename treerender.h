@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// Tree dumps (`tree` in script mode, the menu's tree view, `snapshot tree`).
+//
+// The renderer walks the tree depth-first with an explicit stack and
+// writes every line into one large buffer that is kept per thread and
+// handed to the stream in a single write() whenever it fills, so a dump
+// of millions of nodes costs a few hundred writes instead of a flush per
+// line.  The walk can start at any directory and stop at a depth limit;
+// directories at the limit are shown but not listed.
+//
+// Text is the indented "+ dir/" / "- file" layout.  JSON Lines gives one
+// object per node with its absolute path, depth, size and times in ns
+// since the epoch:
+//
+//   {"path":"/a","type":"dir","depth":1,"size":512,"files":2,"dirs":0,"modified":...}
+//   {"path":"/a/b.txt","type":"file","depth":2,"size":256,"created":...,"modified":...}
+//
+// A directory's size, counts and time are its recursive totals (usage.h);
+// they describe the live tree, so records from a pinned view leave them out.
+
+enum class TreeFormat : uint8_t { Text, JsonLines };
+
+bool parseTreeFormat(const std::string& text, TreeFormat& format);    // "text", "jsonl"
+
+struct TreeRenderSpec {
+    TreeFormat format = TreeFormat::Text;
+    uint64_t maxDepth = UINT64_MAX;            // levels below the top; 0: the top only
+    bool framed = true;                        // Text: the "FILE SYSTEM TREE" banner
+};
@@ -0,0 +1,180 @@
+#include "filesystem.h"
+#include "metrics.h"
+#include <algorithm>
+#include <iomanip>
+using namespace std;
+
+/*──────────────────────  Maintained totals  ────────────────────*/
+Usage FileSystem::usageOf(const File* f) const {
+    return {f->content.size(), 1, 0, f->modifiedAt};
+}
+
+Usage FileSystem::subtreeUsage(const Directory* d) const {
+    Usage u = d->usage.get();
+    u.dirs++;                                                  // d itself
+    return u;
+}
+
+// Newest file time in `d`, from its own files and its subdirectories' totals
+Timestamp FileSystem::newestIn(const Directory* d) const {
+    Timestamp newest = 0;
+    d->entries.forEach([&](Directory* sub) { newest = max(newest, sub->usage.newestTime()); },
+                       [&](File* f) { newest = max(newest, f->modifiedAt); });
+    return newest;
+}
+
+// `u` was linked somewhere below `at` (or into it).  The newest time stops
+// rising at the first directory that was already as new: its ancestors
+// are too, or a concurrent change is raising them.
+void FileSystem::addUsage(Directory* at, const Usage& u) {
+    bool rising = u.files > 0;
+    for (Directory* d = at; d; d = d->parent) {
+        d->usage.add(static_cast<int64_t>(u.bytes), static_cast<int64_t>(u.files), static_cast<int64_t>(u.dirs));
+        if (rising) rising = d->usage.raise(u.newest);
+    }
+}
+
+// `u` was unlinked from below `at`; call it once the entry is gone
+void FileSystem::removeUsage(Directory* at, const Usage& u) {
+    for (Directory* d = at; d; d = d->parent)
+        d->usage.add(-static_cast<int64_t>(u.bytes), -static_cast<int64_t>(u.files), -static_cast<int64_t>(u.dirs));
+    if (u.files) dropNewest(at, u.newest);
+}
+
+// A file time `gone` no longer exists below `at`.  Each directory whose
+// newest time it may have been takes the maximum over its entries again,
+// up to the first one that still has a newer (or equal) time.  Entries of
+// `at` and its ancestors cannot change meanwhile (the concurrent API holds
+// their locks); totals of their other subdirectories can, so a lowered
+// time is checked once more against the entries and raised if needed.
+void FileSystem::dropNewest(Directory* at, Timestamp gone) {
+    for (Directory* d = at; d; d = d->parent) {
+        for (;;) {
+            Timestamp seen = d->usage.newestTime();
+            if (seen > gone) return;
+            Timestamp now = newestIn(d);
+            if (now >= seen) return;
+            if (d->usage.lower(seen, now)) {
+                d->usage.raise(newestIn(d));
+                break;
+            }
+        }
+    }
+}
+
+// `f` was written; `before` is usageOf(f) from before the write
+void FileSystem::fileChanged(File* f, const Usage& before) {
+    int64_t grown = static_cast<int64_t>(f->content.size() - before.bytes);
+    bool rising = f->modifiedAt > before.newest;
+    for (Directory* d = f->parent; d; d = d->parent) {
+        d->usage.add(grown, 0, 0);
+        if (rising) rising = d->usage.raise(f->modifiedAt);
+    }
+    if (f->modifiedAt < before.newest) dropNewest(f->parent, before.newest);
+}
+
+/*───────────────────────────  Recount  ─────────────────────────*/
+// Totals of every directory below `top` (and of `top`) counted from the
+// files, in breadth-first order: parents before their children
+void FileSystem::tallyUsage(Directory* top, vector<Directory*>& order, vector<Usage>& totals) {
+    order.assign(1, top);
+    totals.assign(1, Usage());
+    vector<size_t> parentOf{0};
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i]->entries.forEach(
+            [&](Directory* sub) {
+                order.push_back(sub);
+                parentOf.push_back(i);
+                totals.emplace_back();
+            },
+            [&](File* f) {
+                Usage& t = totals[i];
+                t.bytes += f->content.size();
+                t.files++;
+                t.newest = max(t.newest, f->modifiedAt);
+            });
+    }
+    for (size_t i = order.size(); i-- > 1;) {
+        Usage& p = totals[parentOf[i]];
+        const Usage& c = totals[i];
+        p.bytes += c.bytes;
+        p.files += c.files;
+        p.dirs += c.dirs + 1;
+        p.newest = max(p.newest, c.newest);
+    }
+}
+
+// Validation: recounts the subtree and compares every directory's totals
+bool FileSystem::checkUsage(Directory* top) {
+    vector<Directory*> order;
+    vector<Usage> totals;
+    tallyUsage(top, order, totals);
+    size_t bad = 0;
+    for (size_t i = 0; i < order.size(); ++i) {
+        Usage kept = order[i]->usage.get();
+        if (kept == totals[i]) continue;
+        if (++bad <= 10)
+            cout << "MISMATCH " << pathOf(order[i]) << ": KEPT " << kept.bytes << " BYTES, " << kept.files
+                 << " FILES, " << kept.dirs << " DIRS, NEWEST " << kept.newest << "; COUNTED " << totals[i].bytes
+                 << " BYTES, " << totals[i].files << " FILES, " << totals[i].dirs << " DIRS, NEWEST "
+                 << totals[i].newest << '\n';
+    }
+    cout << "USAGE CHECK: " << order.size() << " DIRECTORIES, "
+         << (bad ? to_string(bad) + " MISMATCHED" : string("ALL MATCH")) << endl;
+    return bad == 0;
+}
+
+/*─────────────────────  Script: du, ls -l  ─────────────────────*/
+namespace {
+    void usageLine(const Usage& u, const string& name) {
+        cout << setw(14) << u.bytes << setw(11) << u.files << setw(9) << u.dirs << "  "
+             << left << setw(19) << (u.files ? formatTimestamp(u.newest) : string("-")) << right
+             << "  " << name << '\n';
+    }
+}
+
+// du [-check] [PATH]: totals of PATH and of each of its subdirectories,
+// read from the maintained counters; -check recounts and compares them
+bool FileSystem::duCommand(const vector<string>& args) {
+    size_t i = 1;
+    bool check = i < args.size() && args[i] == "-check";
+    if (check) ++i;
+    if (i + 1 < args.size()) return false;
+    string path = i < args.size() ? args[i] : "";
+    Directory* dir = resolveDir(path);
+    if (check) return dir && checkUsage(dir);
+
+    File* file = nullptr;
+    string base;
+    Directory* parent = dir ? nullptr : resolveParent(path, base);
+    if (parent) file = parent->entries.findFile(base);
+    if (!dir && !file) return false;
+
+    cout << setw(14) << "BYTES" << setw(11) << "FILES" << setw(9) << "DIRS" << "  " << left << setw(19)
+         << "NEWEST" << right << "  PATH\n";
+    if (file) {
+        usageLine(usageOf(file), childPath(parent, file->name));
+        cout.flush();
+        return true;
+    }
+    for (Directory* sub : dir->entries.sortedDirs()) usageLine(sub->usage.get(), childPath(dir, sub->name));
+    usageLine(dir->usage.get(), pathOf(dir));
+    cout.flush();
+    return true;
+}
+
+// ls -l: entries with their sizes; a directory's size is its total
+void FileSystem::listLong(Directory* dir) {
+    OpTimer timer(Op::List);
+    cout << "DIRECTORIES:" << endl;
+    for (Directory* d : dir->entries.sortedDirs()) {
+        Usage u = d->usage.get();
+        cout << "  " << setw(14) << u.bytes << setw(9) << u.files << " FILES  " << left << setw(19)
+             << (u.files ? formatTimestamp(u.newest) : string("-")) << right << "  " << d->name << "/\n";
+    }
+    cout << "FILES:" << endl;
+    for (File* f : dir->entries.sortedFiles())
+        cout << "  " << setw(14) << f->content.size() << setw(15) << "" << left << setw(19)
+             << formatTimestamp(f->modifiedAt) << right << "  " << f->name << '\n';
+    cout.flush();
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include "timestamp.h"
+
+// Recursive totals of a directory ("du"): everything below it, the
+// directory itself not included.
+struct Usage {
+    uint64_t bytes = 0;                         // file content, logical size
+    uint64_t files = 0;
+    uint64_t dirs = 0;
+    Timestamp newest = 0;                       // newest file modification, 0: no files
+
+    bool operator==(const Usage& o) const {
+        return bytes == o.bytes && files == o.files && dirs == o.dirs && newest == o.newest;
+    }
+    bool operator!=(const Usage& o) const { return !(*this == o); }
+};
+
+// The totals as every Directory keeps them.
+//
+// A change adds its difference to the directory it happened in and to
+// each ancestor, so reading them is O(1).  The counters are atomic
+// because the concurrent API changes different branches at once while
+// sharing their ancestors.  The newest time only rises on the way up;
+// removing the newest file makes the affected directories take the
+// maximum over their entries again (see FileSystem::removeUsage).
+class DirUsage {
+public:
+    DirUsage() = default;
+    DirUsage(const DirUsage&) = delete;
+    DirUsage& operator=(const DirUsage&) = delete;
+
+    Usage get() const {
+        return {bytes.load(std::memory_order_relaxed), files.load(std::memory_order_relaxed),
+                dirs.load(std::memory_order_relaxed), newest.load(std::memory_order_relaxed)};
+    }
+    void set(const Usage& u) {
+        bytes.store(u.bytes, std::memory_order_relaxed);
+        files.store(u.files, std::memory_order_relaxed);
+        dirs.store(u.dirs, std::memory_order_relaxed);
+        newest.store(u.newest, std::memory_order_relaxed);
+    }
+
+    // Unsigned wrap-around makes a negative delta a subtraction
+    void add(int64_t dBytes, int64_t dFiles, int64_t dDirs) {
+        if (dBytes) bytes.fetch_add(static_cast<uint64_t>(dBytes), std::memory_order_relaxed);
+        if (dFiles) files.fetch_add(static_cast<uint64_t>(dFiles), std::memory_order_relaxed);
+        if (dDirs)  dirs.fetch_add(static_cast<uint64_t>(dDirs), std::memory_order_relaxed);
+    }
+
+    // False if it already was at least `t`
+    bool raise(Timestamp t) {
+        Timestamp cur = newest.load(std::memory_order_relaxed);
+        while (cur < t)
+            if (newest.compare_exchange_weak(cur, t, std::memory_order_relaxed)) return true;
+        return false;
+    }
+    Timestamp newestTime() const { return newest.load(std::memory_order_relaxed); }
+    // Lowers the newest time from `seen` to `t` unless it changed meanwhile
+    bool lower(Timestamp seen, Timestamp t) {
+        return newest.compare_exchange_strong(seen, t, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> bytes{0}, files{0}, dirs{0};
+    std::atomic<Timestamp> newest{0};
+};